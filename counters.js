@@ -0,0 +1,81 @@
+/*
+Creates the counter array for an instrumented file.  Where typed arrays are
+available, the counters are a dense Uint32Array with one element per line;
+"executable" is a hexadecimal bitmap (4 lines per digit, lowest bit first)
+marking the lines which contain statements, so that the other lines can be
+told apart from lines which were never executed.  If "bytes" is true (for
+--mode=boolean) a Uint8Array is used instead.  Elsewhere this falls back to a
+plain array holding 0 for each executable line.
+*/
+if (typeof _$jscoverage_counters !== 'function') {
+  var _$jscoverage_counters = function (length, executable, bytes) {
+    var counters;
+    if (bytes && typeof Uint8Array !== 'undefined') {
+      counters = new Uint8Array(length);
+      counters.executable = executable;
+    }
+    else if (typeof Uint32Array !== 'undefined') {
+      counters = new Uint32Array(length);
+      counters.executable = executable;
+    }
+    else {
+      counters = [];
+      for (var line = 0; line < length; line++) {
+        if ((parseInt(executable.charAt(line >> 2), 16) >> (line & 3)) & 1) {
+          counters[line] = 0;
+        }
+      }
+    }
+    return counters;
+  };
+}
+
+/*
+Creates an ordinary counter array from a compact list of executable lines:
+the lengths (in base 36, separated by commas) of alternating runs of
+non-executable and executable lines, starting with line 0.
+*/
+if (typeof _$jscoverage_decode !== 'function') {
+  var _$jscoverage_decode = function (runs) {
+    var counters = [];
+    var line = 0;
+    runs = runs.split(',');
+    for (var i = 0; i < runs.length; i++) {
+      var end = line + parseInt(runs[i], 36);
+      if (i & 1) {
+        for (; line < end; line++) {
+          counters[line] = 0;
+        }
+      }
+      line = end;
+    }
+    return counters;
+  };
+}
+
+/*
+Creates the block counters for a file instrumented with --granularity=block.
+"encoded" lists the lines of the statements in each block, in base 36,
+separated by commas, with blocks separated by semicolons; the lines are kept
+in the "lines" property so that line counts can be rebuilt from block counts.
+isBoolean is true with --mode=boolean: the blocks of a line are then combined
+with "or" rather than added.
+*/
+if (typeof _$jscoverage_blocks !== 'function') {
+  var _$jscoverage_blocks = function (encoded, isBoolean) {
+    var blocks = [];
+    if (isBoolean) {
+      blocks.isBoolean = true;
+    }
+    blocks.lines = encoded === ''? []: encoded.split(';');
+    for (var i = 0; i < blocks.lines.length; i++) {
+      var lines = blocks.lines[i].split(',');
+      for (var j = 0; j < lines.length; j++) {
+        lines[j] = parseInt(lines[j], 36);
+      }
+      blocks.lines[i] = lines;
+      blocks[i] = 0;
+    }
+    return blocks;
+  };
+}
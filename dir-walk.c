@@ -0,0 +1,359 @@
+/*
+    dir-walk.c - listing the files in a directory tree
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define _GNU_SOURCE
+
+#include <config.h>
+
+#include "dir-walk.h"
+
+#include <string.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "util.h"
+
+/*
+Where possible, directories are opened relative to a descriptor for the root of
+the tree and entries are examined relative to their directory, so that no path
+is built (or resolved by the kernel from the beginning) except for messages.
+The type of most entries is known from readdir (d_type) without a stat call.
+*/
+#if defined(HAVE_OPENAT) && defined(HAVE_FDOPENDIR) && defined(HAVE_FSTATAT)
+#define USE_DIRECTORY_DESCRIPTORS 1
+#endif
+
+/*
+Threads are used only with directory descriptors: the caller may change the
+current directory (make_canonical_path does) while the threads are reading.
+*/
+#if defined(HAVE_PTHREAD_H) && defined(USE_DIRECTORY_DESCRIPTORS)
+#define USE_THREADS 1
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+struct Names {
+  char ** names;
+  size_t length;
+  size_t capacity;
+};
+
+static void Names_init(struct Names * names) {
+  names->names = NULL;
+  names->length = 0;
+  names->capacity = 0;
+}
+
+static void Names_add(struct Names * names, char * name) {
+  if (names->length == names->capacity) {
+    names->capacity = names->capacity == 0? 16: mulst(names->capacity, 2);
+    names->names = xrealloc(names->names, mulst(names->capacity, sizeof(char *)));
+  }
+  names->names[names->length] = name;
+  names->length++;
+}
+
+/* moves all the names from one list to the end of another */
+static void Names_append(struct Names * names, struct Names * other) {
+  for (size_t i = 0; i < other->length; i++) {
+    Names_add(names, other->names[i]);
+  }
+  other->length = 0;
+}
+
+struct Walk {
+  const char * root;
+#ifdef USE_DIRECTORY_DESCRIPTORS
+  int root_fd;
+#endif
+
+  /* directories (relative to the root) not yet read */
+  struct Names directories;
+
+  /* files found but not yet passed to the caller */
+  struct Names files;
+
+#ifdef USE_THREADS
+  /* the number of threads reading a directory */
+  int num_busy;
+
+  pthread_mutex_t mutex;
+
+  /* signalled when there are directories to read, or nothing left to read */
+  pthread_cond_t directories_ready;
+
+  /* signalled when there are files for the caller, or nothing left to read */
+  pthread_cond_t files_ready;
+#endif
+};
+
+static void fatal_entry(const struct Walk * walk, const char * message, const char * name) __attribute__((__noreturn__));
+
+static void fatal_entry(const struct Walk * walk, const char * message, const char * name) {
+  char * path = make_path(walk->root, name);
+  fatal("%s: %s", message, path);
+}
+
+static DIR * open_directory(const struct Walk * walk, const char * name) {
+#ifdef USE_DIRECTORY_DESCRIPTORS
+  int fd = openat(walk->root_fd, *name == '\0'? ".": name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  DIR * dir = fd == -1? NULL: fdopendir(fd);
+  if (dir == NULL) {
+    fatal_entry(walk, "cannot open directory", name);
+  }
+  return dir;
+#else
+  char * path = *name == '\0'? xstrdup(walk->root): make_path(walk->root, name);
+  DIR * dir = xopendir(path);
+  free(path);
+  return dir;
+#endif
+}
+
+static void stat_entry(const struct Walk * walk, DIR * dir, const char * entry, const char * name, struct stat * buf, bool follow) {
+#ifdef USE_DIRECTORY_DESCRIPTORS
+  if (fstatat(dirfd(dir), entry, buf, follow? 0: AT_SYMLINK_NOFOLLOW) == -1) {
+    fatal_entry(walk, "cannot stat file", name);
+  }
+#else
+  char * path = make_path(walk->root, name);
+  if (follow) {
+    xstat(path, buf);
+  }
+  else {
+    xlstat(path, buf);
+  }
+  free(path);
+#endif
+}
+
+/* reads one directory, adding the files and subdirectories in it to the lists */
+static void read_directory(const struct Walk * walk, const char * directory, struct Names * files, struct Names * subdirectories) {
+  DIR * dir = open_directory(walk, directory);
+  struct dirent * e;
+  while ((e = readdir(dir)) != NULL) {
+    if (strcmp(e->d_name, ".") == 0 ||
+        strcmp(e->d_name, "..") == 0) {
+      continue;
+    }
+    char * name = *directory == '\0'? xstrdup(e->d_name): make_path(directory, e->d_name);
+
+    bool is_file = false;
+    bool is_directory = false;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+    is_file = e->d_type == DT_REG;
+    is_directory = e->d_type == DT_DIR;
+#endif
+    if (! is_file && ! is_directory) {
+      struct stat buf;
+      stat_entry(walk, dir, e->d_name, name, &buf, false);
+      if (S_ISREG(buf.st_mode)) {
+        is_file = true;
+      }
+      else if (S_ISDIR(buf.st_mode)) {
+        is_directory = true;
+      }
+#ifndef _WIN32
+      else if (S_ISLNK(buf.st_mode)) {
+        /* check what it points to */
+        stat_entry(walk, dir, e->d_name, name, &buf, true);
+        if (! S_ISREG(buf.st_mode)) {
+          fatal_entry(walk, "refusing to follow symbolic link", name);
+        }
+        is_file = true;
+      }
+#endif
+      else {
+        fatal_entry(walk, "unknown file type", name);
+      }
+    }
+
+    if (is_file) {
+      Names_add(files, name);
+    }
+    else {
+      Names_add(subdirectories, name);
+    }
+  }
+  closedir(dir);
+}
+
+static void call_function(struct Names * files, WalkFunction f, void * data) {
+  for (size_t i = 0; i < files->length; i++) {
+    f(files->names[i], data);
+    free(files->names[i]);
+  }
+  files->length = 0;
+}
+
+#ifdef USE_THREADS
+static void * walk_thread(void * arg) {
+  struct Walk * walk = arg;
+  struct Names files;
+  struct Names subdirectories;
+  Names_init(&files);
+  Names_init(&subdirectories);
+
+  pthread_mutex_lock(&walk->mutex);
+  for (;;) {
+    while (walk->directories.length == 0 && walk->num_busy > 0) {
+      pthread_cond_wait(&walk->directories_ready, &walk->mutex);
+    }
+    if (walk->directories.length == 0) {
+      /* nothing left to read, and no thread will find more */
+      break;
+    }
+    walk->directories.length--;
+    char * directory = walk->directories.names[walk->directories.length];
+    walk->num_busy++;
+    pthread_mutex_unlock(&walk->mutex);
+
+    read_directory(walk, directory, &files, &subdirectories);
+    free(directory);
+
+    pthread_mutex_lock(&walk->mutex);
+    walk->num_busy--;
+    Names_append(&walk->directories, &subdirectories);
+    Names_append(&walk->files, &files);
+    pthread_cond_broadcast(&walk->directories_ready);
+    pthread_cond_signal(&walk->files_ready);
+  }
+  pthread_cond_broadcast(&walk->directories_ready);
+  pthread_cond_signal(&walk->files_ready);
+  pthread_mutex_unlock(&walk->mutex);
+
+  free(files.names);
+  free(subdirectories.names);
+  return NULL;
+}
+
+static void walk_in_threads(struct Walk * walk, int num_threads, WalkFunction f, void * data) {
+  walk->num_busy = 0;
+  pthread_mutex_init(&walk->mutex, NULL);
+  pthread_cond_init(&walk->directories_ready, NULL);
+  pthread_cond_init(&walk->files_ready, NULL);
+
+  pthread_t * threads = xnew(pthread_t, num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    if (pthread_create(threads + i, NULL, walk_thread, walk) != 0) {
+      fatal("cannot create thread");
+    }
+  }
+
+  /* take the files in batches, calling f without holding the lock */
+  struct Names files;
+  Names_init(&files);
+  pthread_mutex_lock(&walk->mutex);
+  for (;;) {
+    while (walk->files.length == 0 && (walk->directories.length > 0 || walk->num_busy > 0)) {
+      pthread_cond_wait(&walk->files_ready, &walk->mutex);
+    }
+    if (walk->files.length == 0) {
+      break;
+    }
+    Names_append(&files, &walk->files);
+    pthread_mutex_unlock(&walk->mutex);
+    call_function(&files, f, data);
+    pthread_mutex_lock(&walk->mutex);
+  }
+  pthread_mutex_unlock(&walk->mutex);
+  free(files.names);
+
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&walk->mutex);
+  pthread_cond_destroy(&walk->directories_ready);
+  pthread_cond_destroy(&walk->files_ready);
+}
+#endif
+
+void walk_directory(const char * directory, int num_threads, WalkFunction f, void * data) {
+  struct Walk walk;
+  walk.root = directory;
+#ifdef USE_DIRECTORY_DESCRIPTORS
+  walk.root_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (walk.root_fd == -1) {
+    fatal("cannot open directory: %s", directory);
+  }
+#endif
+  Names_init(&walk.directories);
+  Names_init(&walk.files);
+  Names_add(&walk.directories, xstrdup(""));
+
+#ifdef USE_THREADS
+  if (num_threads > 1) {
+    walk_in_threads(&walk, num_threads, f, data);
+  }
+  else
+#endif
+  {
+    struct Names subdirectories;
+    Names_init(&subdirectories);
+    while (walk.directories.length > 0) {
+      walk.directories.length--;
+      char * d = walk.directories.names[walk.directories.length];
+      read_directory(&walk, d, &walk.files, &subdirectories);
+      free(d);
+      Names_append(&walk.directories, &subdirectories);
+      call_function(&walk.files, f, data);
+    }
+    free(subdirectories.names);
+  }
+
+  free(walk.directories.names);
+  free(walk.files.names);
+#ifdef USE_DIRECTORY_DESCRIPTORS
+  close(walk.root_fd);
+#endif
+}
+
+static void add_entry(const char * name, void * data) {
+  struct DirListEntry ** head = data;
+  struct DirListEntry * p = xmalloc(sizeof(struct DirListEntry));
+  p->name = xstrdup(name);
+  p->next = *head;
+  *head = p;
+}
+
+struct DirListEntry * make_recursive_dir_list(const char * directory) {
+  struct DirListEntry * head = NULL;
+  walk_directory(directory, 1, add_entry, &head);
+  return head;
+}
+
+void free_dir_list(struct DirListEntry * list) {
+  while (list != NULL) {
+    struct DirListEntry * next = list->next;
+    free(list->name);
+    free(list);
+    list = next;
+  }
+}
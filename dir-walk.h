@@ -0,0 +1,48 @@
+/*
+    dir-walk.h - listing the files in a directory tree
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef DIR_WALK_H_
+#define DIR_WALK_H_
+
+/*
+Called for each regular file (or symbolic link to one) with its path relative
+to the directory being walked.  The name is freed when the function returns.
+*/
+typedef void (*WalkFunction)(const char * name, void * data);
+
+/*
+Calls f for every file in a directory tree, in no particular order.  The tree
+is read by num_threads threads (one if threads are not supported), each reading
+whole directories, and f is called in the calling thread as soon as the files
+of each directory are known: there is no need to wait for the whole tree to be
+read.  Any other kind of file (a device, a socket, or a symbolic link to a
+directory) is a fatal error.
+*/
+void walk_directory(const char * directory, int num_threads, WalkFunction f, void * data);
+
+struct DirListEntry {
+  char * name;
+  struct DirListEntry * next;
+};
+
+struct DirListEntry * make_recursive_dir_list(const char * directory);
+
+void free_dir_list(struct DirListEntry * list);
+
+#endif /* DIR_WALK_H_ */
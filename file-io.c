@@ -0,0 +1,419 @@
+/*
+    file-io.c - batched reading and writing of whole files
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define _GNU_SOURCE
+
+#include <config.h>
+
+#include "file-io.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "util.h"
+
+/* IORING_OP_READ and IORING_OP_WRITE (Linux 5.6) came with IORING_FEAT_RW_CUR_POS */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define USE_IO_URING 1
+#endif
+
+/* the most requests in flight at once */
+#define RING_ENTRIES 64
+
+enum RequestType {
+  REQUEST_READ,
+  REQUEST_WRITE
+};
+
+struct FileRead {
+  enum RequestType type;
+  char * file;
+  int fd;
+  Stream * stream;
+
+  /* the size of the file when it was opened */
+  size_t size;
+
+  bool done;
+};
+
+struct FileWrite {
+  enum RequestType type;
+  char * file;
+  int fd;
+  Stream * stream;
+
+  /* bytes written so far */
+  size_t written;
+};
+
+struct FileIO {
+#ifdef USE_IO_URING
+  /* -1 if io_uring is not available: every operation is then done at once */
+  int ring_fd;
+
+  void * sq_ring;
+  size_t sq_ring_size;
+  void * cq_ring;
+  size_t cq_ring_size;
+  struct io_uring_sqe * sqes;
+  size_t sqes_size;
+
+  unsigned * sq_tail;
+  unsigned sq_mask;
+  unsigned * sq_array;
+  unsigned sq_entries;
+  unsigned * cq_head;
+  unsigned * cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe * cqes;
+
+  /* requests queued but not yet given to the kernel */
+  unsigned to_submit;
+
+  /* requests queued or submitted, but not completed */
+  unsigned in_flight;
+
+  /* writes not completed */
+  unsigned num_writes;
+#else
+  int unused;
+#endif
+};
+
+#ifdef USE_IO_URING
+
+static bool setup_ring(FileIO * io) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+  if (fd == -1) {
+    return false;
+  }
+  if (! (p.features & IORING_FEAT_RW_CUR_POS)) {
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  io->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  io->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (io->cq_ring_size > io->sq_ring_size) {
+      io->sq_ring_size = io->cq_ring_size;
+    }
+    io->cq_ring_size = io->sq_ring_size;
+  }
+  io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (io->sq_ring == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    io->cq_ring = io->sq_ring;
+  }
+  else {
+    io->cq_ring = mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (io->cq_ring == MAP_FAILED) {
+      munmap(io->sq_ring, io->sq_ring_size);
+      close(fd);
+      return false;
+    }
+  }
+  io->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (io->sqes == MAP_FAILED) {
+    if (io->cq_ring != io->sq_ring) {
+      munmap(io->cq_ring, io->cq_ring_size);
+    }
+    munmap(io->sq_ring, io->sq_ring_size);
+    close(fd);
+    return false;
+  }
+
+  uint8_t * sq = io->sq_ring;
+  uint8_t * cq = io->cq_ring;
+  io->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  io->sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+  io->sq_array = (unsigned *) (sq + p.sq_off.array);
+  io->sq_entries = p.sq_entries;
+  io->cq_head = (unsigned *) (cq + p.cq_off.head);
+  io->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  io->cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+  io->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+  io->ring_fd = fd;
+  io->to_submit = 0;
+  io->in_flight = 0;
+  io->num_writes = 0;
+  return true;
+}
+
+/* gives the queued requests to the kernel, and waits for min_complete to complete */
+static void enter(FileIO * io, unsigned int min_complete) {
+  do {
+    int result = syscall(__NR_io_uring_enter, io->ring_fd, io->to_submit, min_complete, min_complete > 0? IORING_ENTER_GETEVENTS: 0, NULL, 0);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fatal("cannot submit input/output requests");
+    }
+    io->to_submit -= result;
+  } while (io->to_submit > 0);
+}
+
+static void wait_for_completion(FileIO * io);
+
+static void queue_request(FileIO * io, uint8_t opcode, int fd, void * buffer, size_t length, size_t offset, void * request) {
+  /* the completion queue has room for twice this many */
+  while (io->in_flight == io->sq_entries) {
+    wait_for_completion(io);
+  }
+
+  unsigned tail = *io->sq_tail;
+  unsigned index = tail & io->sq_mask;
+  struct io_uring_sqe * sqe = io->sqes + index;
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t) buffer;
+  sqe->len = length > UINT32_MAX / 2? UINT32_MAX / 2: length;
+  sqe->off = offset;
+  sqe->user_data = (uintptr_t) request;
+  io->sq_array[index] = index;
+  __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  io->to_submit++;
+  io->in_flight++;
+}
+
+static void queue_read(FileIO * io, struct FileRead * r) {
+  Stream * stream = r->stream;
+  queue_request(io, IORING_OP_READ, r->fd, stream->data + stream->length, stream->capacity - stream->length, stream->length, r);
+}
+
+static void queue_write(FileIO * io, struct FileWrite * w) {
+  Stream * stream = w->stream;
+  queue_request(io, IORING_OP_WRITE, w->fd, stream->data + w->written, stream->length - w->written, w->written, w);
+}
+
+static void finish_read(struct FileRead * r) {
+  if (r->stream->length == r->stream->capacity) {
+    /* the file has grown since it was opened: read the rest the ordinary way */
+    uint8_t buffer[8192];
+    ssize_t n;
+    while ((n = pread(r->fd, buffer, sizeof(buffer), r->stream->length)) != 0) {
+      if (n == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        fatal("cannot read file: %s", r->file);
+      }
+      Stream_write(r->stream, buffer, n);
+    }
+  }
+  close(r->fd);
+  r->done = true;
+}
+
+static void complete_read(FileIO * io, struct FileRead * r, int result) {
+  if (result < 0) {
+    fatal("cannot read file: %s", r->file);
+  }
+  r->stream->length += result;
+  if (result == 0 || r->stream->length == r->size || r->stream->length == r->stream->capacity) {
+    finish_read(r);
+  }
+  else {
+    /* a short read */
+    queue_read(io, r);
+  }
+}
+
+static void complete_write(FileIO * io, struct FileWrite * w, int result) {
+  if (result <= 0) {
+    fatal("cannot write to file: %s", w->file);
+  }
+  w->written += result;
+  if (w->written < w->stream->length) {
+    queue_write(io, w);
+    return;
+  }
+  if (close(w->fd) == -1) {
+    fatal("cannot write to file: %s", w->file);
+  }
+  Stream_delete(w->stream);
+  free(w->file);
+  free(w);
+  io->num_writes--;
+}
+
+static void reap_completions(FileIO * io) {
+  unsigned head = *io->cq_head;
+  while (head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe * cqe = io->cqes + (head & io->cq_mask);
+    void * request = (void *) (uintptr_t) cqe->user_data;
+    int result = cqe->res;
+    head++;
+    __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    io->in_flight--;
+
+    if (*(enum RequestType *) request == REQUEST_READ) {
+      complete_read(io, request, result);
+    }
+    else {
+      complete_write(io, request, result);
+    }
+  }
+}
+
+static void wait_for_completion(FileIO * io) {
+  if (*io->cq_head == __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)) {
+    enter(io, 1);
+  }
+  reap_completions(io);
+}
+
+#endif
+
+FileIO * FileIO_new(void) {
+  FileIO * io = xmalloc(sizeof(FileIO));
+#ifdef USE_IO_URING
+  if (! setup_ring(io)) {
+    io->ring_fd = -1;
+  }
+#endif
+  return io;
+}
+
+FileRead * FileIO_read(FileIO * io, const char * file) {
+  FileRead * r = xmalloc(sizeof(FileRead));
+  r->type = REQUEST_READ;
+  r->file = xstrdup(file);
+  r->done = false;
+
+#ifdef USE_IO_URING
+  if (io->ring_fd != -1) {
+    r->fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (r->fd == -1) {
+      fatal("cannot open file: %s", file);
+    }
+    struct stat buf;
+    if (fstat(r->fd, &buf) == -1) {
+      fatal("cannot stat file: %s", file);
+    }
+    r->size = buf.st_size;
+
+    /* one byte more than the file: reading it all means the file has grown */
+    r->stream = Stream_new(addst(r->size, 1));
+    queue_read(io, r);
+    return r;
+  }
+#endif
+
+  FILE * f = xfopen(file, "rb");
+  r->stream = Stream_new(0);
+  Stream_write_file_contents(r->stream, f);
+  fclose(f);
+  r->done = true;
+  return r;
+}
+
+void FileIO_submit(FileIO * io) {
+#ifdef USE_IO_URING
+  if (io->ring_fd != -1 && io->to_submit > 0) {
+    enter(io, 0);
+  }
+#endif
+}
+
+Stream * FileRead_wait(FileIO * io, FileRead * r) {
+#ifdef USE_IO_URING
+  while (! r->done) {
+    wait_for_completion(io);
+  }
+#endif
+  Stream * stream = r->stream;
+  free(r->file);
+  free(r);
+  return stream;
+}
+
+void FileIO_write(FileIO * io, const char * file, Stream * contents) {
+#ifdef USE_IO_URING
+  if (io->ring_fd != -1) {
+    int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1) {
+      fatal("cannot open file: %s", file);
+    }
+    if (contents->length == 0) {
+      close(fd);
+      Stream_delete(contents);
+      return;
+    }
+    struct FileWrite * w = xmalloc(sizeof(struct FileWrite));
+    w->type = REQUEST_WRITE;
+    w->file = xstrdup(file);
+    w->fd = fd;
+    w->stream = contents;
+    w->written = 0;
+    io->num_writes++;
+    queue_write(io, w);
+    return;
+  }
+#endif
+
+  FILE * f = xfopen(file, "wb");
+  if (fwrite(contents->data, 1, contents->length, f) != contents->length) {
+    fatal("cannot write to file: %s", file);
+  }
+  if (fclose(f) == EOF) {
+    fatal("cannot write to file: %s", file);
+  }
+  Stream_delete(contents);
+}
+
+void FileIO_delete(FileIO * io) {
+#ifdef USE_IO_URING
+  if (io->ring_fd != -1) {
+    while (io->num_writes > 0) {
+      wait_for_completion(io);
+    }
+    munmap(io->sqes, io->sqes_size);
+    if (io->cq_ring != io->sq_ring) {
+      munmap(io->cq_ring, io->cq_ring_size);
+    }
+    munmap(io->sq_ring, io->sq_ring_size);
+    close(io->ring_fd);
+  }
+#endif
+  free(io);
+}
@@ -0,0 +1,56 @@
+/*
+    file-io.h - batched reading and writing of whole files
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef FILE_IO_H_
+#define FILE_IO_H_
+
+#include "stream.h"
+
+/*
+Reads and writes whole files in the background where the platform allows it
+(with io_uring on Linux), so that the caller can work on one file while others
+are being read or written.  Otherwise every operation is an ordinary blocking
+one, done when it is requested.  Errors are fatal, with the same messages as
+xfopen and friends.  A FileIO object is used by one thread.
+*/
+typedef struct FileIO FileIO;
+
+typedef struct FileRead FileRead;
+
+FileIO * FileIO_new(void);
+
+/* starts reading a file; the file is opened at once */
+FileRead * FileIO_read(FileIO * io, const char * file);
+
+/*
+Sends the reads and writes requested so far to the kernel without waiting for
+them.  (They are sent anyway when the caller next has to wait.)
+*/
+void FileIO_submit(FileIO * io);
+
+/* waits for a read to finish and returns the contents of the file; the FileRead is freed */
+Stream * FileRead_wait(FileIO * io, FileRead * read);
+
+/* writes a file, taking ownership of the contents; the file is created (or truncated) at once */
+void FileIO_write(FileIO * io, const char * file, Stream * contents);
+
+/* waits for all the writes to finish */
+void FileIO_delete(FileIO * io);
+
+#endif /* FILE_IO_H_ */
@@ -32,9 +32,14 @@
 #define ERRNO (WSAGetLastError())
 #else
 #include <errno.h>
+#include <sys/select.h>
 #define ERRNO errno
 #endif
 
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
 struct HTTPConnection {
   SOCKET s;
   uint8_t input_buffer[CONNECTION_BUFFER_CAPACITY];
@@ -82,6 +87,33 @@ HTTPConnection * HTTPConnection_new_client(const char * host, uint16_t port) {
   return HTTPConnection_new(s);
 }
 
+HTTPConnection * HTTPConnection_new_unix_client(const char * path) {
+#ifdef HAVE_SYS_UN_H
+  struct sockaddr_un a;
+  if (strlen(path) >= sizeof(a.sun_path)) {
+    return NULL;
+  }
+
+  SOCKET s = socket(PF_UNIX, SOCK_STREAM, 0);
+  if (s == INVALID_SOCKET) {
+    return NULL;
+  }
+
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  strcpy(a.sun_path, path);
+
+  if (connect(s, (struct sockaddr *) &a, sizeof(a)) < 0) {
+    closesocket(s);
+    return NULL;
+  }
+
+  return HTTPConnection_new(s);
+#else
+  return NULL;
+#endif
+}
+
 HTTPConnection * HTTPConnection_new_server(SOCKET s) {
   return HTTPConnection_new(s);
 }
@@ -106,7 +138,9 @@ int HTTPConnection_get_peer(HTTPConnection * connection, struct sockaddr_in * pe
   return result;
 }
 
-int HTTPConnection_read_octet(HTTPConnection * connection, int * octet) {
+/* refills the input buffer if it is empty; *end is true after an orderly shutdown */
+static int fill_input_buffer(HTTPConnection * connection, bool * end) {
+  *end = false;
   if (connection->input_buffer_offset >= connection->input_buffer_length) {
     ssize_t bytes_received = recv(connection->s, connection->input_buffer, CONNECTION_BUFFER_CAPACITY, 0);
     if (bytes_received == -1) {
@@ -116,7 +150,7 @@ int HTTPConnection_read_octet(HTTPConnection * connection, int * octet) {
     }
     else if (bytes_received == 0) {
       /* orderly shutdown */
-      *octet = -1;
+      *end = true;
       return 0;
     }
     else {
@@ -124,11 +158,79 @@ int HTTPConnection_read_octet(HTTPConnection * connection, int * octet) {
       connection->input_buffer_length = bytes_received;
     }
   }
+  return 0;
+}
+
+int HTTPConnection_read_octet(HTTPConnection * connection, int * octet) {
+  bool end;
+  int result = fill_input_buffer(connection, &end);
+  if (result != 0) {
+    return result;
+  }
+  if (end) {
+    *octet = -1;
+    return 0;
+  }
   *octet = connection->input_buffer[connection->input_buffer_offset];
   connection->input_buffer_offset++;
   return 0;
 }
 
+int HTTPConnection_read(HTTPConnection * connection, void * p, size_t capacity, size_t * bytes_read) {
+  *bytes_read = 0;
+  if (capacity == 0) {
+    return 0;
+  }
+
+  /* a large read with nothing buffered goes straight into the caller's memory */
+  if (connection->input_buffer_offset >= connection->input_buffer_length && capacity >= CONNECTION_BUFFER_CAPACITY) {
+    ssize_t bytes_received = recv(connection->s, p, capacity, 0);
+    if (bytes_received == -1) {
+      int result = ERRNO;
+      assert(result != 0);
+      return result;
+    }
+    *bytes_read = bytes_received;
+    return 0;
+  }
+
+  bool end;
+  int result = fill_input_buffer(connection, &end);
+  if (result != 0 || end) {
+    return result;
+  }
+  size_t length = connection->input_buffer_length - connection->input_buffer_offset;
+  if (length > capacity) {
+    length = capacity;
+  }
+  memcpy(p, connection->input_buffer + connection->input_buffer_offset, length);
+  connection->input_buffer_offset += length;
+  *bytes_read = length;
+  return 0;
+}
+
+int HTTPConnection_read_line(HTTPConnection * connection, Stream * stream) {
+  for (;;) {
+    bool end;
+    int result = fill_input_buffer(connection, &end);
+    if (result != 0 || end) {
+      return result;
+    }
+
+    const uint8_t * start = connection->input_buffer + connection->input_buffer_offset;
+    size_t length = connection->input_buffer_length - connection->input_buffer_offset;
+    const uint8_t * newline = memchr(start, '\n', length);
+    if (newline != NULL) {
+      length = newline - start + 1;
+    }
+    Stream_write(stream, start, length);
+    connection->input_buffer_offset += length;
+    if (newline != NULL) {
+      return 0;
+    }
+  }
+}
+
 int HTTPConnection_peek_octet(HTTPConnection * connection, int * octet) {
   int result = HTTPConnection_read_octet(connection, octet);
 
@@ -147,6 +249,50 @@ int HTTPConnection_peek_octet(HTTPConnection * connection, int * octet) {
   return 0;
 }
 
+int HTTPConnection_set_timeout(HTTPConnection * connection, unsigned int seconds) {
+#ifdef _WIN32
+  DWORD timeout = seconds * 1000;
+#else
+  struct timeval timeout;
+  timeout.tv_sec = seconds;
+  timeout.tv_usec = 0;
+#endif
+  if (setsockopt(connection->s, SOL_SOCKET, SO_RCVTIMEO, (const char *) &timeout, sizeof(timeout)) == -1 ||
+      setsockopt(connection->s, SOL_SOCKET, SO_SNDTIMEO, (const char *) &timeout, sizeof(timeout)) == -1) {
+    int result = ERRNO;
+    assert(result != 0);
+    return result;
+  }
+  return 0;
+}
+
+bool HTTPConnection_has_buffered_input(const HTTPConnection * connection) {
+  return connection->input_buffer_offset < connection->input_buffer_length;
+}
+
+int HTTPConnection_wait_for_input(HTTPConnection * connection, unsigned int seconds, bool * ready) {
+  /* a pipelined request may already be in the buffer */
+  if (HTTPConnection_has_buffered_input(connection)) {
+    *ready = true;
+    return 0;
+  }
+
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(connection->s, &fds);
+  struct timeval timeout;
+  timeout.tv_sec = seconds;
+  timeout.tv_usec = 0;
+  int n = select(connection->s + 1, &fds, NULL, NULL, &timeout);
+  if (n == -1) {
+    int result = ERRNO;
+    assert(result != 0);
+    return result;
+  }
+  *ready = n > 0;
+  return 0;
+}
+
 int HTTPConnection_write(HTTPConnection * connection, const void * p, size_t size) {
   while (size > 0) {
     if (connection->output_buffer_length == CONNECTION_BUFFER_CAPACITY) {
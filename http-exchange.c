@@ -27,6 +27,12 @@
 
 #include "util.h"
 
+/*
+On a persistent connection, the start of a response body is held back so that
+a short response can be sent with a Content-Length instead of being chunked.
+*/
+#define RESPONSE_BUFFER_CAPACITY 65536
+
 struct HTTPExchange {
   HTTPConnection * connection;
 
@@ -45,6 +51,10 @@ struct HTTPExchange {
 
   uint16_t status_code;
   char * response_http_version;
+
+  /* used only by a server */
+  bool is_persistent;
+  Stream * response_body;
 };
 
 static const struct {
@@ -110,12 +120,18 @@ HTTPExchange * HTTPExchange_new(HTTPConnection * connection) {
   exchange->response_http_version = NULL;
   exchange->status_code = 0;
 
+  exchange->is_persistent = false;
+  exchange->response_body = NULL;
+
   return exchange;
 }
 
 void HTTPExchange_delete(HTTPExchange * exchange) {
   HTTPMessage_delete(exchange->response_message);
   free(exchange->response_http_version);
+  if (exchange->response_body != NULL) {
+    Stream_delete(exchange->response_body);
+  }
 
   HTTPMessage_delete(exchange->request_message);
   free(exchange->method);
@@ -305,9 +321,14 @@ int HTTPExchange_write_request_headers(HTTPExchange * exchange) {
       if (result != 0) {
         return result;
       }
-      const char * a = inet_ntoa(peer.sin_addr);
       char * value;
-      xasprintf(&value, "%s:%u", a, ntohs(peer.sin_port));
+      if (peer.sin_family == AF_INET) {
+        xasprintf(&value, "%s:%u", inet_ntoa(peer.sin_addr), ntohs(peer.sin_port));
+      }
+      else {
+        /* a Unix domain socket */
+        value = xstrdup("localhost");
+      }
       HTTPMessage_add_header(exchange->request_message, HTTP_HOST, value);
       free(value);
     }
@@ -462,7 +483,42 @@ int HTTPExchange_write_response_headers(HTTPExchange * exchange) {
     HTTPMessage_set_header(exchange->response_message, HTTP_CONTENT_TYPE, "text/html");
   }
 
-  return HTTPMessage_write_start_line_and_headers(exchange->response_message);
+  /*
+  RFC 2616 8.1, 4.4: the connection can be kept open only if the client can
+  tell where the body ends.  A 400 response means the request may not have been
+  read completely.
+  */
+  if (exchange->is_persistent) {
+    if (exchange->status_code == 400) {
+      exchange->is_persistent = false;
+    }
+    else if (! HTTPExchange_response_has_body(exchange) ||
+             HTTPMessage_find_header(exchange->response_message, HTTP_CONTENT_LENGTH) != NULL ||
+             HTTPMessage_find_header(exchange->response_message, HTTP_TRANSFER_ENCODING) != NULL) {
+      /* the length is known */
+    }
+    else if (strcmp(exchange->request_http_version, "HTTP/1.1") == 0) {
+      HTTPMessage_set_chunked(exchange->response_message);
+    }
+    else {
+      exchange->is_persistent = false;
+    }
+  }
+  if (exchange->is_persistent) {
+    HTTPMessage_set_header(exchange->response_message, HTTP_CONNECTION, "keep-alive");
+  }
+
+  int result = HTTPMessage_write_start_line_and_headers(exchange->response_message);
+  if (result != 0) {
+    return result;
+  }
+
+  /* send anything held back */
+  if (exchange->response_body != NULL && exchange->response_body->length > 0) {
+    result = HTTPMessage_write(exchange->response_message, exchange->response_body->data, exchange->response_body->length);
+    Stream_reset(exchange->response_body);
+  }
+  return result;
 }
 
 bool HTTPExchange_response_has_body(const HTTPExchange * exchange) {
@@ -482,6 +538,29 @@ int HTTPExchange_read_entire_response_entity_body(HTTPExchange * exchange, Strea
 }
 
 int HTTPExchange_write_response(HTTPExchange * exchange, const void * p, size_t size) {
+  if (exchange->is_persistent) {
+    if (exchange->status_code == 0) {
+      exchange->status_code = 200;
+    }
+
+    /* on a persistent connection, a body which must not be sent would be taken for the next response */
+    if (! HTTPExchange_response_has_body(exchange)) {
+      return 0;
+    }
+
+    if (! HTTPMessage_has_sent_headers(exchange->response_message) &&
+        HTTPMessage_find_header(exchange->response_message, HTTP_CONTENT_LENGTH) == NULL &&
+        HTTPMessage_find_header(exchange->response_message, HTTP_TRANSFER_ENCODING) == NULL) {
+      if (exchange->response_body == NULL) {
+        exchange->response_body = Stream_new(0);
+      }
+      if (exchange->response_body->length + size <= RESPONSE_BUFFER_CAPACITY) {
+        Stream_write(exchange->response_body, p, size);
+        return 0;
+      }
+    }
+  }
+
   int result = HTTPExchange_write_response_headers(exchange);
   if (result != 0) {
     return result;
@@ -496,3 +575,36 @@ int HTTPExchange_flush_response(HTTPExchange * exchange) {
   }
   return HTTPMessage_flush(exchange->response_message);
 }
+
+void HTTPExchange_set_persistent(HTTPExchange * exchange, bool persistent) {
+  exchange->is_persistent = persistent;
+}
+
+bool HTTPExchange_is_persistent(const HTTPExchange * exchange) {
+  return exchange->is_persistent;
+}
+
+int HTTPExchange_finish_response(HTTPExchange * exchange) {
+  /* a body which was held back completely can be sent with its length */
+  if (! HTTPMessage_has_sent_headers(exchange->response_message) && exchange->response_body != NULL) {
+    HTTPMessage_set_content_length(exchange->response_message, exchange->response_body->length);
+  }
+  int result = HTTPExchange_write_response_headers(exchange);
+  if (result != 0) {
+    return result;
+  }
+
+  /* the client would take whatever follows a short body as the rest of it */
+  if (exchange->is_persistent && HTTPExchange_response_has_body(exchange) && HTTPMessage_is_body_short(exchange->response_message)) {
+    exchange->is_persistent = false;
+  }
+
+  /*
+  Only a persistent connection has a body chunked by the server, so a chunked
+  body here was abandoned by the handler: it must not be ended as if complete.
+  */
+  if (! exchange->is_persistent) {
+    return 0;
+  }
+  return HTTPMessage_finish(exchange->response_message);
+}
@@ -22,6 +22,7 @@
 #include "http-server.h"
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "stream.h"
@@ -47,6 +48,8 @@ struct HTTPMessage {
 
   /* used only for sending */
   bool is_started;
+  bool is_chunked_output;
+  size_t bytes_written;
 };
 
 static bool is_lws(uint8_t c) {
@@ -131,6 +134,8 @@ HTTPMessage * HTTPMessage_new(HTTPConnection * connection) {
   message->chunk_buffer = NULL;
 
   message->is_started = false;
+  message->is_chunked_output = false;
+  message->bytes_written = 0;
   return message;
 }
 
@@ -307,24 +312,7 @@ void HTTPMessage_set_start_line(HTTPMessage * message, const char * start_line)
 static int read_line(Stream * stream, HTTPConnection * connection) __attribute__((warn_unused_result));
 
 static int read_line(Stream * stream, HTTPConnection * connection) {
-  for (;;) {
-    int octet;
-    int result = HTTPConnection_read_octet(connection, &octet);
-    if (result != 0) {
-      return result;
-    }
-
-    /* check for end of input */
-    if (octet == -1) {
-      return 0;
-    }
-
-    char c = (char) octet;
-    Stream_write_char(stream, c);
-    if (c == '\n') {
-      return 0;
-    }
-  }
+  return HTTPConnection_read_line(connection, stream);
 }
 
 static int read_header(Stream * stream, HTTPConnection * connection) __attribute__((warn_unused_result));
@@ -356,12 +344,37 @@ static int read_header(Stream * stream, HTTPConnection * connection) {
 }
 
 static bool stream_contains_nul(const Stream * stream) {
-  for (size_t i = 0; i < stream->length; i++) {
-    if (stream->data[i] == '\0') {
-      return true;
+  return memchr(stream->data, '\0', stream->length) != NULL;
+}
+
+static int parse_content_length(const char * content_length, size_t * result) __attribute__((warn_unused_result));
+
+static int parse_content_length(const char * content_length, size_t * result) {
+  size_t value = 0;
+  for (const char * p = content_length; *p != '\0'; p++) {
+    /* check for overflow */
+    if (SIZE_MAX / 10 < value) {
+      return -1;
+    }
+    value *= 10;
+
+    uint8_t digit = *p;
+
+    /* check that it contains only decimal digits */
+    if (digit < '0' || digit > '9') {
+      return -1;
+    }
+
+    size_t digit_value = digit - '0';
+
+    /* check for overflow */
+    if (SIZE_MAX - digit_value < value) {
+      return -1;
     }
+    value += digit_value;
   }
-  return false;
+  *result = value;
+  return 0;
 }
 
 int HTTPMessage_read_start_line_and_headers(HTTPMessage * message) {
@@ -459,30 +472,10 @@ int HTTPMessage_read_start_line_and_headers(HTTPMessage * message) {
 
   const char * content_length = HTTPMessage_find_header(message, HTTP_CONTENT_LENGTH);
   if (content_length != NULL) {
-    size_t value = 0;
-    for (const char * p = content_length; *p != '\0'; p++) {
-      /* check for overflow */
-      if (SIZE_MAX / 10 < value) {
-        return -1;
-      }
-      value *= 10;
-
-      uint8_t digit = *p;
-
-      /* check that it contains only decimal digits */
-      if (digit < '0' || digit > '9') {
-        return -1;
-      }
-
-      size_t digit_value = digit - '0';
-
-      /* check for overflow */
-      if (SIZE_MAX - digit_value < value) {
-        return -1;
-      }
-      value += digit_value;
+    size_t value;
+    if (parse_content_length(content_length, &value) != 0) {
+      return -1;
     }
-
     message->bytes_remaining = value;
     message->has_content_length = true;
   }
@@ -589,7 +582,9 @@ int HTTPMessage_write_start_line_and_headers(HTTPMessage * message) {
   }
 
   /* send the headers */
-  HTTPMessage_set_header(message, HTTP_CONNECTION, "close");
+  if (HTTPMessage_find_header(message, HTTP_CONNECTION) == NULL) {
+    HTTPMessage_set_header(message, HTTP_CONNECTION, "close");
+  }
   for (HTTPHeader * h = message->headers; h != NULL; h = h->next) {
     result = HTTPConnection_write(message->connection, h->name, strlen(h->name));
     if (result != 0) {
@@ -617,13 +612,67 @@ bool HTTPMessage_has_sent_headers(const HTTPMessage * message) {
   return message->is_started;
 }
 
+void HTTPMessage_set_chunked(HTTPMessage * message) {
+  assert(! message->is_started);
+  HTTPMessage_set_header(message, HTTP_TRANSFER_ENCODING, "chunked");
+  message->is_chunked_output = true;
+}
+
 int HTTPMessage_write(HTTPMessage * message, const void * p, size_t size) {
   int result = 0;
   result = HTTPMessage_write_start_line_and_headers(message);
   if (result != 0) {
     return result;
   }
+  if (! message->is_chunked_output) {
+    result = HTTPConnection_write(message->connection, p, size);
+    if (result == 0) {
+      message->bytes_written += size;
+    }
+    return result;
+  }
+
+  /* an empty chunk would end the body */
+  if (size == 0) {
+    return result;
+  }
+  char chunk_size[32];
+  int length = snprintf(chunk_size, sizeof(chunk_size), "%lx\r\n", (unsigned long) size);
+  result = HTTPConnection_write(message->connection, chunk_size, length);
+  if (result != 0) {
+    return result;
+  }
   result = HTTPConnection_write(message->connection, p, size);
+  if (result != 0) {
+    return result;
+  }
+  return HTTPConnection_write(message->connection, "\r\n", 2);
+}
+
+bool HTTPMessage_is_body_short(const HTTPMessage * message) {
+  if (message->is_chunked_output) {
+    return false;
+  }
+  const char * content_length = HTTPMessage_find_header(message, HTTP_CONTENT_LENGTH);
+  if (content_length == NULL) {
+    return false;
+  }
+  size_t value;
+  if (parse_content_length(content_length, &value) != 0) {
+    return true;
+  }
+  return message->bytes_written < value;
+}
+
+int HTTPMessage_finish(HTTPMessage * message) {
+  int result = HTTPMessage_write_start_line_and_headers(message);
+  if (result != 0) {
+    return result;
+  }
+  if (message->is_chunked_output) {
+    /* the last chunk, with no trailer */
+    result = HTTPConnection_write(message->connection, "0\r\n\r\n", 5);
+  }
   return result;
 }
 
@@ -693,6 +742,17 @@ static int read_chunk_size(Stream * stream, size_t * chunk_size) {
   return 0;
 }
 
+/* copies as much of the line in the chunk buffer as fits, counting down bytes_remaining */
+static void copy_from_chunk_buffer(HTTPMessage * message, uint8_t * s, size_t capacity, size_t * bytes_read) {
+  size_t length = capacity - *bytes_read;
+  if (length > message->bytes_remaining) {
+    length = message->bytes_remaining;
+  }
+  memcpy(s + *bytes_read, message->chunk_buffer->data + message->chunk_buffer->length - message->bytes_remaining, length);
+  *bytes_read += length;
+  message->bytes_remaining -= length;
+}
+
 static int read_chunked_message_body(HTTPMessage * message, void * p, size_t capacity, size_t * bytes_read) {
   int result = 0;
   *bytes_read = 0;
@@ -702,8 +762,7 @@ static int read_chunked_message_body(HTTPMessage * message, void * p, size_t cap
   }
 
   uint8_t * s = p;
-  int c;
-  for (*bytes_read = 0; *bytes_read < capacity; (*bytes_read)++) {
+  while (*bytes_read < capacity) {
     switch (message->chunked_body_state) {
     case CHUNKED_BODY_CHUNK_SIZE:
       if (message->chunk_buffer->length == 0) {
@@ -721,8 +780,7 @@ static int read_chunked_message_body(HTTPMessage * message, void * p, size_t cap
       }
 
       /* serve from the chunk buffer */
-      s[*bytes_read] = message->chunk_buffer->data[message->chunk_buffer->length - message->bytes_remaining];
-      message->bytes_remaining--;
+      copy_from_chunk_buffer(message, s, capacity, bytes_read);
 
       if (message->bytes_remaining == 0) {
         size_t chunk_size;
@@ -746,24 +804,31 @@ static int read_chunked_message_body(HTTPMessage * message, void * p, size_t cap
 
       break;
     case CHUNKED_BODY_CHUNK_DATA:
-      /* serve from the chunk */
-      result = HTTPConnection_read_octet(message->connection, &c);
+    {
+      /* serve from the chunk (and the CRLF after it) */
+      size_t length = capacity - *bytes_read;
+      if (length > message->bytes_remaining) {
+        length = message->bytes_remaining;
+      }
+      size_t n;
+      result = HTTPConnection_read(message->connection, s + *bytes_read, length, &n);
       if (result != 0) {
         return result;
       }
-      if (c == -1) {
+      if (n == 0) {
         result = -1;
         message->chunked_body_state = CHUNKED_BODY_DONE;
         return result;
       }
-      s[*bytes_read] = (uint8_t) c;
-      message->bytes_remaining--;
+      *bytes_read += n;
+      message->bytes_remaining -= n;
 
       if (message->bytes_remaining == 0) {
         message->chunked_body_state = CHUNKED_BODY_CHUNK_SIZE;
       }
 
       break;
+    }
     case CHUNKED_BODY_TRAILER:
       if (message->chunk_buffer->length == 0) {
         /* read a header */
@@ -780,8 +845,7 @@ static int read_chunked_message_body(HTTPMessage * message, void * p, size_t cap
       }
 
       /* serve from the chunk buffer */
-      s[*bytes_read] = message->chunk_buffer->data[message->chunk_buffer->length - message->bytes_remaining];
-      message->bytes_remaining--;
+      copy_from_chunk_buffer(message, s, capacity, bytes_read);
 
       if (message->bytes_remaining == 0) {
         size_t length = message->chunk_buffer->length;
@@ -797,7 +861,7 @@ static int read_chunked_message_body(HTTPMessage * message, void * p, size_t cap
 
       break;
     default:
-      break;
+      return result;
     }
   }
 
@@ -827,26 +891,41 @@ static int read_chunked_entity_body(HTTPMessage * message, void * p, size_t capa
       }
       message->bytes_remaining = chunk_size;
       if (chunk_size == 0) {
+        /* skip the trailer, so that the connection can be used for another message */
         message->chunked_body_state = CHUNKED_BODY_DONE;
+        do {
+          Stream_reset(message->chunk_buffer);
+          result = read_header(message->chunk_buffer, message->connection);
+          if (result != 0) {
+            break;
+          }
+        }
+        while (! (message->chunk_buffer->length == 0 ||
+                  (message->chunk_buffer->length == 1 && message->chunk_buffer->data[0] == '\n') ||
+                  (message->chunk_buffer->length == 2 && message->chunk_buffer->data[0] == '\r' && message->chunk_buffer->data[1] == '\n')));
         break;
       }
     }
 
-    int c;
-    result = HTTPConnection_read_octet(message->connection, &c);
+    size_t length = capacity - *bytes_read;
+    if (length > message->bytes_remaining) {
+      length = message->bytes_remaining;
+    }
+    size_t n;
+    result = HTTPConnection_read(message->connection, s + *bytes_read, length, &n);
     if (result != 0) {
       break;
     }
-    if (c == -1) {
+    if (n == 0) {
       result = -1;
       message->chunked_body_state = CHUNKED_BODY_DONE;
       break;
     }
-    s[*bytes_read] = (uint8_t) c;
-    ++(*bytes_read);
-    message->bytes_remaining--;
+    *bytes_read += n;
+    message->bytes_remaining -= n;
 
     if (message->bytes_remaining == 0) {
+      int c;
       // read CRLF terminating chunk
       result = HTTPConnection_read_octet(message->connection, &c);
       if (result != 0) {
@@ -879,21 +958,29 @@ int HTTPMessage_read_message_body(HTTPMessage * message, void * p, size_t capaci
 
   int result = 0;
   uint8_t * s = p;
-  for (*bytes_read = 0; *bytes_read < capacity; (*bytes_read)++) {
-    if (message->has_content_length && message->bytes_remaining == 0) {
-      break;
+  *bytes_read = 0;
+  while (*bytes_read < capacity) {
+    /* never read past the body: the next message may follow it */
+    size_t length = capacity - *bytes_read;
+    if (message->has_content_length) {
+      if (message->bytes_remaining == 0) {
+        break;
+      }
+      if (length > message->bytes_remaining) {
+        length = message->bytes_remaining;
+      }
     }
 
-    int c;
-    result = HTTPConnection_read_octet(message->connection, &c);
+    size_t n;
+    result = HTTPConnection_read(message->connection, s + *bytes_read, length, &n);
     if (result != 0) {
       break;
     }
-    if (c == -1) {
+    if (n == 0) {
       break;
     }
-    s[*bytes_read] = (uint8_t) c;
-    message->bytes_remaining--;
+    *bytes_read += n;
+    message->bytes_remaining -= n;
   }
   return result;
 }
@@ -32,6 +32,22 @@
 #include <process.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef HAVE_SYS_UN_H
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
 #include "util.h"
 
 #ifdef __MINGW32__
@@ -42,18 +58,70 @@ typedef void * ThreadRoutineReturnType;
 #define THREAD_ROUTINE_RETURN return NULL
 #endif
 
+/*
+With epoll, one thread waits for connections and for requests on open
+connections, and a fixed number of threads handle the requests.  A connection
+waiting for a request has no thread.  Without epoll, every connection has its
+own thread.
+*/
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_PTHREAD_H)
+#define USE_EPOLL 1
+#endif
+
+#define DEFAULT_NUM_THREADS 16
+#define MAX_EVENTS 64
+
 struct HTTPServer {
   char * ip_address;
   uint16_t port;
   HTTPServerHandler handler;
   SOCKET s;
+#ifdef USE_EPOLL
+  int epoll_fd;
+
+  /* written to when the server has been shut down */
+  int wake_fds[2];
+
+  /* protects the lists of ready and idle connections */
+  pthread_mutex_t mutex;
+
+  /* signalled when a connection is ready */
+  pthread_cond_t ready;
+
+  /* connections with a request to handle, in order */
+  struct HTTPServerConnection * ready_head;
+  struct HTTPServerConnection * ready_tail;
+
+  /* connections waiting for a request */
+  struct HTTPServerConnection * idle;
+#endif
 };
 
 struct HTTPServerConnection {
   HTTPConnection * connection;
   struct HTTPServer * server;
+  int num_requests;
+#ifdef USE_EPOLL
+  SOCKET s;
+
+  /* when a connection waiting for a request is closed */
+  time_t deadline;
+
+  /* the next ready connection, or the neighbours of an idle one */
+  struct HTTPServerConnection * previous;
+  struct HTTPServerConnection * next;
+#endif
 };
 
+static int backlog = SOMAXCONN;
+static int num_threads = DEFAULT_NUM_THREADS;
+
+/* set in the server processes started by HTTPServer_fork */
+static bool reuse_port = false;
+
+/* the path of the Unix domain socket to listen on, or NULL for TCP */
+static char * unix_socket_path = NULL;
+
 static bool is_shutdown = false;
 #ifdef __MINGW32__
 CRITICAL_SECTION shutdown_mutex;
@@ -65,12 +133,90 @@ pthread_mutex_t shutdown_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define UNLOCK pthread_mutex_unlock
 #endif
 
-static ThreadRoutineReturnType handle_connection(void * p) {
-  struct HTTPServerConnection * connection = p;
-  uint16_t port = connection->server->port;
+/*
+RFC 2616 8.1: a connection is kept open for another request unless the client
+asks for it to be closed (HTTP/1.1) or does not ask for it to be kept open
+(HTTP/1.0).  An idle connection is closed after a few seconds, and every
+connection after a number of requests.
+*/
+#define KEEP_ALIVE_TIMEOUT 5
+#define KEEP_ALIVE_MAX_REQUESTS 100
+
+/* with epoll, the time allowed for the first request on a connection */
+#define FIRST_REQUEST_TIMEOUT 60
+
+/*
+With epoll, the time a thread waits on a client which has stopped sending a
+request or reading a response: there are only a few threads, and every one of
+them held by a stalled client would stop the server answering anything.
+*/
+#define DEFAULT_IO_TIMEOUT 60
+
+static unsigned int io_timeout = DEFAULT_IO_TIMEOUT;
+
+/* checks for a token in a Connection header, e.g., "close" in "TE, close" */
+static bool has_connection_token(const char * value, const char * token) {
+  size_t length = strlen(token);
+  const char * p = value;
+  while (*p != '\0') {
+    while (*p == ' ' || *p == '\t' || *p == ',') {
+      p++;
+    }
+    const char * start = p;
+    while (*p != '\0' && *p != ',' && *p != ' ' && *p != '\t') {
+      p++;
+    }
+    if ((size_t) (p - start) == length && strncasecmp(start, token, length) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool client_wants_persistent_connection(const HTTPExchange * exchange) {
+  const char * connection = HTTPExchange_find_request_header(exchange, HTTP_CONNECTION);
+  const char * version = HTTPExchange_get_request_http_version(exchange);
+  if (strcmp(version, "HTTP/1.1") == 0) {
+    return connection == NULL || ! has_connection_token(connection, "close");
+  }
+  else if (strcmp(version, "HTTP/1.0") == 0) {
+    return connection != NULL && has_connection_token(connection, "keep-alive");
+  }
+  else {
+    return false;
+  }
+}
+
+/* reads (and discards) any part of the request body which the handler did not read */
+static int skip_request_body(HTTPExchange * exchange) {
+  if (! HTTPExchange_request_has_body(exchange)) {
+    return 0;
+  }
+  HTTPMessage * request = HTTPExchange_get_request_message(exchange);
+  uint8_t buffer[8192];
+  for (;;) {
+    size_t bytes_read;
+    int result = HTTPMessage_read_message_body(request, buffer, sizeof(buffer), &bytes_read);
+    if (result != 0) {
+      return result;
+    }
+    if (bytes_read == 0) {
+      return 0;
+    }
+  }
+}
+
+/* handles one request; returns whether the connection stays open for another */
+static bool handle_request(struct HTTPServerConnection * connection) {
+  connection->num_requests++;
 
   HTTPExchange * exchange = HTTPExchange_new(connection->connection);
+  bool persistent = false;
   if (HTTPExchange_read_request_headers(exchange) == 0) {
+    LOCK(&shutdown_mutex);
+    persistent = ! is_shutdown && connection->num_requests < KEEP_ALIVE_MAX_REQUESTS && client_wants_persistent_connection(exchange);
+    UNLOCK(&shutdown_mutex);
+    HTTPExchange_set_persistent(exchange, persistent);
     connection->server->handler(exchange);
   }
   else {
@@ -80,38 +226,381 @@ static ThreadRoutineReturnType handle_connection(void * p) {
       HTTPServer_log_err("Warning: error writing to client\n");
     }
   }
-  if (HTTPExchange_flush_response(exchange) != 0) {
+  if (HTTPExchange_finish_response(exchange) != 0) {
     HTTPServer_log_err("Warning: error writing to client\n");
+    persistent = false;
   }
+  persistent = persistent && HTTPExchange_is_persistent(exchange) && skip_request_body(exchange) == 0;
   HTTPExchange_delete(exchange);
+
+  /* the handler may have shut down the server */
+  LOCK(&shutdown_mutex);
+  if (is_shutdown) {
+    persistent = false;
+  }
+  UNLOCK(&shutdown_mutex);
+
+  /* send the responses so far, unless a pipelined request has already been read */
+  if (persistent && ! HTTPConnection_has_buffered_input(connection->connection) && HTTPConnection_flush(connection->connection) != 0) {
+    HTTPServer_log_err("Warning: error writing to client\n");
+    persistent = false;
+  }
+
+  return persistent;
+}
+
+/* checks that input on a connection is the start of a request (and not the client closing an idle connection) */
+static bool has_request(struct HTTPServerConnection * connection) {
+  int octet;
+  return HTTPConnection_peek_octet(connection->connection, &octet) == 0 && octet != -1;
+}
+
+static void close_connection(struct HTTPServerConnection * connection) {
+  struct HTTPServer * server = connection->server;
+
+  if (HTTPConnection_flush(connection->connection) != 0) {
+    HTTPServer_log_err("Warning: error writing to client\n");
+  }
   if (HTTPConnection_delete(connection->connection) != 0) {
     HTTPServer_log_err("Warning: error closing connection to client\n");
   }
   free(connection);
 
-  /* HACK: make connection to server to force accept() to return */
   LOCK(&shutdown_mutex);
   if (is_shutdown) {
-    SOCKET s = socket(PF_INET, SOCK_STREAM, 0);
-    if (s == INVALID_SOCKET) {
-      HTTPServer_log_err("Warning: error creating socket\n");
+#ifdef USE_EPOLL
+    /* the response has been sent: the epoll thread can return */
+    if (write(server->wake_fds[1], "", 1) == -1) {
+      HTTPServer_log_err("Warning: error waking server\n");
     }
-    else {
-      struct sockaddr_in a;
-      a.sin_family = AF_INET;
-      a.sin_port = htons(port);
-      a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-      if (connect(s, (struct sockaddr *) &a, sizeof(a)) == -1) {
+#else
+    /* HACK: make connection to server to force accept() to return */
+#ifdef HAVE_SYS_UN_H
+    if (unix_socket_path != NULL) {
+      HTTPConnection * wake = HTTPConnection_new_unix_client(unix_socket_path);
+      if (wake == NULL || HTTPConnection_delete(wake) != 0) {
         HTTPServer_log_err("Warning: error connecting to server\n");
       }
-      closesocket(s);
     }
+    else
+#endif
+    {
+      SOCKET s = socket(PF_INET, SOCK_STREAM, 0);
+      if (s == INVALID_SOCKET) {
+        HTTPServer_log_err("Warning: error creating socket\n");
+      }
+      else {
+        struct sockaddr_in a;
+        a.sin_family = AF_INET;
+        a.sin_port = htons(server->port);
+        a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(s, (struct sockaddr *) &a, sizeof(a)) == -1) {
+          HTTPServer_log_err("Warning: error connecting to server\n");
+        }
+        closesocket(s);
+      }
+    }
+#endif
   }
   UNLOCK(&shutdown_mutex);
+}
+
+static struct HTTPServerConnection * new_connection(struct HTTPServer * server, SOCKET s) {
+  struct HTTPServerConnection * connection = xmalloc(sizeof(struct HTTPServerConnection));
+  connection->server = server;
+  connection->connection = HTTPConnection_new_server(s);
+  connection->num_requests = 0;
+#ifdef USE_EPOLL
+  connection->s = s;
+  connection->previous = NULL;
+  connection->next = NULL;
+#endif
+  return connection;
+}
+
+#ifdef USE_EPOLL
+
+/* the caller must hold the server mutex */
+static void remove_idle_connection(struct HTTPServer * server, struct HTTPServerConnection * connection) {
+  if (connection->previous == NULL) {
+    server->idle = connection->next;
+  }
+  else {
+    connection->previous->next = connection->next;
+  }
+  if (connection->next != NULL) {
+    connection->next->previous = connection->previous;
+  }
+  connection->previous = NULL;
+  connection->next = NULL;
+}
+
+/* makes the main thread wait for a request on the connection (op is EPOLL_CTL_ADD for a new connection) */
+static void wait_for_request(struct HTTPServer * server, struct HTTPServerConnection * connection, int op) {
+  pthread_mutex_lock(&server->mutex);
+  connection->deadline = time(NULL) + (connection->num_requests == 0? FIRST_REQUEST_TIMEOUT: KEEP_ALIVE_TIMEOUT);
+  connection->previous = NULL;
+  connection->next = server->idle;
+  if (server->idle != NULL) {
+    server->idle->previous = connection;
+  }
+  server->idle = connection;
+  pthread_mutex_unlock(&server->mutex);
+
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLONESHOT;
+  event.data.ptr = connection;
+  if (epoll_ctl(server->epoll_fd, op, connection->s, &event) == -1) {
+    fatal("could not wait for connection");
+  }
+}
+
+static void * handle_ready_connections(void * p) {
+  struct HTTPServer * server = p;
+  for (;;) {
+    pthread_mutex_lock(&server->mutex);
+    while (server->ready_head == NULL) {
+      pthread_cond_wait(&server->ready, &server->mutex);
+    }
+    struct HTTPServerConnection * connection = server->ready_head;
+    server->ready_head = connection->next;
+    if (server->ready_head == NULL) {
+      server->ready_tail = NULL;
+    }
+    connection->next = NULL;
+    pthread_mutex_unlock(&server->mutex);
+
+    /* pipelined requests are handled before waiting again */
+    bool open = has_request(connection);
+    while (open) {
+      open = handle_request(connection);
+      if (! HTTPConnection_has_buffered_input(connection->connection)) {
+        break;
+      }
+    }
+
+    if (open) {
+      wait_for_request(server, connection, EPOLL_CTL_MOD);
+    }
+    else {
+      /* a forked process may briefly share the socket, so closing it would not be enough */
+      epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->s, NULL);
+      close_connection(connection);
+    }
+  }
+  return NULL;
+}
+
+static void make_ready(struct HTTPServer * server, struct HTTPServerConnection * connection) {
+  pthread_mutex_lock(&server->mutex);
+  remove_idle_connection(server, connection);
+  if (server->ready_tail == NULL) {
+    server->ready_head = connection;
+  }
+  else {
+    server->ready_tail->next = connection;
+  }
+  server->ready_tail = connection;
+  pthread_cond_signal(&server->ready);
+  pthread_mutex_unlock(&server->mutex);
+}
+
+static void close_idle_connections(struct HTTPServer * server) {
+  time_t now = time(NULL);
+  struct HTTPServerConnection * expired = NULL;
+  pthread_mutex_lock(&server->mutex);
+  struct HTTPServerConnection * connection = server->idle;
+  while (connection != NULL) {
+    struct HTTPServerConnection * next = connection->next;
+    if (connection->deadline <= now) {
+      remove_idle_connection(server, connection);
+      connection->next = expired;
+      expired = connection;
+    }
+    connection = next;
+  }
+  pthread_mutex_unlock(&server->mutex);
+
+  while (expired != NULL) {
+    connection = expired;
+    expired = expired->next;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->s, NULL);
+    close_connection(connection);
+  }
+}
+
+/* returns false once the server has been shut down */
+static bool accept_connections(struct HTTPServer * server) {
+  for (;;) {
+    struct sockaddr_in client_address;
+    socklen_t client_address_size = sizeof(client_address);
+    SOCKET s = accept(server->s, (struct sockaddr *) &client_address, &client_address_size);
+    if (s == INVALID_SOCKET) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        HTTPServer_log_err("Warning: could not accept client connection\n");
+      }
+      return true;
+    }
+
+    LOCK(&shutdown_mutex);
+    bool shutdown = is_shutdown;
+    UNLOCK(&shutdown_mutex);
+    if (shutdown) {
+      closesocket(s);
+      return false;
+    }
+
+    /* the listening socket is non-blocking, but connections are read and written by blocking calls */
+    int flags = fcntl(s, F_GETFL);
+    if (flags != -1) {
+      fcntl(s, F_SETFL, flags & ~O_NONBLOCK);
+    }
+
+    struct HTTPServerConnection * connection = new_connection(server, s);
+    if (HTTPConnection_set_timeout(connection->connection, io_timeout) != 0) {
+      HTTPServer_log_err("Warning: could not set timeout on client connection\n");
+    }
+    wait_for_request(server, connection, EPOLL_CTL_ADD);
+  }
+}
+
+static void run_event_loop(struct HTTPServer * server) {
+  server->epoll_fd = epoll_create(MAX_EVENTS);
+  if (server->epoll_fd == -1) {
+    fatal("could not create epoll instance");
+  }
+  pthread_mutex_init(&server->mutex, NULL);
+  pthread_cond_init(&server->ready, NULL);
+  server->ready_head = NULL;
+  server->ready_tail = NULL;
+  server->idle = NULL;
+
+  int flags = fcntl(server->s, F_GETFL);
+  if (flags == -1 || fcntl(server->s, F_SETFL, flags | O_NONBLOCK) == -1) {
+    fatal("could not make socket non-blocking");
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->s, &event) == -1) {
+    fatal("could not wait for connections");
+  }
+
+  /*
+  Connecting to the server would not be a reliable way to wake this thread:
+  with SO_REUSEPORT, the connection may go to another process.
+  */
+  if (pipe(server->wake_fds) == -1) {
+    fatal("could not create pipe");
+  }
+  event.events = EPOLLIN;
+  event.data.ptr = server;
+  if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fds[0], &event) == -1) {
+    fatal("could not wait for connections");
+  }
+
+  for (int i = 0; i < num_threads; i++) {
+    pthread_t thread;
+    pthread_attr_t a;
+    pthread_attr_init(&a);
+    pthread_attr_setdetachstate(&a, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &a, handle_ready_connections, server) != 0) {
+      fatal("cannot create thread");
+    }
+    pthread_attr_destroy(&a);
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  for (;;) {
+    /* wake up every second to close idle connections */
+    int n = epoll_wait(server->epoll_fd, events, MAX_EVENTS, 1000);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fatal("could not wait for connections");
+    }
+
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr == server) {
+        /* shut down: the threads are left running, since the server is about to exit */
+        return;
+      }
+      else if (events[i].data.ptr == NULL) {
+        if (! accept_connections(server)) {
+          return;
+        }
+      }
+      else {
+        make_ready(server, events[i].data.ptr);
+      }
+    }
+
+    close_idle_connections(server);
+  }
+}
+
+#else
+
+static ThreadRoutineReturnType handle_connection(void * p) {
+  struct HTTPServerConnection * connection = p;
 
+  for (;;) {
+    if (! handle_request(connection)) {
+      break;
+    }
+
+    /* wait for the next request - a pipelined one may already have been read */
+    bool ready;
+    if (HTTPConnection_wait_for_input(connection->connection, KEEP_ALIVE_TIMEOUT, &ready) != 0 || ! ready) {
+      break;
+    }
+    if (! has_request(connection)) {
+      break;
+    }
+  }
+
+  close_connection(connection);
   THREAD_ROUTINE_RETURN;
 }
 
+static void run_threads(struct HTTPServer * server) {
+  for (;;) {
+    struct sockaddr_in client_address;
+    socklen_t client_address_size = sizeof(client_address);
+    SOCKET s = accept(server->s, (struct sockaddr *) &client_address, &client_address_size);
+    if (s == INVALID_SOCKET) {
+      HTTPServer_log_err("Warning: could not accept client connection\n");
+      continue;
+    }
+
+    LOCK(&shutdown_mutex);
+    if (is_shutdown) {
+      closesocket(s);
+      break;
+    }
+    UNLOCK(&shutdown_mutex);
+
+    struct HTTPServerConnection * connection = new_connection(server, s);
+
+#ifdef __MINGW32__
+    unsigned long thread = _beginthread(handle_connection, 0, connection);
+#else
+    pthread_t thread;
+    pthread_attr_t a;
+    pthread_attr_init(&a);
+    pthread_attr_setdetachstate(&a, PTHREAD_CREATE_DETACHED);
+    pthread_create(&thread, &a, handle_connection, connection);
+    pthread_attr_destroy(&a);
+#endif
+  }
+}
+
+#endif
+
 static struct HTTPServer * HTTPServer_new(const char * ip_address, uint16_t port, HTTPServerHandler handler) {
   struct HTTPServer * result = xmalloc(sizeof(struct HTTPServer));
   if (ip_address == NULL) {
@@ -132,17 +621,191 @@ static void HTTPServer_delete(struct HTTPServer * server) {
   free(server);
 }
 
-void HTTPServer_run(const char * ip_address, uint16_t port, HTTPServerHandler handler) {
-  struct HTTPServer * server = HTTPServer_new(ip_address, port, handler);
+void HTTPServer_set_backlog(int value) {
+  backlog = value;
+}
 
-#ifdef __MINGW32__
-  WSADATA data;
-  if (WSAStartup(MAKEWORD(1, 1), &data) != 0) {
-    fatal("could not start Winsock");
+void HTTPServer_set_num_threads(int value) {
+  num_threads = value;
+}
+
+void HTTPServer_set_timeout(unsigned int seconds) {
+  io_timeout = seconds;
+}
+
+int HTTPServer_set_unix_socket(const char * path) {
+#ifdef HAVE_SYS_UN_H
+  free(unix_socket_path);
+  unix_socket_path = xstrdup(path);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+/*
+Server processes are supported only with epoll, which does not depend on
+connecting to the server to wake it (see run_event_loop).
+*/
+#if defined(USE_EPOLL) && defined(SO_REUSEPORT)
+
+static volatile sig_atomic_t supervisor_signal = 0;
+
+static void handle_supervisor_signal(int signal_number) {
+  supervisor_signal = signal_number;
+}
+
+/* returns the process ID in the supervisor, 0 in the new server process */
+static pid_t start_server_process(void) {
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1) {
+    fatal("could not create server process");
   }
-  InitializeCriticalSection(&shutdown_mutex);
+  if (pid == 0) {
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+
+    /* do not outlive the supervisor */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+    reuse_port = true;
+  }
+  return pid;
+}
+
+static void stop_server_processes(pid_t * pids, int num_processes) {
+  for (int i = 0; i < num_processes; i++) {
+    if (pids[i] != 0) {
+      kill(pids[i], SIGTERM);
+    }
+  }
+  for (int i = 0; i < num_processes; i++) {
+    if (pids[i] != 0) {
+      waitpid(pids[i], NULL, 0);
+    }
+  }
+}
+
+int HTTPServer_fork(int num_processes) {
+  pid_t * pids = xnew(pid_t, num_processes);
+  time_t * start_times = xnew(time_t, num_processes);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_supervisor_signal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGINT, &action, NULL);
+
+  for (int i = 0; i < num_processes; i++) {
+    start_times[i] = time(NULL);
+    pids[i] = start_server_process();
+    if (pids[i] == 0) {
+      free(pids);
+      free(start_times);
+      return 0;
+    }
+  }
+
+  for (;;) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid == -1) {
+      if (errno != EINTR) {
+        fatal("could not wait for server processes");
+      }
+      if (supervisor_signal != 0) {
+        /* stop the servers, then the supervisor */
+        stop_server_processes(pids, num_processes);
+        signal(supervisor_signal, SIG_DFL);
+        raise(supervisor_signal);
+      }
+      continue;
+    }
+
+    int i;
+    for (i = 0; i < num_processes; i++) {
+      if (pids[i] == pid) {
+        break;
+      }
+    }
+    if (i == num_processes) {
+      continue;
+    }
+
+    if (WIFSIGNALED(status)) {
+      /* it crashed: replace it, but not in a tight loop */
+      HTTPServer_log_err("Warning: server process %d terminated by signal %d\n", (int) pid, WTERMSIG(status));
+      if (time(NULL) - start_times[i] < 1) {
+        sleep(1);
+      }
+      start_times[i] = time(NULL);
+      pids[i] = start_server_process();
+      if (pids[i] == 0) {
+        free(pids);
+        free(start_times);
+        return 0;
+      }
+    }
+    else {
+      /* a server exits after a shutdown request, or on an error: either way, stop them all */
+      pids[i] = 0;
+      stop_server_processes(pids, num_processes);
+      exit(WIFEXITED(status)? WEXITSTATUS(status): EXIT_FAILURE);
+    }
+  }
+}
+
+#else
+
+int HTTPServer_fork(int num_processes) {
+  return -1;
+}
+
+#endif
+
+#ifdef HAVE_SYS_UN_H
+static void bind_unix_socket(struct HTTPServer * server) {
+  struct sockaddr_un a;
+  if (strlen(unix_socket_path) >= sizeof(a.sun_path)) {
+    fatal("socket path too long: %s", unix_socket_path);
+  }
+
+  server->s = socket(PF_UNIX, SOCK_STREAM, 0);
+  if (server->s == INVALID_SOCKET) {
+    fatal("could not create socket");
+  }
+
+  memset(&a, 0, sizeof(a));
+  a.sun_family = AF_UNIX;
+  strcpy(a.sun_path, unix_socket_path);
+
+  /*
+  A socket left behind by a server which did not stop cleanly refuses
+  connections, and is replaced.  One which a server is still listening on is
+  not: as with a TCP port in use, the bind fails.
+  */
+  struct stat buf;
+  if (lstat(unix_socket_path, &buf) == 0 && S_ISSOCK(buf.st_mode)) {
+    SOCKET s = socket(PF_UNIX, SOCK_STREAM, 0);
+    if (s != INVALID_SOCKET) {
+      if (connect(s, (struct sockaddr *) &a, sizeof(a)) == -1 && errno == ECONNREFUSED) {
+        unlink(unix_socket_path);
+      }
+      closesocket(s);
+    }
+  }
+
+  if (bind(server->s, (struct sockaddr *) &a, sizeof(a)) == -1) {
+    closesocket(server->s);
+    fatal("could not bind to socket: %s", unix_socket_path);
+  }
+}
 #endif
 
+static void bind_tcp_socket(struct HTTPServer * server) {
   server->s = socket(PF_INET, SOCK_STREAM, 0);
   if (server->s == INVALID_SOCKET) {
     fatal("could not create socket");
@@ -155,6 +818,14 @@ void HTTPServer_run(const char * ip_address, uint16_t port, HTTPServerHandler ha
   setsockopt(server->s, SOL_SOCKET, SO_REUSEADDR, (const char *) &optval, sizeof(optval));
 #endif
 
+  /* each server process has its own listening socket, and the kernel spreads connections among them */
+#ifdef SO_REUSEPORT
+  if (reuse_port && setsockopt(server->s, SOL_SOCKET, SO_REUSEPORT, (const char *) &optval, sizeof(optval)) == -1) {
+    closesocket(server->s);
+    fatal("could not set SO_REUSEPORT");
+  }
+#endif
+
   struct sockaddr_in a;
   a.sin_family = AF_INET;
   a.sin_port = htons(server->port);
@@ -175,47 +846,50 @@ void HTTPServer_run(const char * ip_address, uint16_t port, HTTPServerHandler ha
     closesocket(server->s);
     fatal("could not bind to address");
   }
+}
 
-  if (listen(server->s, 5) == -1) {
-    closesocket(server->s);
-    fatal("could not listen for connections");
-  }
+void HTTPServer_run(const char * ip_address, uint16_t port, HTTPServerHandler handler) {
+  struct HTTPServer * server = HTTPServer_new(ip_address, port, handler);
 
-  for (;;) {
-    struct sockaddr_in client_address;
-    size_t client_address_size = sizeof(client_address);
-    SOCKET s = accept(server->s, (struct sockaddr *) &client_address, &client_address_size);
-    if (s == INVALID_SOCKET) {
-      HTTPServer_log_err("Warning: could not accept client connection\n");
-      continue;
-    }
+#ifdef __MINGW32__
+  WSADATA data;
+  if (WSAStartup(MAKEWORD(1, 1), &data) != 0) {
+    fatal("could not start Winsock");
+  }
+  InitializeCriticalSection(&shutdown_mutex);
+#endif
 
-    LOCK(&shutdown_mutex);
-    if (is_shutdown) {
-      closesocket(s);
-      break;
-    }
-    UNLOCK(&shutdown_mutex);
+#ifdef HAVE_SYS_UN_H
+  if (unix_socket_path != NULL) {
+    bind_unix_socket(server);
+  }
+  else
+#endif
+  {
+    bind_tcp_socket(server);
+  }
 
-    struct HTTPServerConnection * connection = xmalloc(sizeof(struct HTTPServerConnection));
-    connection->server = server;
-    connection->connection = HTTPConnection_new_server(s);
+  if (listen(server->s, backlog) == -1) {
+    closesocket(server->s);
+    fatal("could not listen for connections");
+  }
 
-#ifdef __MINGW32__
-    unsigned long thread = _beginthread(handle_connection, 0, connection);
+#ifdef USE_EPOLL
+  run_event_loop(server);
 #else
-    pthread_t thread;
-    pthread_attr_t a;
-    pthread_attr_init(&a);
-    pthread_attr_setdetachstate(&a, PTHREAD_CREATE_DETACHED);
-    pthread_create(&thread, &a, handle_connection, connection);
-    pthread_attr_destroy(&a);
+  run_threads(server);
 #endif
+
+#ifdef HAVE_SYS_UN_H
+  if (unix_socket_path != NULL) {
+    unlink(unix_socket_path);
   }
+#endif
 
   HTTPServer_delete(server);
 }
 
+
 void HTTPServer_shutdown(void) {
   LOCK(&shutdown_mutex);
   is_shutdown = true;
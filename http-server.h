@@ -105,10 +105,28 @@ typedef void (*HTTPServerHandler)(HTTPExchange * exchange);
 /* HTTPConnection */
 HTTPConnection * HTTPConnection_new_server(SOCKET s);
 HTTPConnection * HTTPConnection_new_client(const char * host, uint16_t port) __attribute__((warn_unused_result));
+
+/* connects to a Unix domain socket; returns NULL on error, or if these are not supported */
+HTTPConnection * HTTPConnection_new_unix_client(const char * path) __attribute__((warn_unused_result));
 int HTTPConnection_delete(HTTPConnection * connection) __attribute__((warn_unused_result));
+
+/* the peer of a connection over a Unix domain socket has the family AF_UNIX */
 int HTTPConnection_get_peer(HTTPConnection * connection, struct sockaddr_in * peer) __attribute__((warn_unused_result));
 int HTTPConnection_read_octet(HTTPConnection * connection, int * octet) __attribute__((warn_unused_result));
 int HTTPConnection_peek_octet(HTTPConnection * connection, int * octet) __attribute__((warn_unused_result));
+
+/* reads at least one octet unless the connection has been shut down (*bytes_read is then 0) */
+int HTTPConnection_read(HTTPConnection * connection, void * p, size_t capacity, size_t * bytes_read) __attribute__((warn_unused_result));
+
+/* appends everything up to and including the next LF (or the end of input) to the stream */
+int HTTPConnection_read_line(HTTPConnection * connection, Stream * stream) __attribute__((warn_unused_result));
+bool HTTPConnection_has_buffered_input(const HTTPConnection * connection);
+
+/* makes a read or write fail (with EAGAIN) once the peer has stalled for the given number of seconds */
+int HTTPConnection_set_timeout(HTTPConnection * connection, unsigned int seconds) __attribute__((warn_unused_result));
+
+/* waits up to the given number of seconds for input; *ready is false if none arrived */
+int HTTPConnection_wait_for_input(HTTPConnection * connection, unsigned int seconds, bool * ready) __attribute__((warn_unused_result));
 int HTTPConnection_write(HTTPConnection * connection, const void * p, size_t size) __attribute__((warn_unused_result));
 int HTTPConnection_flush(HTTPConnection * connection) __attribute__((warn_unused_result));
 
@@ -130,6 +148,21 @@ bool HTTPMessage_has_sent_headers(const HTTPMessage * message);
 int HTTPMessage_write(HTTPMessage * message, const void * p, size_t size) __attribute__((warn_unused_result));
 int HTTPMessage_flush(HTTPMessage * message) __attribute__((warn_unused_result));
 
+/*
+Sends the body with the "chunked" Transfer-Encoding: each HTTPMessage_write is
+sent as one chunk, and HTTPMessage_finish sends the last chunk.
+*/
+void HTTPMessage_set_chunked(HTTPMessage * message);
+
+/*
+Returns true if fewer bytes of the body have been sent than its Content-Length
+declares, so that the connection cannot be used for another message.
+*/
+bool HTTPMessage_is_body_short(const HTTPMessage * message);
+
+/* sends whatever is needed to end the message (but does not flush the connection) */
+int HTTPMessage_finish(HTTPMessage * message) __attribute__((warn_unused_result));
+
 /*
 This function reads the entire entity body from a message.  If the message uses
 the "chunked" Transfer-Encoding, this function will decode it, so that the
@@ -191,6 +224,51 @@ int HTTPExchange_read_entire_response_entity_body(HTTPExchange * exchange, Strea
 int HTTPExchange_write_response(HTTPExchange * exchange, const void * p, size_t size) __attribute__((warn_unused_result));
 int HTTPExchange_flush_response(HTTPExchange * exchange) __attribute__((warn_unused_result));
 
+/*
+A server exchange is persistent if the connection may be used for another
+request after the response.  The server sets this from the request before
+calling the handler; it is cleared when the response is sent with
+"Connection: close" (if the length of the response body cannot be
+determined, for example), or when the response ends with less of its body than
+its Content-Length declares.  A handler which cannot send all of a body (one
+it copies with the "chunked" Transfer-Encoding, for example) must clear it.
+*/
+void HTTPExchange_set_persistent(HTTPExchange * exchange, bool persistent);
+bool HTTPExchange_is_persistent(const HTTPExchange * exchange);
+
+/* ends the response (without flushing the connection) */
+int HTTPExchange_finish_response(HTTPExchange * exchange) __attribute__((warn_unused_result));
+
+/* the length of the queue of connections not yet accepted (default: SOMAXCONN) */
+void HTTPServer_set_backlog(int backlog);
+
+/* the number of threads handling requests, where the server uses epoll (default: 16) */
+void HTTPServer_set_num_threads(int num_threads);
+
+/*
+The number of seconds a client may stall in the middle of a request or a
+response, where the server uses epoll (default: 60).
+*/
+void HTTPServer_set_timeout(unsigned int seconds);
+
+/*
+Makes HTTPServer_run listen on a Unix domain socket at the given path instead
+of a TCP port.  A socket left at the path by a server which is no longer
+running is replaced, and the socket is removed when the server stops.  Returns
+-1 if Unix domain sockets are not supported.
+*/
+int HTTPServer_set_unix_socket(const char * path);
+
+/*
+Starts num_processes server processes, each of which returns 0 and should then
+call HTTPServer_run, binding its own listening socket with SO_REUSEPORT.  The
+calling process never returns: it restarts any server process which crashes,
+and when one exits (after a shutdown request, or on an error), it stops the
+others and exits with the same status.  Returns -1 (in the calling process) if
+this is not supported.
+*/
+int HTTPServer_fork(int num_processes);
+
 void HTTPServer_run(const char * ip_address, uint16_t port, HTTPServerHandler handler);
 void HTTPServer_shutdown(void);
 void HTTPServer_log_out(const char * format, ...) __attribute__((__format__(printf, 1, 2)));
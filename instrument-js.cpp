@@ -22,7 +22,9 @@
 #include "instrument-js.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -59,6 +61,14 @@ struct IfDirective {
 };
 
 enum JSCoverageMode jscoverage_mode = JSCOVERAGE_NORMAL;
+enum JSCoverageCounterMode jscoverage_counter_mode = JSCOVERAGE_COUNT;
+enum JSCoverageGranularity jscoverage_granularity = JSCOVERAGE_STATEMENT;
+double jscoverage_sample_rate = 0;
+bool jscoverage_local_counters = false;
+bool jscoverage_typed_arrays = false;
+bool jscoverage_compact_prologue = false;
+bool jscoverage_external_source = false;
+bool jscoverage_compact_output = false;
 
 static bool * exclusive_directives = NULL;
 
@@ -67,6 +77,9 @@ static JSContext * context = NULL;
 static JSObject * global = NULL;
 static JSVersion js_version = JSVERSION_ECMA_3;
 
+/* the top of the context's temporary arena pool when nothing is being parsed */
+static void * temp_pool_mark = NULL;
+
 /*
 JSParseNode objects store line numbers starting from 1.
 The lines array stores line numbers starting from 0.
@@ -75,6 +88,62 @@ static const char * file_id = NULL;
 static char * lines = NULL;
 static uint32_t num_lines = 0;
 
+/* the id written in the instrumented code: file_id, or JSCOVERAGE_TEMPLATE_ID */
+static const char * output_id = NULL;
+
+/* the number of statements counted in the file */
+static uint32_t num_statements = 0;
+
+/*
+The parser and the other things allocated for one file are kept here rather
+than on the stack, so that they can be freed if a fatal handler (see util.h)
+abandons the file part of the way through.
+*/
+static JSCompiler * compiler = NULL;
+static JSErrorReporter old_error_reporter = NULL;
+static struct IfDirective * if_directives = NULL;
+static Stream * instrumented = NULL;
+
+/*
+With --local-counters, the instrumented code refers to the file's coverage array
+through this file-local variable instead of looking up _$jscoverage['id'].
+*/
+static char * counters_variable = NULL;
+
+/*
+With --granularity=block, there is one counter for each basic block: a run of
+sibling statements which control flows straight through.  Each block records the
+line of each of its statements, so that the line counts can be rebuilt from the
+block counts.
+*/
+struct Block {
+  uint32_t * lines;
+  uint32_t length;
+  uint32_t capacity;
+};
+static struct Block * blocks = NULL;
+static uint32_t num_blocks = 0;
+static uint32_t blocks_capacity = 0;
+
+/* the block being added to, and the statement which may be added to it next */
+static uint32_t current_block = 0;
+static JSParseNode * next_in_block = NULL;
+
+/*
+With sampling (jscoverage_sample_rate > 0), each function body and the top level
+of the file are output twice: with counters, for pages where
+_$jscoverage_sampled is true, and without them, for other pages.  Functions
+nested inside one of these branches are output the same way as the branch.
+*/
+enum SampleBranch {
+  SAMPLE_NONE,
+  SAMPLE_COUNTED,
+  SAMPLE_UNCOUNTED,
+  /* the body could not be duplicated: every counter checks _$jscoverage_sampled */
+  SAMPLE_GATED
+};
+static enum SampleBranch sample_branch = SAMPLE_NONE;
+
 void jscoverage_set_js_version(const char * version) {
   js_version = JS_StringToVersion(version);
   if (js_version != JSVERSION_UNKNOWN) {
@@ -86,6 +155,51 @@ void jscoverage_set_js_version(const char * version) {
   if ((size_t) (end - version) != strlen(version)) {
     fatal("invalid version: %s", version);
   }
+  if (context != NULL) {
+    JS_SetVersion(context, js_version);
+  }
+}
+
+void jscoverage_set_counter_mode(const char * mode) {
+  if (strcmp(mode, "count") == 0) {
+    jscoverage_counter_mode = JSCOVERAGE_COUNT;
+  }
+  else if (strcmp(mode, "boolean") == 0) {
+    jscoverage_counter_mode = JSCOVERAGE_BOOLEAN;
+  }
+  else {
+    fatal("invalid mode: %s", mode);
+  }
+}
+
+void jscoverage_set_granularity(const char * granularity) {
+  if (strcmp(granularity, "statement") == 0) {
+    jscoverage_granularity = JSCOVERAGE_STATEMENT;
+  }
+  else if (strcmp(granularity, "block") == 0) {
+    jscoverage_granularity = JSCOVERAGE_BLOCK;
+  }
+  else if (strcmp(granularity, "function") == 0) {
+    jscoverage_granularity = JSCOVERAGE_FUNCTION;
+  }
+  else {
+    fatal("invalid granularity: %s", granularity);
+  }
+}
+
+void jscoverage_set_sample_rate(const char * rate) {
+  char * end;
+  jscoverage_sample_rate = strtod(rate, &end);
+  if (end == rate || *end != '\0' || ! (jscoverage_sample_rate > 0 && jscoverage_sample_rate <= 1)) {
+    fatal("invalid sample rate: %s", rate);
+  }
+}
+
+void jscoverage_write_options(Stream * output) {
+  Stream_printf(output, "js-version=%d mode=%d counter-mode=%d granularity=%d sample-rate=%.17g",
+                (int) js_version, (int) jscoverage_mode, (int) jscoverage_counter_mode, (int) jscoverage_granularity, jscoverage_sample_rate);
+  Stream_printf(output, " local-counters=%d typed-arrays=%d compact-prologue=%d external-source=%d compact-output=%d",
+                jscoverage_local_counters, jscoverage_typed_arrays, jscoverage_compact_prologue, jscoverage_external_source, jscoverage_compact_output);
 }
 
 void jscoverage_init(void) {
@@ -109,6 +223,8 @@ void jscoverage_init(void) {
   if (! JS_InitStandardClasses(context, global)) {
     fatal("cannot initialize standard classes");
   }
+
+  temp_pool_mark = JS_ARENA_MARK(&context->tempPool);
 }
 
 void jscoverage_cleanup(void) {
@@ -275,10 +391,360 @@ static const char * get_op(uint8 op) {
   }
 }
 
+/*
+Precedence of JavaScript expressions, from lowest to highest.  In compact
+output, an operand is parenthesized only if its precedence is lower than the
+context requires.
+*/
+enum Precedence {
+  PREC_COMMA,
+  PREC_ASSIGNMENT,
+  PREC_CONDITIONAL,
+  PREC_OR,
+  PREC_AND,
+  PREC_BITOR,
+  PREC_BITXOR,
+  PREC_BITAND,
+  PREC_EQUALITY,
+  PREC_RELATIONAL,
+  PREC_SHIFT,
+  PREC_ADDITIVE,
+  PREC_MULTIPLICATIVE,
+  PREC_UNARY,
+  PREC_POSTFIX,
+  PREC_MEMBER,
+  PREC_PRIMARY
+};
+
+/* true while the initializer of a for (;;) loop is output: `in' must be parenthesized there */
+static bool in_for_init = false;
+
+static bool is_word_char(uint8_t c) {
+  return isalnum(c) || c == '_' || c == '$' || c >= 0x80;
+}
+
+/*
+Returns true if the character c1 followed by c2 would be read as a different
+token (e.g., `a - -b' written as `a--b').
+*/
+static bool tokens_would_merge(uint8_t c1, uint8_t c2) {
+  return (c1 == '+' && c2 == '+') ||
+         (c1 == '-' && (c2 == '-' || c2 == '>')) ||
+         (c1 == '/' && (c2 == '/' || c2 == '*')) ||
+         (c1 == '<' && c2 == '!');
+}
+
+static void print_indent(Stream * f, int indent) {
+  if (! jscoverage_compact_output) {
+    Stream_printf(f, "%*s", indent, "");
+  }
+}
+
+/* in compact output, operators are parenthesized by output_operand instead */
+static void print_open_paren(Stream * f) {
+  if (! jscoverage_compact_output) {
+    Stream_write_char(f, '(');
+  }
+}
+
+static void print_close_paren(Stream * f) {
+  if (! jscoverage_compact_output) {
+    Stream_write_char(f, ')');
+  }
+}
+
+/*
+Writes code containing spaces and newlines for readability.  In compact output,
+only the spaces which separate a word from a following word are kept.
+*/
+static void print_code(Stream * f, const char * s) {
+  if (! jscoverage_compact_output) {
+    Stream_write_string(f, s);
+    return;
+  }
+  for (; *s != '\0'; s++) {
+    if (*s == '\n') {
+      continue;
+    }
+    if (*s == ' ') {
+      uint8_t previous = f->length == 0? ' ': f->data[f->length - 1];
+      uint8_t next = s[1];
+      /* a regular expression followed by a word would take it as flags */
+      bool after_word = is_word_char(previous) || previous == '/';
+      if (next == '\0') {
+        /* the next character is not known yet */
+        if (after_word) {
+          Stream_write_char(f, ' ');
+        }
+      }
+      else if (after_word && is_word_char(next)) {
+        Stream_write_char(f, ' ');
+      }
+      continue;
+    }
+    Stream_write_char(f, *s);
+  }
+}
+
+/* writes a binary operator */
+static void print_operator(Stream * f, const char * op) {
+  if (! jscoverage_compact_output) {
+    Stream_printf(f, " %s ", op);
+    return;
+  }
+  if (f->length > 0 && tokens_would_merge(f->data[f->length - 1], op[0])) {
+    Stream_write_char(f, ' ');
+  }
+  Stream_write_string(f, op);
+}
+
+/*
+Formats a number with the fewest digits (with format "%.*g" or "%.*f") that read
+back as the same value, then drops a redundant leading zero, exponent sign or
+exponent zeros.  Returns false if no precision up to max_precision will do.
+*/
+static bool format_shortest_number(char * buffer, size_t size, const char * format, int min_precision, int max_precision, double d) {
+  int precision;
+  for (precision = min_precision; precision <= max_precision; precision++) {
+    snprintf(buffer, size, format, precision, d);
+    if (strtod(buffer, NULL) == d) {
+      break;
+    }
+  }
+  if (precision > max_precision) {
+    return false;
+  }
+
+  char * q = buffer;
+  const char * p = buffer;
+  if (*p == '-') {
+    *q++ = *p++;
+  }
+  if (p[0] == '0' && p[1] == '.') {
+    p++;
+  }
+  for (; *p != '\0'; p++) {
+    *q++ = *p;
+    if (*p == 'e') {
+      if (p[1] == '+') {
+        p++;
+      }
+      else if (p[1] == '-') {
+        *q++ = '-';
+        p++;
+      }
+      while (p[1] == '0' && p[2] != '\0') {
+        p++;
+      }
+    }
+  }
+  *q = '\0';
+  return true;
+}
+
+/*
+Writes a number as briefly as possible.  An integer which a double holds
+exactly is written in full (10 rather than 1e1); any other number in exponent
+form only where that is shorter than the plain decimal form.
+*/
+static void print_shortest_number(Stream * f, double d) {
+  if (d == floor(d) && fabs(d) < 9007199254740992.0) {
+    Stream_printf(f, "%.0f", d);
+    return;
+  }
+
+  char exponent_form[32];
+  char decimal_form[512];
+  format_shortest_number(exponent_form, sizeof(exponent_form), "%.*g", 1, 17, d);
+  if (format_shortest_number(decimal_form, sizeof(decimal_form), "%.*f", 0, 20, d) &&
+      strlen(decimal_form) <= strlen(exponent_form)) {
+    Stream_write_string(f, decimal_form);
+  }
+  else {
+    Stream_write_string(f, exponent_form);
+  }
+}
+
+static enum Precedence get_precedence(JSParseNode * node) {
+  switch (node->pn_type) {
+  case TOK_COMMA:
+    return PREC_COMMA;
+  case TOK_ASSIGN:
+    return PREC_ASSIGNMENT;
+  case TOK_HOOK:
+    return PREC_CONDITIONAL;
+  case TOK_OR:
+    return PREC_OR;
+  case TOK_AND:
+    return PREC_AND;
+  case TOK_BITOR:
+    return PREC_BITOR;
+  case TOK_BITXOR:
+    return PREC_BITXOR;
+  case TOK_BITAND:
+    return PREC_BITAND;
+  case TOK_EQOP:
+    return PREC_EQUALITY;
+  case TOK_IN:
+    /* it parenthesizes itself in the initializer of a for (;;) loop */
+    if (in_for_init) {
+      return PREC_PRIMARY;
+    }
+    return PREC_RELATIONAL;
+  case TOK_RELOP:
+  case TOK_INSTANCEOF:
+    return PREC_RELATIONAL;
+  case TOK_SHOP:
+    return PREC_SHIFT;
+  case TOK_PLUS:
+  case TOK_MINUS:
+    return PREC_ADDITIVE;
+  case TOK_STAR:
+  case TOK_DIVOP:
+    return PREC_MULTIPLICATIVE;
+  case TOK_UNARYOP:
+  case TOK_DELETE:
+    return PREC_UNARY;
+  case TOK_INC:
+  case TOK_DEC:
+    switch (node->pn_op) {
+    case JSOP_INCNAME:
+    case JSOP_INCPROP:
+    case JSOP_INCELEM:
+    case JSOP_DECNAME:
+    case JSOP_DECPROP:
+    case JSOP_DECELEM:
+      return PREC_UNARY;
+    default:
+      return PREC_POSTFIX;
+    }
+  case TOK_NEW:
+  case TOK_DOT:
+  case TOK_LB:
+  case TOK_LP:
+    return PREC_MEMBER;
+  case TOK_NUMBER:
+    /* a negative number is written with a minus sign */
+    if (node->pn_dval < 0 || (node->pn_dval == 0.0 && signbit(node->pn_dval))) {
+      return PREC_UNARY;
+    }
+    return PREC_PRIMARY;
+  case TOK_RP:
+    return get_precedence(node->pn_kid);
+  default:
+    /* this includes function expressions, yield and let expressions, which are always parenthesized */
+    return PREC_PRIMARY;
+  }
+}
+
+static void print_file_coverage(Stream * f) {
+  if (counters_variable == NULL || jscoverage_granularity == JSCOVERAGE_BLOCK) {
+    Stream_printf(f, "_$jscoverage['%s']", output_id);
+  }
+  else {
+    Stream_write_string(f, counters_variable);
+  }
+}
+
+static void print_counter_increment(Stream * f, int indent, uint32_t index) {
+  print_indent(f, indent);
+  if (sample_branch == SAMPLE_GATED) {
+    print_code(f, "if (_$jscoverage_sampled) ");
+  }
+  if (counters_variable != NULL) {
+    Stream_write_string(f, counters_variable);
+  }
+  else if (jscoverage_granularity == JSCOVERAGE_BLOCK) {
+    Stream_printf(f, "_$jscoverage['%s'].blocks", output_id);
+  }
+  else {
+    Stream_printf(f, "_$jscoverage['%s']", output_id);
+  }
+  if (jscoverage_counter_mode == JSCOVERAGE_BOOLEAN) {
+    /* an idempotent store is cheaper than incrementing */
+    Stream_printf(f, "[%u]", index);
+    print_code(f, " = 1;\n");
+  }
+  else {
+    Stream_printf(f, "[%u]++;", index);
+    print_code(f, "\n");
+  }
+}
+
+static uint32_t new_block(void) {
+  if (num_blocks == blocks_capacity) {
+    blocks_capacity = blocks_capacity == 0? 64: mulst(blocks_capacity, 2);
+    blocks = (struct Block *) xrealloc(blocks, mulst(blocks_capacity, sizeof(struct Block)));
+  }
+  blocks[num_blocks].lines = NULL;
+  blocks[num_blocks].length = 0;
+  blocks[num_blocks].capacity = 0;
+  return num_blocks++;
+}
+
+static void add_line_to_block(uint32_t index, uint32_t line) {
+  struct Block * block = blocks + index;
+  if (block->length == block->capacity) {
+    block->capacity = block->capacity == 0? 4: mulst(block->capacity, 2);
+    block->lines = (uint32_t *) xrealloc(block->lines, mulst(block->capacity, sizeof(uint32_t)));
+  }
+  block->lines[block->length] = line;
+  block->length++;
+}
+
+/*
+Returns false for statements after which control always continues with the next
+statement (barring exceptions); anything containing other statements or jumping
+elsewhere ends the basic block.
+*/
+static bool ends_block(JSParseNode * node) {
+  switch (node->pn_type) {
+  case TOK_SEMI:
+  case TOK_VAR:
+  case TOK_FUNCTION:
+  case TOK_DEBUGGER:
+  case TOK_NAME:
+    return false;
+  case TOK_LET:
+    return node->pn_arity != PN_LIST;
+  default:
+    return true;
+  }
+}
+
 static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_object_literals, bool parenthesize_assignments = true);
 static void instrument_statement(JSParseNode * node, Stream * f, int indent, bool is_jscoverage_if);
+static void instrument_statements(JSParseNode * first, JSParseNode * function, Stream * f, int indent);
 static void output_statement(JSParseNode * node, Stream * f, int indent, bool is_jscoverage_if);
 
+/*
+Outputs an operand of an operator which requires the given precedence.  In
+normal output, operators parenthesize themselves; in compact output, the operand
+is parenthesized here, only if necessary.
+*/
+static void output_operand(JSParseNode * node, Stream * f, enum Precedence precedence, bool parenthesize_object_literals) {
+  if (jscoverage_compact_output && get_precedence(node) < precedence) {
+    Stream_write_char(f, '(');
+    output_expression(node, f, false);
+    Stream_write_char(f, ')');
+  }
+  else {
+    output_expression(node, f, parenthesize_object_literals);
+  }
+}
+
+/* outputs the operand following a prefix or binary operator */
+static void output_right_operand(JSParseNode * node, Stream * f, enum Precedence precedence) {
+  size_t start = f->length;
+  output_operand(node, f, precedence, false);
+  if (jscoverage_compact_output && start > 0 && f->length > start && tokens_would_merge(f->data[start - 1], f->data[start])) {
+    /* separate the operand from the operator */
+    Stream_write_char(f, ' ');
+    memmove(f->data + start + 1, f->data + start, f->length - start - 1);
+    f->data[start] = ' ';
+  }
+}
+
 enum FunctionType {
   FUNCTION_NORMAL,
   FUNCTION_GETTER_OR_SETTER
@@ -287,11 +753,24 @@ enum FunctionType {
 static void output_for_in(JSParseNode * node, Stream * f) {
   assert(node->pn_type == TOK_FOR);
   assert(node->pn_arity == PN_BINARY);
-  Stream_write_string(f, "for ");
+  Stream_write_string(f, "for");
   if (node->pn_iflags & JSITER_FOREACH) {
-    Stream_write_string(f, "each ");
+    Stream_write_string(f, " each");
+  }
+  if (jscoverage_compact_output) {
+    /* the `in' expression does not parenthesize itself */
+    JSParseNode * in = node->pn_left;
+    assert(in->pn_type == TOK_IN);
+    Stream_write_char(f, '(');
+    output_expression(in->pn_left, f, false);
+    print_code(f, " in ");
+    output_expression(in->pn_right, f, false);
+    Stream_write_char(f, ')');
+  }
+  else {
+    Stream_write_char(f, ' ');
+    output_expression(node->pn_left, f, false);
   }
-  output_expression(node->pn_left, f, false);
 }
 
 static void output_array_comprehension_or_generator_expression(JSParseNode * node, Stream * f) {
@@ -317,7 +796,7 @@ static void output_array_comprehension_or_generator_expression(JSParseNode * nod
       /* for generator expressions */
       p = p->pn_kid;
     }
-    output_expression(p, f, false);
+    output_operand(p, f, PREC_ASSIGNMENT, false);
     break;
   case PN_LIST:
     /*
@@ -336,16 +815,16 @@ static void output_array_comprehension_or_generator_expression(JSParseNode * nod
 
   p = for_node;
   while (p->pn_type == TOK_FOR) {
-    Stream_write_char(f, ' ');
+    print_code(f, " ");
     output_for_in(p, f);
     p = p->pn_right;
   }
   if (p->pn_type == TOK_LC) {
     /* this is the optimized-away "if (0)" */
-    Stream_write_string(f, " if (0)");
+    print_code(f, " if (0)");
   }
   else if (if_node) {
-    Stream_write_string(f, " if (");
+    print_code(f, " if (");
     output_expression(if_node->pn_kid1, f, false);
     Stream_write_char(f, ')');
   }
@@ -359,7 +838,7 @@ static void instrument_function(JSParseNode * node, Stream * f, int indent, enum
   JSFunction * function = (JSFunction *) JS_GetPrivate(context, object);
   assert(function);
   assert(object == &function->object);
-  Stream_printf(f, "%*s", indent, "");
+  print_indent(f, indent);
   if (type == FUNCTION_NORMAL) {
     Stream_write_string(f, "function ");
   }
@@ -386,7 +865,7 @@ static void instrument_function(JSParseNode * node, Stream * f, int indent, enum
   bool destructuring = false;
   for (int i = 0; i < function->nargs; i++) {
     if (i > 0) {
-      Stream_write_string(f, ", ");
+      print_code(f, ", ");
     }
     JSAtom * param = JS_LOCAL_NAME_TO_ATOM(local_names[i]);
     if (param == NULL) {
@@ -430,9 +909,12 @@ static void instrument_function(JSParseNode * node, Stream * f, int indent, enum
     }
   }
   JS_FinishArenaPool(&pool);
-  Stream_write_string(f, ") {\n");
+  print_code(f, ") {\n");
 
-  /* function body */
+  /* function body - this starts new basic blocks */
+  uint32_t saved_current_block = current_block;
+  JSParseNode * saved_next_in_block = next_in_block;
+  next_in_block = NULL;
 
   JSParseNode * p = node->pn_body;
   if (p->pn_type == TOK_UPVARS) {
@@ -466,11 +948,12 @@ static void instrument_function(JSParseNode * node, Stream * f, int indent, enum
     if (destructuring) {
       p = p->pn_next;
     }
-    for (; p != NULL; p = p->pn_next) {
-      instrument_statement(p, f, indent + 2, false);
-    }
+    instrument_statements(p, node, f, indent + 2);
   }
 
+  current_block = saved_current_block;
+  next_in_block = saved_next_in_block;
+
   Stream_write_char(f, '}');
 }
 
@@ -479,9 +962,9 @@ static void output_function_arguments(JSParseNode * node, Stream * f) {
   Stream_write_char(f, '(');
   for (struct JSParseNode * p = function_node->pn_next; p != NULL; p = p->pn_next) {
     if (p != function_node->pn_next) {
-      Stream_write_string(f, ", ");
+      print_code(f, ", ");
     }
-    output_expression(p, f, false);
+    output_operand(p, f, PREC_ASSIGNMENT, false);
   }
   Stream_write_char(f, ')');
 }
@@ -520,9 +1003,14 @@ static void instrument_function_call(JSParseNode * node, Stream * f) {
     output_expression(function_node, f, false);
     break;
   default:
-    Stream_write_char(f, '(');
-    output_expression(function_node, f, false);
-    Stream_write_char(f, ')');
+    if (jscoverage_compact_output) {
+      output_operand(function_node, f, PREC_MEMBER, false);
+    }
+    else {
+      Stream_write_char(f, '(');
+      output_expression(function_node, f, false);
+      Stream_write_char(f, ')');
+    }
     break;
   }
 
@@ -533,15 +1021,15 @@ static void instrument_declarations(JSParseNode * list, Stream * f) {
   assert(list->pn_arity == PN_LIST);
   for (JSParseNode * p = list->pn_head; p != NULL; p = p->pn_next) {
     if (p != list->pn_head) {
-      Stream_write_string(f, ", ");
+      print_code(f, ", ");
     }
 
     switch (p->pn_type) {
     case TOK_NAME:
       print_string_atom(p->pn_atom, f);
       if (p->pn_expr != NULL) {
-        Stream_write_string(f, " = ");
-        output_expression(p->pn_expr, f, false);
+        print_code(f, " = ");
+        output_operand(p->pn_expr, f, PREC_ASSIGNMENT, false);
       }
       break;
     default:
@@ -572,21 +1060,23 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     Stream_write_char(f, ')');
     break;
   case TOK_COMMA:
-    Stream_write_char(f, '(');
+    print_open_paren(f);
     for (struct JSParseNode * p = node->pn_head; p != NULL; p = p->pn_next) {
       if (p != node->pn_head) {
-        Stream_write_string(f, ", ");
+        print_code(f, ", ");
       }
-      output_expression(p, f, parenthesize_object_literals);
+      output_operand(p, f, PREC_ASSIGNMENT, parenthesize_object_literals);
     }
-    Stream_write_char(f, ')');
+    print_close_paren(f);
     break;
   case TOK_ASSIGN:
     if (parenthesize_assignments) {
-      Stream_write_char(f, '(');
+      print_open_paren(f);
+    }
+    output_operand(node->pn_left, f, PREC_MEMBER, parenthesize_object_literals);
+    if (! jscoverage_compact_output) {
+      Stream_write_char(f, ' ');
     }
-    output_expression(node->pn_left, f, parenthesize_object_literals);
-    Stream_write_char(f, ' ');
     switch (node->pn_op) {
     case JSOP_ADD:
     case JSOP_SUB:
@@ -605,20 +1095,20 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
       /* do nothing - it must be a simple assignment */
       break;
     }
-    Stream_write_string(f, "= ");
-    output_expression(node->pn_right, f, false);
+    print_code(f, "= ");
+    output_operand(node->pn_right, f, PREC_ASSIGNMENT, false);
     if (parenthesize_assignments) {
-      Stream_write_char(f, ')');
+      print_close_paren(f);
     }
     break;
   case TOK_HOOK:
-    Stream_write_char(f, '(');
-    output_expression(node->pn_kid1, f, parenthesize_object_literals);
-    Stream_write_string(f, "? ");
-    output_expression(node->pn_kid2, f, false);
-    Stream_write_string(f, ": ");
-    output_expression(node->pn_kid3, f, false);
-    Stream_write_char(f, ')');
+    print_open_paren(f);
+    output_operand(node->pn_kid1, f, PREC_OR, parenthesize_object_literals);
+    print_code(f, "? ");
+    output_operand(node->pn_kid2, f, PREC_ASSIGNMENT, false);
+    print_code(f, ": ");
+    output_operand(node->pn_kid3, f, PREC_ASSIGNMENT, false);
+    print_close_paren(f);
     break;
   case TOK_OR:
   case TOK_AND:
@@ -632,99 +1122,103 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
   case TOK_MINUS:
   case TOK_STAR:
   case TOK_DIVOP:
-    Stream_write_char(f, '(');
-    switch (node->pn_arity) {
-    case PN_BINARY:
-      output_expression(node->pn_left, f, parenthesize_object_literals);
-      Stream_printf(f, " %s ", get_op(node->pn_op));
-      output_expression(node->pn_right, f, false);
-      break;
-    case PN_LIST:
-      for (struct JSParseNode * p = node->pn_head; p != NULL; p = p->pn_next) {
-        if (p == node->pn_head) {
-          output_expression(p, f, parenthesize_object_literals);
-        }
-        else {
-          Stream_printf(f, " %s ", get_op(node->pn_op));
-          output_expression(p, f, false);
+    print_open_paren(f);
+    {
+      /* the operators are left-associative */
+      enum Precedence precedence = get_precedence(node);
+      switch (node->pn_arity) {
+      case PN_BINARY:
+        output_operand(node->pn_left, f, precedence, parenthesize_object_literals);
+        print_operator(f, get_op(node->pn_op));
+        output_right_operand(node->pn_right, f, (enum Precedence) (precedence + 1));
+        break;
+      case PN_LIST:
+        for (struct JSParseNode * p = node->pn_head; p != NULL; p = p->pn_next) {
+          if (p == node->pn_head) {
+            output_operand(p, f, precedence, parenthesize_object_literals);
+          }
+          else {
+            print_operator(f, get_op(node->pn_op));
+            output_right_operand(p, f, (enum Precedence) (precedence + 1));
+          }
         }
+        break;
+      default:
+        abort();
       }
-      break;
-    default:
-      abort();
     }
-    Stream_write_char(f, ')');
+    print_close_paren(f);
     break;
   case TOK_UNARYOP:
-    Stream_write_char(f, '(');
+    print_open_paren(f);
     switch (node->pn_op) {
     case JSOP_NEG:
-      Stream_write_string(f, "- ");
-      output_expression(node->pn_kid, f, false);
+      print_code(f, "- ");
+      output_right_operand(node->pn_kid, f, PREC_UNARY);
       break;
     case JSOP_POS:
-      Stream_write_string(f, "+ ");
-      output_expression(node->pn_kid, f, false);
+      print_code(f, "+ ");
+      output_right_operand(node->pn_kid, f, PREC_UNARY);
       break;
     case JSOP_NOT:
-      Stream_write_string(f, "! ");
-      output_expression(node->pn_kid, f, false);
+      print_code(f, "! ");
+      output_right_operand(node->pn_kid, f, PREC_UNARY);
       break;
     case JSOP_BITNOT:
-      Stream_write_string(f, "~ ");
-      output_expression(node->pn_kid, f, false);
+      print_code(f, "~ ");
+      output_right_operand(node->pn_kid, f, PREC_UNARY);
       break;
     case JSOP_TYPEOF:
     case JSOP_TYPEOFEXPR:
-      Stream_write_string(f, "typeof ");
-      output_expression(node->pn_kid, f, false);
+      print_code(f, "typeof ");
+      output_right_operand(node->pn_kid, f, PREC_UNARY);
       break;
     case JSOP_VOID:
-      Stream_write_string(f, "void ");
-      output_expression(node->pn_kid, f, false);
+      print_code(f, "void ");
+      output_right_operand(node->pn_kid, f, PREC_UNARY);
       break;
     default:
       fatal_source(file_id, node->pn_pos.begin.lineno, "unknown operator (%u)", (unsigned int) node->pn_op);
       break;
     }
-    Stream_write_char(f, ')');
+    print_close_paren(f);
     break;
   case TOK_INC:
   case TOK_DEC:
     /*
     This is not documented, but node->pn_op tells whether it is pre- or post-increment.
     */
-    Stream_write_char(f, '(');
+    print_open_paren(f);
     switch (node->pn_op) {
     case JSOP_INCNAME:
     case JSOP_INCPROP:
     case JSOP_INCELEM:
       Stream_write_string(f, "++");
-      output_expression(node->pn_kid, f, false);
+      output_right_operand(node->pn_kid, f, PREC_MEMBER);
       break;
     case JSOP_DECNAME:
     case JSOP_DECPROP:
     case JSOP_DECELEM:
       Stream_write_string(f, "--");
-      output_expression(node->pn_kid, f, false);
+      output_right_operand(node->pn_kid, f, PREC_MEMBER);
       break;
     case JSOP_NAMEINC:
     case JSOP_PROPINC:
     case JSOP_ELEMINC:
-      output_expression(node->pn_kid, f, parenthesize_object_literals);
+      output_operand(node->pn_kid, f, PREC_MEMBER, parenthesize_object_literals);
       Stream_write_string(f, "++");
       break;
     case JSOP_NAMEDEC:
     case JSOP_PROPDEC:
     case JSOP_ELEMDEC:
-      output_expression(node->pn_kid, f, parenthesize_object_literals);
+      output_operand(node->pn_kid, f, PREC_MEMBER, parenthesize_object_literals);
       Stream_write_string(f, "--");
       break;
     default:
       abort();
       break;
     }
-    Stream_write_char(f, ')');
+    print_close_paren(f);
     break;
   case TOK_NEW:
     /*
@@ -737,7 +1231,7 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
       (new f())();
     We can fix this by surrounding pn_head in parentheses.
     */
-    Stream_write_string(f, "new ");
+    print_code(f, "new ");
     if (node->pn_head->pn_type != TOK_NAME) {
       Stream_write_char(f, '(');
     }
@@ -748,10 +1242,10 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     output_function_arguments(node, f);
     break;
   case TOK_DELETE:
-    Stream_write_char(f, '(');
-    Stream_write_string(f, "delete ");
-    output_expression(node->pn_kid, f, false);
-    Stream_write_char(f, ')');
+    print_open_paren(f);
+    print_code(f, "delete ");
+    output_right_operand(node->pn_kid, f, PREC_UNARY);
+    print_close_paren(f);
     break;
   case TOK_DOT:
     /* numeric literals must be parenthesized */
@@ -762,7 +1256,7 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
       Stream_write_char(f, ')');
       break;
     default:
-      output_expression(node->pn_expr, f, true);
+      output_operand(node->pn_expr, f, PREC_MEMBER, true);
       break;
     }
     /*
@@ -803,7 +1297,8 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     }
     break;
   case TOK_LB:
-    output_expression(node->pn_left, f, false);
+    /* in compact output, this may be at the start of a statement */
+    output_operand(node->pn_left, f, PREC_MEMBER, jscoverage_compact_output && parenthesize_object_literals);
     Stream_write_char(f, '[');
     output_expression(node->pn_right, f, false);
     Stream_write_char(f, ']');
@@ -815,11 +1310,11 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     Stream_write_char(f, '[');
     for (struct JSParseNode * p = node->pn_head; p != NULL; p = p->pn_next) {
       if (p != node->pn_head) {
-        Stream_write_string(f, ", ");
+        print_code(f, ", ");
       }
       /* a TOK_COMMA which is not a PN_LIST is a special case: a hole in the array */
       if (! (p->pn_type == TOK_COMMA && p->pn_arity != PN_LIST)) {
-        output_expression(p, f, false);
+        output_operand(p, f, PREC_ASSIGNMENT, false);
       }
     }
     if (node->pn_xflags & PNX_ENDCOMMA) {
@@ -837,7 +1332,7 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
         fatal_source(file_id, p->pn_pos.begin.lineno, "unsupported node type (%u)", (unsigned int) p->pn_type);
       }
       if (p != node->pn_head) {
-        Stream_write_string(f, ", ");
+        print_code(f, ", ");
       }
 
       /* check whether this is a getter or setter */
@@ -845,13 +1340,13 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
       case JSOP_GETTER:
       case JSOP_SETTER:
         if (p->pn_op == JSOP_GETTER) {
-          Stream_write_string(f, "get ");
+          print_code(f, "get ");
         }
         else {
-          Stream_write_string(f, "set ");
+          print_code(f, "set ");
         }
         output_expression(p->pn_left, f, false);
-        Stream_write_char(f, ' ');
+        print_code(f, " ");
         if (p->pn_right->pn_type != TOK_FUNCTION) {
           fatal_source(file_id, p->pn_pos.begin.lineno, "expected function");
         }
@@ -859,8 +1354,8 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
         break;
       default:
         output_expression(p->pn_left, f, false);
-        Stream_write_string(f, ": ");
-        output_expression(p->pn_right, f, false);
+        print_code(f, ": ");
+        output_operand(p->pn_right, f, PREC_ASSIGNMENT, false);
         break;
       }
     }
@@ -870,9 +1365,15 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     }
     break;
   case TOK_RP:
-    Stream_write_char(f, '(');
-    output_expression(node->pn_kid, f, false);
-    Stream_write_char(f, ')');
+    if (jscoverage_compact_output) {
+      /* parenthesized by output_operand if necessary */
+      output_expression(node->pn_kid, f, parenthesize_object_literals);
+    }
+    else {
+      Stream_write_char(f, '(');
+      output_expression(node->pn_kid, f, false);
+      Stream_write_char(f, ')');
+    }
     break;
   case TOK_NAME:
     print_string_atom(node->pn_atom, f);
@@ -914,6 +1415,9 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     else if (isnan(node->pn_dval)) {
       Stream_write_string(f, "Number.NaN");
     }
+    else if (jscoverage_compact_output) {
+      print_shortest_number(f, node->pn_dval);
+    }
     else {
       Stream_printf(f, "%.17g", node->pn_dval);
     }
@@ -938,18 +1442,26 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     }
     break;
   case TOK_INSTANCEOF:
-    Stream_write_char(f, '(');
-    output_expression(node->pn_left, f, parenthesize_object_literals);
-    Stream_write_string(f, " instanceof ");
-    output_expression(node->pn_right, f, false);
-    Stream_write_char(f, ')');
+    print_open_paren(f);
+    output_operand(node->pn_left, f, PREC_RELATIONAL, parenthesize_object_literals);
+    print_code(f, " instanceof ");
+    output_operand(node->pn_right, f, PREC_SHIFT, false);
+    print_close_paren(f);
     break;
   case TOK_IN:
-    Stream_write_char(f, '(');
-    output_expression(node->pn_left, f, false);
-    Stream_write_string(f, " in ");
-    output_expression(node->pn_right, f, false);
-    Stream_write_char(f, ')');
+    {
+      /* in the initializer of a for (;;) loop, `in' is always parenthesized */
+      bool parenthesize = ! jscoverage_compact_output || in_for_init;
+      if (parenthesize) {
+        Stream_write_char(f, '(');
+      }
+      output_operand(node->pn_left, f, PREC_RELATIONAL, ! parenthesize && parenthesize_object_literals);
+      print_code(f, " in ");
+      output_operand(node->pn_right, f, PREC_SHIFT, false);
+      if (parenthesize) {
+        Stream_write_char(f, ')');
+      }
+    }
     break;
   case TOK_LEXICALSCOPE:
     assert(node->pn_arity == PN_NAME);
@@ -960,8 +1472,8 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     assert(node->pn_expr->pn_left->pn_type == TOK_LP);
     assert(node->pn_expr->pn_left->pn_arity == PN_LIST);
     instrument_declarations(node->pn_expr->pn_left, f);
-    Stream_write_string(f, ") ");
-    output_expression(node->pn_expr->pn_right, f, true);
+    print_code(f, ") ");
+    output_operand(node->pn_expr->pn_right, f, PREC_ASSIGNMENT, true);
     Stream_write_char(f, ')');
     break;
   case TOK_YIELD:
@@ -969,8 +1481,8 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
     Stream_write_char(f, '(');
     Stream_write_string(f, "yield");
     if (node->pn_kid != NULL) {
-      Stream_write_char(f, ' ');
-      output_expression(node->pn_kid, f, true);
+      print_code(f, " ");
+      output_operand(node->pn_kid, f, PREC_ASSIGNMENT, true);
     }
     Stream_write_char(f, ')');
     break;
@@ -997,16 +1509,16 @@ static void output_expression(JSParseNode * node, Stream * f, bool parenthesize_
   case TOK_VAR:
     assert(node->pn_arity == PN_LIST);
     if (node->pn_op == JSOP_DEFCONST) {
-      Stream_write_string(f, "const ");
+      print_code(f, "const ");
     }
     else {
-      Stream_write_string(f, "var ");
+      print_code(f, "var ");
     }
     instrument_declarations(node, f);
     break;
   case TOK_LET:
     assert(node->pn_arity == PN_LIST);
-    Stream_write_string(f, "let ");
+    print_code(f, "let ");
     instrument_declarations(node, f);
     break;
   default:
@@ -1018,7 +1530,7 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
   switch (node->pn_type) {
   case TOK_FUNCTION:
     instrument_function(node, f, indent, FUNCTION_NORMAL);
-    Stream_write_char(f, '\n');
+    print_code(f, "\n");
     break;
   case TOK_LC:
     assert(node->pn_arity == PN_LIST);
@@ -1047,62 +1559,64 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
       }
     }
 
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "if (");
+    print_indent(f, indent);
+    print_code(f, "if (");
     output_expression(node->pn_kid1, f, false);
-    Stream_write_string(f, ") {\n");
+    print_code(f, ") {\n");
     if (is_jscoverage_if && node->pn_kid3) {
       uint32_t else_start = node->pn_kid3->pn_pos.begin.lineno;
       uint32_t else_end = node->pn_kid3->pn_pos.end.lineno + 1;
-      Stream_printf(f, "%*s", indent + 2, "");
-      Stream_printf(f, "_$jscoverage['%s'].conditionals[%d] = %d;\n", file_id, else_start, else_end);
+      print_indent(f, indent + 2);
+      print_file_coverage(f);
+      Stream_printf(f, ".conditionals[%d] = %d;\n", else_start, else_end);
     }
     instrument_statement(node->pn_kid2, f, indent + 2, false);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "}\n");
+    print_indent(f, indent);
+    print_code(f, "}\n");
 
     if (node->pn_kid3 || is_jscoverage_if) {
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "else {\n");
+      print_indent(f, indent);
+      print_code(f, "else {\n");
 
       if (is_jscoverage_if) {
         uint32_t if_start = node->pn_kid2->pn_pos.begin.lineno + 1;
         uint32_t if_end = node->pn_kid2->pn_pos.end.lineno + 1;
-        Stream_printf(f, "%*s", indent + 2, "");
-        Stream_printf(f, "_$jscoverage['%s'].conditionals[%d] = %d;\n", file_id, if_start, if_end);
+        print_indent(f, indent + 2);
+        print_file_coverage(f);
+        Stream_printf(f, ".conditionals[%d] = %d;\n", if_start, if_end);
       }
 
       if (node->pn_kid3) {
         instrument_statement(node->pn_kid3, f, indent + 2, is_jscoverage_if);
       }
 
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "}\n");
+      print_indent(f, indent);
+      print_code(f, "}\n");
     }
 
     break;
   }
   case TOK_SWITCH:
     assert(node->pn_arity == PN_BINARY);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "switch (");
+    print_indent(f, indent);
+    print_code(f, "switch (");
     output_expression(node->pn_left, f, false);
-    Stream_write_string(f, ") {\n");
+    print_code(f, ") {\n");
     {
       JSParseNode * list = node->pn_right;
       if (list->pn_type == TOK_LEXICALSCOPE) {
         list = list->pn_expr;
       }
       for (struct JSParseNode * p = list->pn_head; p != NULL; p = p->pn_next) {
-        Stream_printf(f, "%*s", indent, "");
+        print_indent(f, indent);
         switch (p->pn_type) {
         case TOK_CASE:
-          Stream_write_string(f, "case ");
+          print_code(f, "case ");
           output_expression(p->pn_left, f, false);
-          Stream_write_string(f, ":\n");
+          print_code(f, ":\n");
           break;
         case TOK_DEFAULT:
-          Stream_write_string(f, "default:\n");
+          print_code(f, "default:\n");
           break;
         default:
           abort();
@@ -1111,8 +1625,8 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
         instrument_statement(p->pn_right, f, indent + 2, false);
       }
     }
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "}\n");
+    print_indent(f, indent);
+    print_code(f, "}\n");
     break;
   case TOK_CASE:
   case TOK_DEFAULT:
@@ -1120,27 +1634,27 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
     break;
   case TOK_WHILE:
     assert(node->pn_arity == PN_BINARY);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "while (");
+    print_indent(f, indent);
+    print_code(f, "while (");
     output_expression(node->pn_left, f, false);
-    Stream_write_string(f, ") {\n");
+    print_code(f, ") {\n");
     instrument_statement(node->pn_right, f, indent + 2, false);
-    Stream_write_string(f, "}\n");
+    print_code(f, "}\n");
     break;
   case TOK_DO:
     assert(node->pn_arity == PN_BINARY);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "do {\n");
+    print_indent(f, indent);
+    print_code(f, "do {\n");
     instrument_statement(node->pn_left, f, indent + 2, false);
-    Stream_write_string(f, "}\n");
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "while (");
+    print_code(f, "}\n");
+    print_indent(f, indent);
+    print_code(f, "while (");
     output_expression(node->pn_right, f, false);
-    Stream_write_string(f, ");\n");
+    print_code(f, ");\n");
     break;
   case TOK_FOR:
     assert(node->pn_arity == PN_BINARY);
-    Stream_printf(f, "%*s", indent, "");
+    print_indent(f, indent);
     switch (node->pn_left->pn_type) {
     case TOK_IN:
       /* for/in */
@@ -1150,18 +1664,21 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
     case TOK_FORHEAD:
       /* for (;;) */
       assert(node->pn_left->pn_arity == PN_TERNARY);
-      Stream_write_string(f, "for (");
+      print_code(f, "for (");
       if (node->pn_left->pn_kid1) {
+        bool saved_in_for_init = in_for_init;
+        in_for_init = true;
         output_expression(node->pn_left->pn_kid1, f, false, false);
+        in_for_init = saved_in_for_init;
       }
       Stream_write_string(f, ";");
       if (node->pn_left->pn_kid2) {
-        Stream_write_char(f, ' ');
+        print_code(f, " ");
         output_expression(node->pn_left->pn_kid2, f, false);
       }
       Stream_write_string(f, ";");
       if (node->pn_left->pn_kid3) {
-        Stream_write_char(f, ' ');
+        print_code(f, " ");
         output_expression(node->pn_left->pn_kid3, f, false);
       }
       Stream_write_char(f, ')');
@@ -1170,48 +1687,48 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
       abort();
       break;
     }
-    Stream_write_string(f, " {\n");
+    print_code(f, " {\n");
     instrument_statement(node->pn_right, f, indent + 2, false);
-    Stream_write_string(f, "}\n");
+    print_code(f, "}\n");
     break;
   case TOK_THROW:
     assert(node->pn_arity == PN_UNARY);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "throw ");
+    print_indent(f, indent);
+    print_code(f, "throw ");
     output_expression(node->pn_u.unary.kid, f, false);
-    Stream_write_string(f, ";\n");
+    print_code(f, ";\n");
     break;
   case TOK_TRY:
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "try {\n");
+    print_indent(f, indent);
+    print_code(f, "try {\n");
     instrument_statement(node->pn_kid1, f, indent + 2, false);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "}\n");
+    print_indent(f, indent);
+    print_code(f, "}\n");
     if (node->pn_kid2) {
       assert(node->pn_kid2->pn_type == TOK_RESERVED);
       for (JSParseNode * scope = node->pn_kid2->pn_head; scope != NULL; scope = scope->pn_next) {
         assert(scope->pn_type == TOK_LEXICALSCOPE);
         JSParseNode * catch_node = scope->pn_expr;
         assert(catch_node->pn_type == TOK_CATCH);
-        Stream_printf(f, "%*s", indent, "");
-        Stream_write_string(f, "catch (");
+        print_indent(f, indent);
+        print_code(f, "catch (");
         output_expression(catch_node->pn_kid1, f, false);
         if (catch_node->pn_kid2) {
-          Stream_write_string(f, " if ");
+          print_code(f, " if ");
           output_expression(catch_node->pn_kid2, f, false);
         }
-        Stream_write_string(f, ") {\n");
+        print_code(f, ") {\n");
         instrument_statement(catch_node->pn_kid3, f, indent + 2, false);
-        Stream_printf(f, "%*s", indent, "");
-        Stream_write_string(f, "}\n");
+        print_indent(f, indent);
+        print_code(f, "}\n");
       }
     }
     if (node->pn_kid3) {
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "finally {\n");
+      print_indent(f, indent);
+      print_code(f, "finally {\n");
       instrument_statement(node->pn_kid3, f, indent + 2, false);
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "}\n");
+      print_indent(f, indent);
+      print_code(f, "}\n");
     }
     break;
   case TOK_CATCH:
@@ -1220,64 +1737,64 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
   case TOK_BREAK:
   case TOK_CONTINUE:
     assert(node->pn_arity == PN_NAME || node->pn_arity == PN_NULLARY);
-    Stream_printf(f, "%*s", indent, "");
+    print_indent(f, indent);
     Stream_write_string(f, node->pn_type == TOK_BREAK? "break": "continue");
     if (node->pn_atom != NULL) {
-      Stream_write_char(f, ' ');
+      print_code(f, " ");
       print_string_atom(node->pn_atom, f);
     }
-    Stream_write_string(f, ";\n");
+    print_code(f, ";\n");
     break;
   case TOK_WITH:
     assert(node->pn_arity == PN_BINARY);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "with (");
+    print_indent(f, indent);
+    print_code(f, "with (");
     output_expression(node->pn_left, f, false);
-    Stream_write_string(f, ") {\n");
+    print_code(f, ") {\n");
     instrument_statement(node->pn_right, f, indent + 2, false);
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "}\n");
+    print_indent(f, indent);
+    print_code(f, "}\n");
     break;
   case TOK_VAR:
-    Stream_printf(f, "%*s", indent, "");
+    print_indent(f, indent);
     output_expression(node, f, false);
-    Stream_write_string(f, ";\n");
+    print_code(f, ";\n");
     break;
   case TOK_RETURN:
     assert(node->pn_arity == PN_UNARY);
-    Stream_printf(f, "%*s", indent, "");
+    print_indent(f, indent);
     Stream_write_string(f, "return");
     if (node->pn_kid != NULL) {
-      Stream_write_char(f, ' ');
+      print_code(f, " ");
       output_expression(node->pn_kid, f, true);
     }
-    Stream_write_string(f, ";\n");
+    print_code(f, ";\n");
     break;
   case TOK_SEMI:
     assert(node->pn_arity == PN_UNARY);
-    Stream_printf(f, "%*s", indent, "");
+    print_indent(f, indent);
     if (node->pn_kid != NULL) {
       output_expression(node->pn_kid, f, true, false);
     }
-    Stream_write_string(f, ";\n");
+    print_code(f, ";\n");
     break;
   case TOK_COLON:
   {
     assert(node->pn_arity == PN_NAME);
-    Stream_printf(f, "%*s", indent < 2? 0: indent - 2, "");
+    print_indent(f, indent < 2? 0: indent - 2);
     print_string_atom(node->pn_atom, f);
-    Stream_write_string(f, ":\n");
+    print_code(f, ":\n");
     JSParseNode * labelled = node->pn_expr;
     if (labelled->pn_type == TOK_LEXICALSCOPE) {
       labelled = labelled->pn_expr;
     }
     if (labelled->pn_type == TOK_LC) {
       /* labelled block */
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "{\n");
+      print_indent(f, indent);
+      print_code(f, "{\n");
       instrument_statement(labelled, f, indent + 2, false);
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "}\n");
+      print_indent(f, indent);
+      print_code(f, "}\n");
     }
     else {
       /*
@@ -1300,11 +1817,11 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
       break;
     case TOK_LC:
       /* block */
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "{\n");
+      print_indent(f, indent);
+      print_code(f, "{\n");
       instrument_statement(node->pn_expr, f, indent + 2, false);
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "}\n");
+      print_indent(f, indent);
+      print_code(f, "}\n");
       break;
     case TOK_FOR:
       instrument_statement(node->pn_expr, f, indent, false);
@@ -1318,21 +1835,21 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
     switch (node->pn_arity) {
     case PN_BINARY:
       /* let statement */
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "let (");
+      print_indent(f, indent);
+      print_code(f, "let (");
       assert(node->pn_left->pn_type == TOK_LP);
       assert(node->pn_left->pn_arity == PN_LIST);
       instrument_declarations(node->pn_left, f);
-      Stream_write_string(f, ") {\n");
+      print_code(f, ") {\n");
       instrument_statement(node->pn_right, f, indent + 2, false);
-      Stream_printf(f, "%*s", indent, "");
-      Stream_write_string(f, "}\n");
+      print_indent(f, indent);
+      print_code(f, "}\n");
       break;
     case PN_LIST:
       /* let definition */
-      Stream_printf(f, "%*s", indent, "");
+      print_indent(f, indent);
       output_expression(node, f, false);
-      Stream_write_string(f, ";\n");
+      print_code(f, ";\n");
       break;
     default:
       abort();
@@ -1340,8 +1857,8 @@ static void output_statement(JSParseNode * node, Stream * f, int indent, bool is
     }
     break;
   case TOK_DEBUGGER:
-    Stream_printf(f, "%*s", indent, "");
-    Stream_write_string(f, "debugger;\n");
+    print_indent(f, indent);
+    print_code(f, "debugger;\n");
     break;
   case TOK_SEQ:
     /*
@@ -1367,8 +1884,8 @@ See <Statements> in jsparse.h.
 TOK_FUNCTION is handled as a statement and as an expression.
 TOK_EXPORT, TOK_IMPORT are not handled.
 */
-static void instrument_statement(JSParseNode * node, Stream * f, int indent, bool is_jscoverage_if) {
-  if (node->pn_type != TOK_LC && node->pn_type != TOK_LEXICALSCOPE) {
+static void count_statement(JSParseNode * node, Stream * f, int indent) {
+  if (node->pn_type != TOK_LC && node->pn_type != TOK_LEXICALSCOPE && jscoverage_granularity != JSCOVERAGE_FUNCTION && sample_branch != SAMPLE_UNCOUNTED) {
     uint32_t line = node->pn_pos.begin.lineno;
     if (line > num_lines) {
       fatal("file %s contains more than 65,535 lines", file_id);
@@ -1376,14 +1893,142 @@ static void instrument_statement(JSParseNode * node, Stream * f, int indent, boo
 
     /* the root node has line number 0 */
     if (line != 0) {
-      Stream_printf(f, "%*s", indent, "");
-      Stream_printf(f, "_$jscoverage['%s'][%d]++;\n", file_id, line);
+      if (jscoverage_granularity == JSCOVERAGE_BLOCK) {
+        if (node != next_in_block) {
+          current_block = new_block();
+          print_counter_increment(f, indent, current_block);
+        }
+        add_line_to_block(current_block, line);
+        next_in_block = ends_block(node)? NULL: node->pn_next;
+      }
+      else {
+        print_counter_increment(f, indent, line);
+      }
       lines[line - 1] = 1;
+      num_statements++;
     }
   }
+}
+
+static void instrument_statement(JSParseNode * node, Stream * f, int indent, bool is_jscoverage_if) {
+  count_statement(node, f, indent);
   output_statement(node, f, indent, is_jscoverage_if);
 }
 
+static void count_function_entry(JSParseNode * function, Stream * f, int indent) {
+  if (function != NULL && jscoverage_granularity == JSCOVERAGE_FUNCTION && sample_branch != SAMPLE_UNCOUNTED) {
+    /* a single counter for the function, on the line where it starts */
+    uint32_t line = function->pn_pos.begin.lineno;
+    print_counter_increment(f, indent, line);
+    lines[line - 1] = 1;
+  }
+}
+
+static bool has_let_definition(JSParseNode * first) {
+  for (JSParseNode * p = first; p != NULL; p = p->pn_next) {
+    if (p->pn_type == TOK_LET && p->pn_arity == PN_LIST) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* const definitions belong to the enclosing function, even inside a block */
+static bool has_const_definition(JSParseNode * node) {
+  if (node == NULL) {
+    return false;
+  }
+  switch (node->pn_arity) {
+  case PN_LIST:
+    if (node->pn_type == TOK_VAR && node->pn_op == JSOP_DEFCONST) {
+      return true;
+    }
+    for (JSParseNode * p = node->pn_head; p != NULL; p = p->pn_next) {
+      if (has_const_definition(p)) {
+        return true;
+      }
+    }
+    return false;
+  case PN_TERNARY:
+    return has_const_definition(node->pn_kid1) || has_const_definition(node->pn_kid2) || has_const_definition(node->pn_kid3);
+  case PN_BINARY:
+    return has_const_definition(node->pn_left) || has_const_definition(node->pn_right);
+  case PN_UNARY:
+    return has_const_definition(node->pn_kid);
+  case PN_NAME:
+    return has_const_definition(node->maybeExpr());
+  case PN_NAMESET:
+    return has_const_definition(node->pn_tree);
+  default:
+    /* PN_FUNC: a function has its own definitions */
+    return false;
+  }
+}
+
+/*
+Instruments the statements of a function body (function is the TOK_FUNCTION
+node) or of the top level of the file (function is NULL).
+*/
+static void instrument_statements(JSParseNode * first, JSParseNode * function, Stream * f, int indent) {
+  enum SampleBranch saved_sample_branch = sample_branch;
+  if (sample_branch == SAMPLE_GATED) {
+    sample_branch = SAMPLE_NONE;
+  }
+
+  bool has_definition = has_let_definition(first);
+  for (JSParseNode * p = first; p != NULL && ! has_definition; p = p->pn_next) {
+    has_definition = has_const_definition(p);
+  }
+  if (jscoverage_sample_rate > 0 && sample_branch == SAMPLE_NONE && ! has_definition) {
+    /*
+    Function declarations are hoisted out of the branches (each has branches of
+    its own); only their counters remain in place.  A let definition would not
+    be visible to hoisted functions, and a const definition would be made
+    twice, so bodies with either are not branched.
+    */
+    for (JSParseNode * p = first; p != NULL; p = p->pn_next) {
+      if (p->pn_type == TOK_FUNCTION) {
+        output_statement(p, f, indent, false);
+      }
+    }
+    print_indent(f, indent);
+    print_code(f, "if (_$jscoverage_sampled) {\n");
+    sample_branch = SAMPLE_COUNTED;
+    count_function_entry(function, f, indent + 2);
+    for (JSParseNode * p = first; p != NULL; p = p->pn_next) {
+      if (p->pn_type == TOK_FUNCTION) {
+        count_statement(p, f, indent + 2);
+      }
+      else {
+        instrument_statement(p, f, indent + 2, false);
+      }
+    }
+    print_indent(f, indent);
+    print_code(f, "}\n");
+    print_indent(f, indent);
+    print_code(f, "else {\n");
+    sample_branch = SAMPLE_UNCOUNTED;
+    for (JSParseNode * p = first; p != NULL; p = p->pn_next) {
+      if (p->pn_type != TOK_FUNCTION) {
+        instrument_statement(p, f, indent + 2, false);
+      }
+    }
+    print_indent(f, indent);
+    print_code(f, "}\n");
+  }
+  else {
+    if (jscoverage_sample_rate > 0 && sample_branch == SAMPLE_NONE) {
+      sample_branch = SAMPLE_GATED;
+    }
+    count_function_entry(function, f, indent);
+    for (JSParseNode * p = first; p != NULL; p = p->pn_next) {
+      instrument_statement(p, f, indent, false);
+    }
+  }
+
+  sample_branch = saved_sample_branch;
+}
+
 static bool characters_start_with(const jschar * characters, size_t line_start, size_t line_end, const char * prefix) {
   const jschar * characters_end = characters + line_end;
   const jschar * cp = characters + line_start;
@@ -1422,16 +2067,145 @@ static void error_reporter(JSContext * context, const char * message, JSErrorRep
   warn_source(file_id, report->lineno, "%s", message);
 }
 
+static void print_base36(Stream * f, uint32_t n) {
+  char buffer[8];
+  size_t i = sizeof(buffer) - 1;
+  buffer[i] = '\0';
+  do {
+    buffer[--i] = "0123456789abcdefghijklmnopqrstuvwxyz"[n % 36];
+    n /= 36;
+  } while (n > 0);
+  Stream_write_string(f, buffer + i);
+}
+
+/*
+Writes the executable lines of the file as the lengths (in base 36, separated
+by commas) of alternating runs of non-executable and executable lines, starting
+with line 0, which is never executable.  A trailing run of non-executable lines
+is omitted.
+*/
+static void print_executable_line_runs(Stream * f) {
+  bool executable = false;
+  uint32_t run = 1;
+  for (uint32_t i = 0; i < num_lines; i++) {
+    if ((lines[i] != 0) == executable) {
+      run++;
+      continue;
+    }
+    if (i + 1 != run) {
+      Stream_write_char(f, ',');
+    }
+    print_base36(f, run);
+    executable = ! executable;
+    run = 1;
+  }
+  if (executable) {
+    Stream_write_char(f, ',');
+    print_base36(f, run);
+  }
+}
+
+static void free_file(void) {
+  free(lines);
+  lines = NULL;
+  free(exclusive_directives);
+  exclusive_directives = NULL;
+  for (uint32_t i = 0; i < num_blocks; i++) {
+    free(blocks[i].lines);
+  }
+  free(blocks);
+  blocks = NULL;
+  num_blocks = 0;
+  blocks_capacity = 0;
+  current_block = 0;
+  next_in_block = NULL;
+  while (if_directives != NULL) {
+    struct IfDirective * if_directive = if_directives;
+    if_directives = if_directives->next;
+    free(if_directive);
+  }
+  if (instrumented != NULL) {
+    Stream_delete(instrumented);
+    instrumented = NULL;
+  }
+  free(counters_variable);
+  counters_variable = NULL;
+  if (compiler != NULL) {
+    JS_SetErrorReporter(context, old_error_reporter);
+    delete compiler;
+    compiler = NULL;
+  }
+  file_id = NULL;
+  output_id = NULL;
+}
+
+void jscoverage_abandon_file(void) {
+  free_file();
+  sample_branch = SAMPLE_NONE;
+  in_for_init = false;
+  JS_ClearPendingException(context);
+  JS_ARENA_RELEASE(&context->tempPool, temp_pool_mark);
+}
+
+static void instrument_js(const char * id, bool make_template, const uint16_t * characters, size_t num_characters, Stream * output, InstrumentedFileInfo * info);
+
 void jscoverage_instrument_js(const char * id, const uint16_t * characters, size_t num_characters, Stream * output) {
+  instrument_js(id, false, characters, num_characters, output, NULL);
+}
+
+void jscoverage_instrument_js_with_info(const char * id, const uint16_t * characters, size_t num_characters, Stream * output, InstrumentedFileInfo * info) {
+  instrument_js(id, false, characters, num_characters, output, info);
+}
+
+void jscoverage_instrument_js_template(const char * id, const uint16_t * characters, size_t num_characters, Stream * output) {
+  instrument_js(id, true, characters, num_characters, output, NULL);
+}
+
+static void print_id_hash(const char * id, Stream * output) {
+  Stream_printf(output, "%016llx", (unsigned long long) hash_bytes(id, strlen(id)));
+}
+
+void jscoverage_expand_template(const uint8_t * code, size_t length, const char * id, Stream * output) {
+  size_t start = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (code[i] != JSCOVERAGE_TEMPLATE_ID[0] && code[i] != JSCOVERAGE_TEMPLATE_ID_HASH[0]) {
+      continue;
+    }
+    Stream_write(output, code + start, i - start);
+    if (code[i] == JSCOVERAGE_TEMPLATE_ID[0]) {
+      Stream_write_string(output, id);
+    }
+    else {
+      print_id_hash(id, output);
+    }
+    start = i + 1;
+  }
+  Stream_write(output, code + start, length - start);
+}
+
+static void instrument_js(const char * id, bool make_template, const uint16_t * characters, size_t num_characters, Stream * output, InstrumentedFileInfo * info) {
   file_id = id;
+  output_id = make_template? JSCOVERAGE_TEMPLATE_ID: id;
+  num_statements = 0;
+  if (jscoverage_local_counters) {
+    /* the variable may be global, so its name must be unique to the file */
+    if (make_template) {
+      counters_variable = xstrdup("_$jscoverage_" JSCOVERAGE_TEMPLATE_ID_HASH);
+    }
+    else {
+      xasprintf(&counters_variable, "_$jscoverage_%016llx", (unsigned long long) hash_bytes(id, strlen(id)));
+    }
+  }
 
   /* parse the javascript */
-  JSCompiler compiler(context);
-  if (! compiler.init(characters, num_characters, NULL, id, 1)) {
+  JSCompiler * new_compiler = new JSCompiler(context);
+  if (! new_compiler->init(characters, num_characters, NULL, id, 1)) {
+    /* the destructor may be used only after init succeeds */
     fatal("cannot create token stream from file %s", file_id);
   }
-  JSErrorReporter old_error_reporter = JS_SetErrorReporter(context, error_reporter);
-  JSParseNode * node = compiler.parse(global);
+  compiler = new_compiler;
+  old_error_reporter = JS_SetErrorReporter(context, error_reporter);
+  JSParseNode * node = compiler->parse(global);
   if (node == NULL) {
     js_ReportUncaughtException(context);
     fatal("parse error in file %s", file_id);
@@ -1450,7 +2224,6 @@ void jscoverage_instrument_js(const char * id, const uint16_t * characters, size
   }
 
   bool has_conditionals = false;
-  struct IfDirective * if_directives = NULL;
   size_t line_number = 0;
   size_t i = 0;
   while (i < num_characters) {
@@ -1516,8 +2289,9 @@ void jscoverage_instrument_js(const char * id, const uint16_t * characters, size
   4. original source code
   */
 
-  Stream * instrumented = Stream_new(0);
-  instrument_statement(node, instrumented, 0, false);
+  instrumented = Stream_new(0);
+  assert(node->pn_type == TOK_LC);
+  instrument_statements(node->pn_head, NULL, instrumented, 0);
 
   /* write line number info to the output */
   Stream_write_string(output, JSCOVERAGE_INSTRUMENTED_HEADER);
@@ -1525,11 +2299,11 @@ void jscoverage_instrument_js(const char * id, const uint16_t * characters, size
   case JSCOVERAGE_MOZILLA:
     Stream_write_string(output, "try {\n");
     Stream_write_string(output, "  Components.utils.import('resource://app/modules/jscoverage.jsm');\n");
-    Stream_printf(output, "  dump('%s: successfully imported jscoverage module\\n');\n", id);
+    Stream_printf(output, "  dump('%s: successfully imported jscoverage module\\n');\n", output_id);
     Stream_write_string(output, "}\n");
     Stream_write_string(output, "catch (e) {\n");
     Stream_write_string(output, "  _$jscoverage = {};\n");
-    Stream_printf(output, "  dump('%s: failed to import jscoverage module - coverage not available for this file\\n');\n", id);
+    Stream_printf(output, "  dump('%s: failed to import jscoverage module - coverage not available for this file\\n');\n", output_id);
     Stream_write_string(output, "}\n");
     break;
   case JSCOVERAGE_NORMAL:
@@ -1563,51 +2337,127 @@ void jscoverage_instrument_js(const char * id, const uint16_t * characters, size
     Stream_write_string(output, "if (typeof _$jscoverage === 'undefined') {\n  var _$jscoverage = {};\n}\n");
     break;
   }
-  Stream_printf(output, "if (! _$jscoverage['%s']) {\n", file_id);
-  Stream_printf(output, "  _$jscoverage['%s'] = [];\n", file_id);
-  for (uint32_t i = 0; i < num_lines; i++) {
-    if (lines[i]) {
-      Stream_printf(output, "  _$jscoverage['%s'][%d] = 0;\n", file_id, i + 1);
+  if (jscoverage_sample_rate > 0) {
+    /* the first instrumented file loaded in a page decides whether the page is sampled */
+    Stream_write_string(output, "if (typeof _$jscoverage_sampled !== 'boolean') {\n");
+    Stream_printf(output, "  var _$jscoverage_sampled = Math.random() < %g;\n", jscoverage_sample_rate);
+    Stream_write_string(output, "}\n");
+  }
+  if (jscoverage_typed_arrays || jscoverage_compact_prologue || jscoverage_granularity == JSCOVERAGE_BLOCK) {
+    const struct Resource * resource = get_resource("counters.js");
+    Stream_write(output, resource->data, resource->length);
+  }
+  Stream_printf(output, "if (! _$jscoverage['%s']) {\n", output_id);
+  if (jscoverage_typed_arrays) {
+    /* bitmap of executable lines: each hex digit covers 4 lines, lowest bit first */
+    Stream_printf(output, "  _$jscoverage['%s'] = _$jscoverage_counters(%u, \"", output_id, num_lines + 1);
+    for (uint32_t line = 0; line <= num_lines; line += 4) {
+      int digit = 0;
+      for (uint32_t bit = 0; bit < 4; bit++) {
+        if (line + bit >= 1 && line + bit <= num_lines && lines[line + bit - 1]) {
+          digit |= 1 << bit;
+        }
+      }
+      Stream_write_char(output, "0123456789abcdef"[digit]);
+    }
+    if (jscoverage_counter_mode == JSCOVERAGE_BOOLEAN) {
+      /* values are only ever 0 or 1, so a byte is enough */
+      Stream_write_string(output, "\", true);\n");
+    }
+    else {
+      Stream_write_string(output, "\");\n");
+    }
+  }
+  else if (jscoverage_compact_prologue) {
+    Stream_printf(output, "  _$jscoverage['%s'] = _$jscoverage_decode(\"", output_id);
+    print_executable_line_runs(output);
+    Stream_write_string(output, "\");\n");
+  }
+  else {
+    Stream_printf(output, "  _$jscoverage['%s'] = [];\n", output_id);
+    for (uint32_t i = 0; i < num_lines; i++) {
+      if (lines[i]) {
+        Stream_printf(output, "  _$jscoverage['%s'][%d] = 0;\n", output_id, i + 1);
+      }
     }
   }
   Stream_write_string(output, "}\n");
-  free(lines);
-  lines = NULL;
-  free(exclusive_directives);
-  exclusive_directives = NULL;
+  if (jscoverage_granularity == JSCOVERAGE_BLOCK) {
+    /* the lines of each block in base 36: lines separated by commas, blocks by semicolons */
+    Stream_printf(output, "if (! _$jscoverage['%s'].blocks) {\n", output_id);
+    Stream_printf(output, "  _$jscoverage['%s'].blocks = _$jscoverage_blocks(\"", output_id);
+    for (uint32_t i = 0; i < num_blocks; i++) {
+      if (i > 0) {
+        Stream_write_char(output, ';');
+      }
+      for (uint32_t j = 0; j < blocks[i].length; j++) {
+        if (j > 0) {
+          Stream_write_char(output, ',');
+        }
+        print_base36(output, blocks[i].lines[j]);
+      }
+    }
+    if (jscoverage_counter_mode == JSCOVERAGE_BOOLEAN) {
+      Stream_write_string(output, "\", true);\n");
+    }
+    else {
+      Stream_write_string(output, "\");\n");
+    }
+    Stream_write_string(output, "}\n");
+  }
+  if (counters_variable != NULL) {
+    Stream_printf(output, "var %s = _$jscoverage['%s']%s;\n", counters_variable, output_id, jscoverage_granularity == JSCOVERAGE_BLOCK? ".blocks": "");
+  }
+  if (jscoverage_sample_rate > 0) {
+    Stream_printf(output, "_$jscoverage['%s'].samples = (_$jscoverage['%s'].samples || 0) + (_$jscoverage_sampled? 1: 0);\n", output_id, output_id);
+  }
+  if (info != NULL) {
+    info->num_lines = num_lines;
+    info->num_executable_lines = 0;
+    for (uint32_t i = 0; i < num_lines; i++) {
+      if (lines[i]) {
+        info->num_executable_lines++;
+      }
+    }
+    info->executable_lines = xnew(uint32_t, info->num_executable_lines);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < num_lines; i++) {
+      if (lines[i]) {
+        info->executable_lines[n++] = i + 1;
+      }
+    }
+    info->num_statements = num_statements;
+  }
 
-  /* copy the original source to the output */
-  Stream_printf(output, "_$jscoverage['%s'].source = ", file_id);
-  jscoverage_write_source(id, characters, num_characters, output);
-  Stream_printf(output, ";\n");
+  /* copy the original source to the output, unless it is retrieved separately */
+  if (! jscoverage_external_source) {
+    Stream_printf(output, "_$jscoverage['%s'].source = ", output_id);
+    jscoverage_write_source(id, characters, num_characters, output);
+    Stream_printf(output, ";\n");
+  }
 
   /* conditionals */
   if (has_conditionals) {
-    Stream_printf(output, "_$jscoverage['%s'].conditionals = [];\n", file_id);
+    Stream_printf(output, "_$jscoverage['%s'].conditionals = [];\n", output_id);
   }
 
   /* copy the instrumented source code to the output */
   Stream_write(output, instrumented->data, instrumented->length);
+  if (jscoverage_compact_output && instrumented->length > 0) {
+    /* compact output is all on one line */
+    Stream_write_char(output, '\n');
+  }
 
   /* conditionals */
   for (struct IfDirective * if_directive = if_directives; if_directive != NULL; if_directive = if_directive->next) {
     Stream_write_string(output, "if (!(");
     print_javascript(if_directive->condition_start, if_directive->condition_end - if_directive->condition_start, output);
     Stream_write_string(output, ")) {\n");
-    Stream_printf(output, "  _$jscoverage['%s'].conditionals[%d] = %d;\n", file_id, if_directive->start_line, if_directive->end_line);
+    Stream_printf(output, "  _$jscoverage['%s'].conditionals[%d] = %d;\n", output_id, if_directive->start_line, if_directive->end_line);
     Stream_write_string(output, "}\n");
   }
 
-  /* free */
-  while (if_directives != NULL) {
-    struct IfDirective * if_directive = if_directives;
-    if_directives = if_directives->next;
-    free(if_directive);
-  }
-
-  Stream_delete(instrumented);
-
-  file_id = NULL;
+  free_file();
 }
 
 void jscoverage_write_source(const char * id, const jschar * characters, size_t num_characters, Stream * output) {
@@ -1904,13 +2754,14 @@ int jscoverage_parse_json(Coverage * coverage, const uint8_t * json, size_t leng
 
     JSParseNode * array = NULL;
     JSParseNode * source = NULL;
+    JSParseNode * samples = NULL;
     if (value->pn_type == TOK_RB) {
       /* an array */
       array = value;
     }
     else if (value->pn_type == TOK_RC) {
-      /* an object literal */
-      if (value->pn_count != 2) {
+      /* an object literal - "source" may be omitted, "samples" is present only with sampling */
+      if (value->pn_count < 1 || value->pn_count > 3) {
         result = -1;
         goto done;
       }
@@ -1939,6 +2790,13 @@ int jscoverage_parse_json(Coverage * coverage, const uint8_t * json, size_t leng
             goto done;
           }
         }
+        else if (strcmp(s, "samples") == 0) {
+          samples = element->pn_right;
+          if (samples->pn_type != TOK_NUMBER) {
+            result = -1;
+            goto done;
+          }
+        }
         else {
           result = -1;
           goto done;
@@ -1965,12 +2823,16 @@ int jscoverage_parse_json(Coverage * coverage, const uint8_t * json, size_t leng
       file_coverage->num_coverage_lines = array->pn_count;
       file_coverage->coverage_lines = xnew(int, array->pn_count);
       file_coverage->source_lines = NULL;
+      file_coverage->samples = -1;
 
       /* set coverage for all lines */
       uint32 i = 0;
       for (JSParseNode * element = array->pn_head; element != NULL; element = element->pn_next, i++) {
         if (element->pn_type == TOK_NUMBER) {
           file_coverage->coverage_lines[i] = (int) element->pn_dval;
+          if (jscoverage_counter_mode == JSCOVERAGE_BOOLEAN && file_coverage->coverage_lines[i] != 0) {
+            file_coverage->coverage_lines[i] = 1;
+          }
         }
         else if (element->pn_type == TOK_PRIMARY && element->pn_op == JSOP_NULL) {
           file_coverage->coverage_lines[i] = -1;
@@ -2005,7 +2867,12 @@ int jscoverage_parse_json(Coverage * coverage, const uint8_t * json, size_t leng
             result = -2;
             goto done;
           }
-          file_coverage->coverage_lines[i] += (int) element->pn_dval;
+          if (jscoverage_counter_mode == JSCOVERAGE_BOOLEAN) {
+            file_coverage->coverage_lines[i] = file_coverage->coverage_lines[i] != 0 || element->pn_dval != 0;
+          }
+          else {
+            file_coverage->coverage_lines[i] += (int) element->pn_dval;
+          }
         }
         else if (element->pn_type == TOK_PRIMARY && element->pn_op == JSOP_NULL) {
           if (file_coverage->coverage_lines[i] != -1) {
@@ -2021,6 +2888,13 @@ int jscoverage_parse_json(Coverage * coverage, const uint8_t * json, size_t leng
       assert(i == array->pn_count);
     }
 
+    if (samples != NULL) {
+      if (file_coverage->samples == -1) {
+        file_coverage->samples = 0;
+      }
+      file_coverage->samples += (int) samples->pn_dval;
+    }
+
     /* if this JSON file has source, use it */
     if (file_coverage->source_lines == NULL && source != NULL) {
       file_coverage->num_source_lines = source->pn_count;
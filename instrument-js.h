@@ -34,6 +34,9 @@ extern "C" {
 #define JSCOVERAGE_INSTRUMENTED_HEADER "/* automatically generated by JSCoverage - do not edit */\n"
 #define JSCOVERAGE_INSTRUMENTED_HEADER_LENGTH (sizeof(JSCOVERAGE_INSTRUMENTED_HEADER) - 1)
 
+/* appended to the name of an instrumented file to name its source file (with --external-source) */
+#define JSCOVERAGE_SOURCE_SUFFIX ".jscoverage-source.json"
+
 enum FileType {
   FILE_TYPE_JS,
   FILE_TYPE_HTML,
@@ -47,14 +50,81 @@ enum JSCoverageMode {
 };
 extern enum JSCoverageMode jscoverage_mode;
 
+enum JSCoverageCounterMode {
+  JSCOVERAGE_COUNT,
+  JSCOVERAGE_BOOLEAN
+};
+extern enum JSCoverageCounterMode jscoverage_counter_mode;
+
+enum JSCoverageGranularity {
+  JSCOVERAGE_STATEMENT,
+  JSCOVERAGE_BLOCK,
+  JSCOVERAGE_FUNCTION
+};
+extern enum JSCoverageGranularity jscoverage_granularity;
+
+extern double jscoverage_sample_rate;
+
+extern bool jscoverage_local_counters;
+extern bool jscoverage_typed_arrays;
+extern bool jscoverage_compact_prologue;
+extern bool jscoverage_external_source;
+extern bool jscoverage_compact_output;
+
 void jscoverage_set_js_version(const char * version);
 
+void jscoverage_set_counter_mode(const char * mode);
+
+void jscoverage_set_granularity(const char * granularity);
+
+void jscoverage_set_sample_rate(const char * rate);
+
+/* writes the settings of the options above, which determine the instrumented code */
+void jscoverage_write_options(Stream * output);
+
 void jscoverage_init(void);
 
 void jscoverage_cleanup(void);
 
 void jscoverage_instrument_js(const char * id, const uint16_t * characters, size_t num_characters, Stream * output);
 
+typedef struct InstrumentedFileInfo {
+  uint32_t num_lines;
+
+  /* the lines with a counter (numbered from 1), in order */
+  uint32_t * executable_lines;
+  uint32_t num_executable_lines;
+
+  /* the number of statements counted (none with function granularity) */
+  uint32_t num_statements;
+} InstrumentedFileInfo;
+
+/* like jscoverage_instrument_js, and fills in info (executable_lines is allocated) */
+void jscoverage_instrument_js_with_info(const char * id, const uint16_t * characters, size_t num_characters, Stream * output, InstrumentedFileInfo * info);
+
+/*
+Like jscoverage_instrument_js, but every occurrence of the id in the code is
+JSCOVERAGE_TEMPLATE_ID, and every occurrence of a hash of the id (which names
+the variable used with jscoverage_local_counters) is JSCOVERAGE_TEMPLATE_ID_HASH.
+(The id is still used in messages.)  Neither character appears anywhere else in
+instrumented code, which escapes all control characters, so the code for any
+file with the same contents can be made with jscoverage_expand_template.
+*/
+#define JSCOVERAGE_TEMPLATE_ID "\001"
+#define JSCOVERAGE_TEMPLATE_ID_HASH "\002"
+
+void jscoverage_instrument_js_template(const char * id, const uint16_t * characters, size_t num_characters, Stream * output);
+
+/* writes the code for a file from a template, exactly as jscoverage_instrument_js would */
+void jscoverage_expand_template(const uint8_t * code, size_t length, const char * id, Stream * output);
+
+/*
+Frees what is left of a file whose instrumentation was cut short by a fatal
+handler (see set_fatal_handler in util.h), so that the next file can be
+instrumented.
+*/
+void jscoverage_abandon_file(void);
+
 void jscoverage_copy_resources(const char * destination_directory);
 
 typedef struct Coverage Coverage;
@@ -65,6 +135,9 @@ typedef struct FileCoverage {
   int * coverage_lines;
   char ** source_lines;
 
+  /* number of sampled page loads, or -1 if the file was not instrumented with sampling */
+  int samples;
+
   /* SpiderMonkey uses uint32 for array lengths */
   uint32_t num_coverage_lines;
   uint32_t num_source_lines;
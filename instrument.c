@@ -28,14 +28,32 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#ifndef __MINGW32__
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
+#include "dir-walk.h"
 #include "encoding.h"
+#include "file-io.h"
 #include "global.h"
 #include "instrument-js.h"
+#include "path-patterns.h"
 #include "resource-manager.h"
 #include "util.h"
 
 static int g_verbose = 0;
+static int g_link = 0;
 
 static int string_ends_with(const char * s, const char * suffix) {
   size_t length = strlen(s);
@@ -70,7 +88,384 @@ static void check_contains_file(const char * file1, const char * file2) {
   }
 }
 
-static void instrument_file(const char * source_file, const char * destination_file, const char * id, int instrumenting) {
+static void write_source_file(const char * destination_file, const Stream * stream) {
+  char * source_file;
+  xasprintf(&source_file, "%s%s", destination_file, JSCOVERAGE_SOURCE_SUFFIX);
+  FILE * f = xfopen(source_file, "wb");
+  if (fwrite(stream->data, 1, stream->length, f) != stream->length) {
+    fatal("cannot write to file: %s", source_file);
+  }
+  fclose(f);
+  free(source_file);
+}
+
+static bool is_instrumented(const Stream * input_stream) {
+  return input_stream->length >= JSCOVERAGE_INSTRUMENTED_HEADER_LENGTH &&
+         memcmp(input_stream->data, JSCOVERAGE_INSTRUMENTED_HEADER, JSCOVERAGE_INSTRUMENTED_HEADER_LENGTH) == 0;
+}
+
+/*
+Copies of the same file (a library vendored into several packages) are
+instrumented only once.  The code is kept as a template, with a mark in place
+of the id (see jscoverage_instrument_js_template), and the code for each copy is
+made by putting in its id.  Templates are kept until they take up
+TEMPLATES_MAX_SIZE bytes; files seen after that are instrumented on their own.
+*/
+#define TEMPLATES_MAX_SIZE (64 * 1024 * 1024)
+
+struct Template {
+  uint64_t digest;
+
+  /* the contents of the source file */
+  Stream * source;
+
+  Stream * code;
+
+  /* with --external-source, the contents of the source file for the report */
+  Stream * source_json;
+
+  struct Template * next;
+};
+
+struct Templates {
+  struct Template ** buckets;
+  size_t num_buckets;
+  size_t num_templates;
+  size_t size;
+};
+
+static struct Templates g_templates = {NULL, 0, 0, 0};
+
+static struct Template * find_template(uint64_t digest, const Stream * source) {
+  if (g_templates.num_buckets == 0) {
+    return NULL;
+  }
+  for (struct Template * t = g_templates.buckets[digest % g_templates.num_buckets]; t != NULL; t = t->next) {
+    if (t->digest == digest && t->source->length == source->length &&
+        memcmp(t->source->data, source->data, source->length) == 0) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+/* keeps a template, with a copy of the source, if there is room */
+static bool add_template(struct Template * t, const Stream * source) {
+  size_t size = source->length + t->code->length + (t->source_json == NULL? 0: t->source_json->length);
+  if (size > TEMPLATES_MAX_SIZE - g_templates.size) {
+    return false;
+  }
+  t->source = Stream_new(source->length);
+  Stream_write(t->source, source->data, source->length);
+
+  if (g_templates.num_templates >= g_templates.num_buckets) {
+    size_t num_buckets = g_templates.num_buckets == 0? 256: mulst(g_templates.num_buckets, 2);
+    struct Template ** buckets = xnew(struct Template *, num_buckets);
+    for (size_t i = 0; i < num_buckets; i++) {
+      buckets[i] = NULL;
+    }
+    for (size_t i = 0; i < g_templates.num_buckets; i++) {
+      struct Template * p = g_templates.buckets[i];
+      while (p != NULL) {
+        struct Template * next = p->next;
+        p->next = buckets[p->digest % num_buckets];
+        buckets[p->digest % num_buckets] = p;
+        p = next;
+      }
+    }
+    free(g_templates.buckets);
+    g_templates.buckets = buckets;
+    g_templates.num_buckets = num_buckets;
+  }
+  t->next = g_templates.buckets[t->digest % g_templates.num_buckets];
+  g_templates.buckets[t->digest % g_templates.num_buckets] = t;
+  g_templates.num_templates++;
+  g_templates.size += size;
+  return true;
+}
+
+/* deletes a template which was not kept */
+static void delete_template(struct Template * t) {
+  Stream_delete(t->code);
+  if (t->source_json != NULL) {
+    Stream_delete(t->source_json);
+  }
+  free(t);
+}
+
+/* destination_file is used only with --external-source */
+static void instrument_js_stream(const Stream * input_stream, Stream * output_stream, const char * destination_file, const char * id) {
+  uint64_t digest = hash_bytes(input_stream->data, input_stream->length);
+  struct Template * t = find_template(digest, input_stream);
+  bool cached = t != NULL;
+  if (! cached) {
+    size_t num_characters = input_stream->length;
+    uint16_t * characters = NULL;
+    int result = jscoverage_bytes_to_characters(jscoverage_encoding, input_stream->data, input_stream->length, &characters, &num_characters);
+    if (result == JSCOVERAGE_ERROR_ENCODING_NOT_SUPPORTED) {
+      fatal("encoding %s not supported", jscoverage_encoding);
+    }
+    else if (result == JSCOVERAGE_ERROR_INVALID_BYTE_SEQUENCE) {
+      fatal("error decoding %s in file %s", jscoverage_encoding, id);
+    }
+
+    t = xnew(struct Template, 1);
+    t->digest = digest;
+    t->source = NULL;
+    t->code = Stream_new(0);
+    jscoverage_instrument_js_template(id, characters, num_characters, t->code);
+    t->source_json = NULL;
+    if (jscoverage_external_source) {
+      t->source_json = Stream_new(0);
+      jscoverage_write_source(id, characters, num_characters, t->source_json);
+    }
+    free(characters);
+    cached = add_template(t, input_stream);
+  }
+
+  jscoverage_expand_template(t->code->data, t->code->length, id, output_stream);
+  if (jscoverage_external_source) {
+    write_source_file(destination_file, t->source_json);
+  }
+  if (! cached) {
+    delete_template(t);
+  }
+}
+
+/*
+With --incremental, the destination directory holds a manifest of the files
+copied to it.  Each line records the size and modification time of the source
+file, whether it was instrumented, a digest of its contents, and its name.  The manifest starts
+with the version of jscoverage and the options used: if these differ, every
+file is written again.
+*/
+#define MANIFEST_FILE "jscoverage-manifest.txt"
+
+struct ManifestEntry {
+  char * name;
+  uint64_t digest;
+  unsigned long long size;
+  long long mtime;
+  int instrumenting;
+  bool seen;
+};
+
+struct Manifest {
+  char * header;
+  struct ManifestEntry * entries;
+  size_t num_entries;
+  size_t capacity;
+
+  /* whether the entries were made by this version with the same options */
+  bool current;
+
+  /* when the manifest was written: sources modified since then are checked by digest */
+  time_t written;
+};
+
+static struct Manifest * Manifest_new(void) {
+  struct Manifest * manifest = xmalloc(sizeof(struct Manifest));
+  manifest->header = NULL;
+  manifest->entries = NULL;
+  manifest->num_entries = 0;
+  manifest->capacity = 0;
+  manifest->current = false;
+  manifest->written = 0;
+  return manifest;
+}
+
+static void Manifest_delete(struct Manifest * manifest) {
+  for (size_t i = 0; i < manifest->num_entries; i++) {
+    free(manifest->entries[i].name);
+  }
+  free(manifest->entries);
+  free(manifest->header);
+  free(manifest);
+}
+
+static void Manifest_add(struct Manifest * manifest, const struct ManifestEntry * entry) {
+  if (manifest->num_entries == manifest->capacity) {
+    manifest->capacity = manifest->capacity == 0? 256: mulst(manifest->capacity, 2);
+    manifest->entries = xrealloc(manifest->entries, mulst(manifest->capacity, sizeof(struct ManifestEntry)));
+  }
+  manifest->entries[manifest->num_entries] = *entry;
+  manifest->num_entries++;
+}
+
+static char * make_manifest_header(void) {
+  Stream * stream = Stream_new(0);
+  Stream_write_string(stream, "jscoverage " VERSION "\n");
+  jscoverage_write_options(stream);
+  Stream_printf(stream, " encoding=%s highlight=%d\n", jscoverage_encoding, jscoverage_highlight);
+  Stream_write_char(stream, '\0');
+  char * result = xstrdup((char *) stream->data);
+  Stream_delete(stream);
+  return result;
+}
+
+static int compare_manifest_entries(const void * p1, const void * p2) {
+  const struct ManifestEntry * e1 = p1;
+  const struct ManifestEntry * e2 = p2;
+  return strcmp(e1->name, e2->name);
+}
+
+static struct Manifest * read_manifest(const char * path, const char * header) {
+  struct Manifest * manifest = Manifest_new();
+  FILE * f = fopen(path, "rb");
+  if (f == NULL) {
+    return manifest;
+  }
+  struct stat buf;
+  if (fstat(fileno(f), &buf) == 0) {
+    manifest->written = buf.st_mtime;
+  }
+  Stream * stream = Stream_new(0);
+  Stream_write_file_contents(stream, f);
+  Stream_write_char(stream, '\0');
+  fclose(f);
+
+  char * data = (char *) stream->data;
+  size_t header_length = strlen(header);
+  manifest->current = strncmp(data, header, header_length) == 0;
+
+  /* skip the header (two lines) */
+  char * line = data;
+  for (int i = 0; i < 2 && line != NULL; i++) {
+    line = strchr(line, '\n');
+    if (line != NULL) {
+      line++;
+    }
+  }
+
+  while (line != NULL && *line != '\0') {
+    char * end = strchr(line, '\n');
+    if (end == NULL) {
+      /* truncated */
+      break;
+    }
+    *end = '\0';
+    struct ManifestEntry entry;
+    unsigned long long digest;
+    int name_offset = -1;
+    if (sscanf(line, "%llu %lld %d %16llx %n", &entry.size, &entry.mtime, &entry.instrumenting, &digest, &name_offset) == 4 && name_offset > 0) {
+      entry.name = xstrdup(line + name_offset);
+      entry.digest = digest;
+      entry.seen = false;
+      Manifest_add(manifest, &entry);
+    }
+    line = end + 1;
+  }
+  Stream_delete(stream);
+
+  qsort(manifest->entries, manifest->num_entries, sizeof(struct ManifestEntry), compare_manifest_entries);
+  return manifest;
+}
+
+static void write_manifest(const char * path, const struct Manifest * manifest) {
+  char * temporary_path;
+  xasprintf(&temporary_path, "%s.tmp", path);
+  FILE * f = xfopen(temporary_path, "wb");
+  fputs(manifest->header, f);
+  for (size_t i = 0; i < manifest->num_entries; i++) {
+    const struct ManifestEntry * entry = manifest->entries + i;
+    if (strchr(entry->name, '\n') != NULL) {
+      /* cannot be recorded: this file will always be copied again */
+      continue;
+    }
+    fprintf(f, "%llu %lld %d %016llx %s\n", entry->size, entry->mtime, entry->instrumenting, (unsigned long long) entry->digest, entry->name);
+  }
+  if (fclose(f) == EOF) {
+    fatal("cannot write to file: %s", temporary_path);
+  }
+#ifdef __MINGW32__
+  remove(path);
+#endif
+  if (rename(temporary_path, path) != 0) {
+    fatal("cannot rename file: %s", temporary_path);
+  }
+  free(temporary_path);
+}
+
+static uint64_t digest_file(const char * file) {
+  FILE * f = xfopen(file, "rb");
+  Stream * stream = Stream_new(0);
+  Stream_write_file_contents(stream, f);
+  fclose(f);
+  uint64_t result = hash_bytes(stream->data, stream->length);
+  Stream_delete(stream);
+  return result;
+}
+
+/*
+Fills in the manifest entry for a file and returns whether the file need not be
+copied again.  The source is read (to compute its digest) only if its size or
+modification time has changed.
+*/
+static bool check_manifest(struct Manifest * manifest, const char * source_file, const char * destination_file, const char * id, int instrumenting, struct ManifestEntry * entry) {
+  struct stat buf;
+  xstat(source_file, &buf);
+  entry->name = xstrdup(id);
+  entry->size = buf.st_size;
+  entry->mtime = buf.st_mtime;
+  entry->instrumenting = instrumenting;
+  entry->seen = false;
+
+  struct ManifestEntry key;
+  key.name = (char *) id;
+  struct ManifestEntry * old = NULL;
+  if (manifest->num_entries > 0) {
+    old = bsearch(&key, manifest->entries, manifest->num_entries, sizeof(struct ManifestEntry), compare_manifest_entries);
+  }
+  if (old != NULL) {
+    old->seen = true;
+  }
+
+  bool unchanged = manifest->current && old != NULL && old->instrumenting == instrumenting && stat(destination_file, &buf) == 0;
+  if (unchanged && old->size == entry->size && old->mtime == entry->mtime && entry->mtime < manifest->written) {
+    entry->digest = old->digest;
+    return true;
+  }
+  entry->digest = digest_file(source_file);
+  return unchanged && old->size == entry->size && old->digest == entry->digest;
+}
+
+/* removes the files copied by an earlier run whose source is gone (or is now excluded) */
+static void prune_manifest(const struct Manifest * manifest, const char * destination) {
+  for (size_t i = 0; i < manifest->num_entries; i++) {
+    const struct ManifestEntry * entry = manifest->entries + i;
+    if (entry->seen) {
+      continue;
+    }
+    if (entry->name[0] == '/' || strstr(entry->name, "..") != NULL) {
+      continue;
+    }
+    if (g_verbose) {
+      printf("Removing file %s\n", entry->name);
+    }
+    char * d = make_path(destination, entry->name);
+    remove(d);
+    char * source_file;
+    xasprintf(&source_file, "%s%s", d, JSCOVERAGE_SOURCE_SUFFIX);
+    remove(source_file);
+    free(source_file);
+    free(d);
+  }
+}
+
+static void copy_or_link_file(const char * source_file, const char * destination_file) {
+  if (g_link) {
+    link_file(source_file, destination_file);
+  }
+  else {
+    copy_file(source_file, destination_file);
+  }
+}
+
+/*
+Instruments (or copies) one file.  The instrumented code is written through io;
+read, if not NULL, is a read of the source file started earlier.
+*/
+static void instrument_file(const char * source_file, const char * destination_file, const char * id, int instrumenting, FileIO * io, FileRead * read) {
   if (g_verbose) {
     printf("Instrumenting file %s\n", id);
   }
@@ -78,6 +473,14 @@ static void instrument_file(const char * source_file, const char * destination_f
   /* check if they are the same */
   char * canonical_source_file = make_canonical_path(source_file);
   char * canonical_destination_file = make_canonical_path(destination_file);
+#ifndef _WIN32
+  if (strcmp(canonical_source_file, canonical_destination_file) != 0 && is_same_file(canonical_source_file, canonical_destination_file)) {
+    /* a hard link made by --link: writing to it would overwrite the source */
+    if (unlink(destination_file) == -1) {
+      fatal("cannot remove file: %s", destination_file);
+    }
+  }
+#endif
   check_same_file(canonical_source_file, canonical_destination_file);
   free(canonical_source_file);
   free(canonical_destination_file);
@@ -87,54 +490,265 @@ static void instrument_file(const char * source_file, const char * destination_f
     switch (file_type) {
     case FILE_TYPE_OTHER:
     case FILE_TYPE_HTML:
-      copy_file(source_file, destination_file);
+      copy_or_link_file(source_file, destination_file);
       break;
     case FILE_TYPE_JS:
       {
-        FILE * input = xfopen(source_file, "rb");
-        FILE * output = xfopen(destination_file, "wb");
-
-        Stream * input_stream = Stream_new(0);
+        if (read == NULL) {
+          read = FileIO_read(io, source_file);
+        }
+        Stream * input_stream = FileRead_wait(io, read);
+        read = NULL;
         Stream * output_stream = Stream_new(0);
 
-        Stream_write_file_contents(input_stream, input);
-
         /*
         Check if the source file looks like an instrumented JavaScript file.
         */
-        if (input_stream->length >= JSCOVERAGE_INSTRUMENTED_HEADER_LENGTH &&
-            memcmp(input_stream->data, JSCOVERAGE_INSTRUMENTED_HEADER, JSCOVERAGE_INSTRUMENTED_HEADER_LENGTH) == 0) {
+        if (is_instrumented(input_stream)) {
           fatal_command_line("file %s in the source directory appears to be already instrumented", id);
         }
 
-        size_t num_characters = input_stream->length;
-        uint16_t * characters = NULL;
-        int result = jscoverage_bytes_to_characters(jscoverage_encoding, input_stream->data, input_stream->length, &characters, &num_characters);
-        if (result == JSCOVERAGE_ERROR_ENCODING_NOT_SUPPORTED) {
-          fatal("encoding %s not supported", jscoverage_encoding);
-        }
-        else if (result == JSCOVERAGE_ERROR_INVALID_BYTE_SEQUENCE) {
-          fatal("error decoding %s in file %s", jscoverage_encoding, id);
-        }
-        jscoverage_instrument_js(id, characters, num_characters, output_stream);
-        free(characters);
-
-        if (fwrite(output_stream->data, 1, output_stream->length, output) != output_stream->length) {
-          fatal("cannot write to file: %s", destination_file);
-        }
+        instrument_js_stream(input_stream, output_stream, destination_file, id);
 
+        FileIO_write(io, destination_file, output_stream);
         Stream_delete(input_stream);
-        Stream_delete(output_stream);
-
-        fclose(input);
-        fclose(output);
       }
       break;
     }
   }
   else {
-    copy_file(source_file, destination_file);
+    copy_or_link_file(source_file, destination_file);
+  }
+}
+
+/* compiles the --exclude or --no-instrument paths (relative to the source directory) */
+static PathPatterns * make_path_patterns(char ** list, int length) {
+  PathPatterns * patterns = PathPatterns_new();
+  for (int i = 0; i < length; i++) {
+    PathPatterns_add(patterns, list[i]);
+  }
+  return patterns;
+}
+
+struct InstrumentJob {
+  char * source_file;
+  char * destination_file;
+  char * id;
+  int instrumenting;
+};
+
+#ifndef __MINGW32__
+static double get_time(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+Each worker process reads the indices of the jobs to run from a pipe shared by
+all the workers, so that a worker which gets large files simply takes fewer of
+them.
+*/
+static void run_worker(int worker, const struct InstrumentJob * jobs, int fd) {
+  if (g_verbose) {
+    /* keep lines from different workers separate */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+  }
+
+  double start = get_time();
+  unsigned int num_files = 0;
+  FileIO * io = FileIO_new();
+  uint32_t i;
+  while (read(fd, &i, sizeof(i)) == sizeof(i)) {
+    instrument_file(jobs[i].source_file, jobs[i].destination_file, jobs[i].id, jobs[i].instrumenting, io, NULL);
+    num_files++;
+  }
+  FileIO_delete(io);
+
+  if (g_verbose) {
+    double seconds = get_time() - start;
+    printf("Worker %d: %u files in %.3f seconds (%.1f files/second)\n", worker, num_files, seconds, seconds > 0? num_files / seconds: 0.0);
+  }
+  exit(EXIT_SUCCESS);
+}
+
+static void run_jobs(const struct InstrumentJob * jobs, uint32_t num_jobs, int num_workers) {
+  int fds[2];
+  if (pipe(fds) == -1) {
+    fatal("cannot create pipe");
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t * workers = xnew(pid_t, num_workers);
+  for (int w = 0; w < num_workers; w++) {
+    workers[w] = fork();
+    if (workers[w] == -1) {
+      fatal("cannot create worker process");
+    }
+    if (workers[w] == 0) {
+      close(fds[1]);
+      run_worker(w + 1, jobs, fds[0]);
+    }
+  }
+  close(fds[0]);
+
+  /* if every worker has failed, writing fails with EPIPE */
+  void (*handler)(int) = signal(SIGPIPE, SIG_IGN);
+  for (uint32_t i = 0; i < num_jobs; i++) {
+    if (write(fds[1], &i, sizeof(i)) != sizeof(i)) {
+      break;
+    }
+  }
+  close(fds[1]);
+  signal(SIGPIPE, handler);
+
+  /* a worker which fails has already reported the error: stop the others */
+  bool failed = false;
+  for (int n = 0; n < num_workers; n++) {
+    int status;
+    pid_t pid = wait(&status);
+    if (pid == -1) {
+      fatal("cannot wait for worker process");
+    }
+    if (! failed && ! (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)) {
+      failed = true;
+      for (int w = 0; w < num_workers; w++) {
+        if (workers[w] != pid) {
+          kill(workers[w], SIGTERM);
+        }
+      }
+    }
+  }
+  free(workers);
+  if (failed) {
+    exit(EXIT_FAILURE);
+  }
+}
+#endif
+
+/* the number of threads reading the source directory */
+#define WALK_THREADS 4
+
+/* without --jobs: how many files are read ahead of the one being instrumented */
+#define READ_AHEAD 32
+
+struct PendingFile {
+  struct InstrumentJob job;
+
+  /* NULL if the file is not read (it is copied) */
+  FileRead * read;
+};
+
+/* the state of jscoverage_instrument while it walks the source directory */
+struct InstrumentDirectory {
+  const char * source;
+  const char * destination;
+  const PathPatterns * exclude;
+  const PathPatterns * no_instrument;
+  struct Manifest * old_manifest;
+  struct Manifest * new_manifest;
+
+  /* the destination directory created last: files arrive a directory at a time */
+  char * last_directory;
+
+  /* with --jobs, the files are instrumented once the whole directory has been read */
+  bool collect_jobs;
+  struct InstrumentJob * jobs;
+  uint32_t num_jobs;
+  uint32_t jobs_capacity;
+
+  /* otherwise, they are instrumented in order while the next ones are read */
+  FileIO * io;
+  struct PendingFile pending[READ_AHEAD];
+  unsigned int first_pending;
+  unsigned int num_pending;
+};
+
+/* instruments the oldest pending file */
+static void instrument_pending(struct InstrumentDirectory * state) {
+  /* start the reads (and writes) requested since last time */
+  FileIO_submit(state->io);
+
+  struct PendingFile * p = state->pending + state->first_pending;
+  instrument_file(p->job.source_file, p->job.destination_file, p->job.id, p->job.instrumenting, state->io, p->read);
+  free(p->job.source_file);
+  free(p->job.destination_file);
+  free(p->job.id);
+  state->first_pending = (state->first_pending + 1) % READ_AHEAD;
+  state->num_pending--;
+}
+
+static void add_pending(struct InstrumentDirectory * state, char * source_file, char * destination_file, const char * id, int instrumenting) {
+  if (state->num_pending == READ_AHEAD) {
+    instrument_pending(state);
   }
+  struct PendingFile * p = state->pending + (state->first_pending + state->num_pending) % READ_AHEAD;
+  p->job.source_file = source_file;
+  p->job.destination_file = destination_file;
+  p->job.id = xstrdup(id);
+  p->job.instrumenting = instrumenting;
+  p->read = NULL;
+  if (instrumenting && get_file_type(source_file) == FILE_TYPE_JS) {
+    p->read = FileIO_read(state->io, source_file);
+  }
+  state->num_pending++;
+}
+
+static void instrument_entry(const char * name, void * data) {
+  struct InstrumentDirectory * state = data;
+
+  /* check if it's on the exclude list */
+  if (PathPatterns_match(state->exclude, name)) {
+    return;
+  }
+
+  char * s = make_path(state->source, name);
+  char * d = make_path(state->destination, name);
+
+  char * dd = make_dirname(d);
+  if (state->last_directory == NULL || strcmp(dd, state->last_directory) != 0) {
+    mkdirs(dd);
+    free(state->last_directory);
+    state->last_directory = dd;
+  }
+  else {
+    free(dd);
+  }
+
+  /* check if it's on the no-instrument list */
+  int instrument_this = ! PathPatterns_match(state->no_instrument, name);
+
+  if (state->new_manifest != NULL) {
+    struct ManifestEntry entry;
+    bool unchanged = check_manifest(state->old_manifest, s, d, name, instrument_this, &entry);
+    Manifest_add(state->new_manifest, &entry);
+    if (unchanged) {
+      if (g_verbose) {
+        printf("Skipping unchanged file %s\n", name);
+      }
+      free(s);
+      free(d);
+      return;
+    }
+  }
+
+  if (state->collect_jobs) {
+    /* run it later in a worker: its directory already exists, so workers never race to create one */
+    if (state->num_jobs == state->jobs_capacity) {
+      state->jobs_capacity = state->jobs_capacity == 0? 64: state->jobs_capacity * 2;
+      state->jobs = xrealloc(state->jobs, mulst(state->jobs_capacity, sizeof(struct InstrumentJob)));
+    }
+    struct InstrumentJob * job = state->jobs + state->num_jobs;
+    job->source_file = s;
+    job->destination_file = d;
+    job->id = xstrdup(name);
+    job->instrumenting = instrument_this;
+    state->num_jobs++;
+    return;
+  }
+
+  add_pending(state, s, d, name, instrument_this);
 }
 
 void jscoverage_instrument(const char * source,
@@ -143,12 +757,16 @@ void jscoverage_instrument(const char * source,
                            char ** exclude,
                            int num_exclude,
                            char ** no_instrument,
-                           int num_no_instrument)
+                           int num_no_instrument,
+                           int jobs,
+                           int incremental,
+                           int link)
 {
   assert(source != NULL);
   assert(destination != NULL);
 
   g_verbose = verbose;
+  g_link = link;
 
   /* check if they are the same */
   check_same_file(source, destination);
@@ -217,43 +835,415 @@ void jscoverage_instrument(const char * source,
     jscoverage_copy_resources(destination);
   }
 
+  char * manifest_path = make_path(destination, MANIFEST_FILE);
+  struct Manifest * old_manifest = NULL;
+  struct Manifest * new_manifest = NULL;
+  if (incremental) {
+    new_manifest = Manifest_new();
+    new_manifest->header = make_manifest_header();
+    old_manifest = read_manifest(manifest_path, new_manifest->header);
+  }
+  else {
+    /* every file is written again, perhaps with other options: a manifest left by --incremental would be wrong */
+    remove(manifest_path);
+  }
+
   /* finally: copy the directory */
-  struct DirListEntry * list = make_recursive_dir_list(source);
-  for (struct DirListEntry * p = list; p != NULL; p = p->next) {
-    char * s = make_path(source, p->name);
-    char * d = make_path(destination, p->name);
-
-    /* check if it's on the exclude list */
-    for (int i = 0; i < num_exclude; i++) {
-      char * x = make_path(source, exclude[i]);
-      if (is_same_file(x, s) || contains_file(x, s)) {
-        free(x);
-        goto cleanup;
+  PathPatterns * exclude_patterns = make_path_patterns(exclude, num_exclude);
+  PathPatterns * no_instrument_patterns = make_path_patterns(no_instrument, num_no_instrument);
+  struct InstrumentDirectory state;
+  state.source = source;
+  state.destination = destination;
+  state.exclude = exclude_patterns;
+  state.no_instrument = no_instrument_patterns;
+  state.old_manifest = old_manifest;
+  state.new_manifest = new_manifest;
+  state.last_directory = NULL;
+  state.collect_jobs = jobs > 1;
+  state.jobs = NULL;
+  state.num_jobs = 0;
+  state.jobs_capacity = 0;
+  state.io = FileIO_new();
+  state.first_pending = 0;
+  state.num_pending = 0;
+  walk_directory(source, WALK_THREADS, instrument_entry, &state);
+  while (state.num_pending > 0) {
+    instrument_pending(&state);
+  }
+  FileIO_delete(state.io);
+  free(state.last_directory);
+  struct InstrumentJob * job_list = state.jobs;
+  uint32_t num_jobs = state.num_jobs;
+
+  if (job_list != NULL) {
+#ifndef __MINGW32__
+    run_jobs(job_list, num_jobs, jobs);
+#endif
+    for (uint32_t i = 0; i < num_jobs; i++) {
+      free(job_list[i].source_file);
+      free(job_list[i].destination_file);
+      free(job_list[i].id);
+    }
+    free(job_list);
+  }
+
+  if (new_manifest != NULL) {
+    prune_manifest(old_manifest, destination);
+    write_manifest(manifest_path, new_manifest);
+    Manifest_delete(old_manifest);
+    Manifest_delete(new_manifest);
+  }
+  free(manifest_path);
+
+  PathPatterns_delete(exclude_patterns);
+  PathPatterns_delete(no_instrument_patterns);
+}
+
+void jscoverage_instrument_file(const char * source_file, const char * destination_file, const char * id) {
+  if (source_file != NULL && destination_file != NULL) {
+    check_same_file(source_file, destination_file);
+  }
+
+  Stream * input_stream = Stream_new(0);
+  if (source_file == NULL) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    Stream_write_file_contents(input_stream, stdin);
+  }
+  else {
+    FILE * f = xfopen(source_file, "rb");
+    Stream_write_file_contents(input_stream, f);
+    fclose(f);
+  }
+
+  if (is_instrumented(input_stream)) {
+    fatal_command_line("file %s appears to be already instrumented", source_file == NULL? id: source_file);
+  }
+
+  /* the output is not opened until the whole file is instrumented, so that an error leaves no partial file */
+  Stream * output_stream = Stream_new(0);
+  instrument_js_stream(input_stream, output_stream, destination_file, id);
+  Stream_delete(input_stream);
+
+  if (destination_file == NULL) {
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    if (fwrite(output_stream->data, 1, output_stream->length, stdout) != output_stream->length || fflush(stdout) != 0) {
+      fatal("cannot write to standard output");
+    }
+  }
+  else {
+    FILE * f = xfopen(destination_file, "wb");
+    if (fwrite(output_stream->data, 1, output_stream->length, f) != output_stream->length) {
+      fatal("cannot write to file: %s", destination_file);
+    }
+    if (fclose(f) != 0) {
+      fatal("cannot write to file: %s", destination_file);
+    }
+  }
+  Stream_delete(output_stream);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+/*
+--watch: after the initial copy, wait for changes in the source directory and
+copy (or remove) only the files affected.  Changes arriving close together -
+an editor saving several files, or a version control checkout - are collected
+and handled together.
+*/
+
+/* how long the source directory must be quiet before a batch of changes is handled */
+#define WATCH_QUIET_MILLISECONDS 50
+
+/* a batch is handled after this long even if changes keep arriving */
+#define WATCH_MAX_DELAY_MILLISECONDS 1000
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF)
+
+struct Watch {
+  int fd;
+
+  /* the directory watched by each watch descriptor (relative to the source; NULL if not watched) */
+  char ** directories;
+  int num_directories;
+
+  /* paths (relative to the source) changed in the current batch */
+  char ** changes;
+  size_t num_changes;
+  size_t changes_capacity;
+};
+
+static void add_change(struct Watch * watch, const char * path) {
+  for (size_t i = 0; i < watch->num_changes; i++) {
+    if (strcmp(watch->changes[i], path) == 0) {
+      return;
+    }
+  }
+  if (watch->num_changes == watch->changes_capacity) {
+    watch->changes_capacity = watch->changes_capacity == 0? 64: mulst(watch->changes_capacity, 2);
+    watch->changes = xrealloc(watch->changes, mulst(watch->changes_capacity, sizeof(char *)));
+  }
+  watch->changes[watch->num_changes] = xstrdup(path);
+  watch->num_changes++;
+}
+
+/* watches a directory and its subdirectories; if changed, every file in them is a change too */
+static void add_watches(struct Watch * watch, const char * source, const char * directory_wrt_source, bool changed) {
+  char * directory = directory_wrt_source == NULL? xstrdup(source): make_path(source, directory_wrt_source);
+  int wd = inotify_add_watch(watch->fd, directory, WATCH_EVENTS);
+  if (wd == -1) {
+    /* it may have been removed already */
+    free(directory);
+    return;
+  }
+  if (wd >= watch->num_directories) {
+    int n = wd + 64;
+    watch->directories = xrealloc(watch->directories, mulst(n, sizeof(char *)));
+    for (int i = watch->num_directories; i < n; i++) {
+      watch->directories[i] = NULL;
+    }
+    watch->num_directories = n;
+  }
+  free(watch->directories[wd]);
+  watch->directories[wd] = directory_wrt_source == NULL? xstrdup(""): xstrdup(directory_wrt_source);
+
+  DIR * dir = opendir(directory);
+  if (dir != NULL) {
+    struct dirent * e;
+    while ((e = readdir(dir)) != NULL) {
+      if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
+        continue;
       }
-      free(x);
+      char * entry = make_path(directory, e->d_name);
+      char * entry_wrt_source = directory_wrt_source == NULL? xstrdup(e->d_name): make_path(directory_wrt_source, e->d_name);
+      struct stat buf;
+      if (lstat(entry, &buf) == 0) {
+        if (S_ISDIR(buf.st_mode)) {
+          add_watches(watch, source, entry_wrt_source, changed);
+        }
+        else if (changed) {
+          add_change(watch, entry_wrt_source);
+        }
+      }
+      free(entry_wrt_source);
+      free(entry);
     }
+    closedir(dir);
+  }
+  free(directory);
+}
 
-    char * dd = make_dirname(d);
-    mkdirs(dd);
-    free(dd);
+static void read_events(struct Watch * watch, const char * source) {
+  char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t length = read(watch->fd, buffer, sizeof(buffer));
+  if (length == -1) {
+    if (errno == EINTR) {
+      return;
+    }
+    fatal("cannot read file system events");
+  }
+
+  for (char * p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+    const struct inotify_event * event = (const struct inotify_event *) p;
+    if (event->mask & IN_Q_OVERFLOW) {
+      /* events were lost: everything may have changed */
+      add_watches(watch, source, NULL, true);
+      continue;
+    }
+    if (event->wd < 0 || event->wd >= watch->num_directories || watch->directories[event->wd] == NULL) {
+      continue;
+    }
+    if (event->mask & IN_IGNORED) {
+      free(watch->directories[event->wd]);
+      watch->directories[event->wd] = NULL;
+      continue;
+    }
+    if (event->len == 0) {
+      continue;
+    }
 
-    int instrument_this = 1;
+    const char * directory = watch->directories[event->wd];
+    char * path = *directory == '\0'? xstrdup(event->name): make_path(directory, event->name);
+    if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+      add_watches(watch, source, path, true);
+    }
+    else if ((event->mask & IN_ISDIR) || ! (event->mask & IN_CREATE)) {
+      /* a file is handled when it is closed after writing (creating it is not enough) */
+      add_change(watch, path);
+    }
+    free(path);
+  }
+}
 
-    /* check if it's on the no-instrument list */
-    for (int i = 0; i < num_no_instrument; i++) {
-      char * ni = make_path(source, no_instrument[i]);
-      if (is_same_file(ni, s) || contains_file(ni, s)) {
-        instrument_this = 0;
+static void remove_destination(const char * path, const char * id) {
+  struct stat buf;
+  if (lstat(path, &buf) == -1) {
+    return;
+  }
+  if (S_ISDIR(buf.st_mode)) {
+    DIR * dir = opendir(path);
+    if (dir != NULL) {
+      struct dirent * e;
+      while ((e = readdir(dir)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) {
+          continue;
+        }
+        char * entry = make_path(path, e->d_name);
+        char * entry_id = make_path(id, e->d_name);
+        remove_destination(entry, entry_id);
+        free(entry_id);
+        free(entry);
       }
-      free(ni);
+      closedir(dir);
+    }
+    rmdir(path);
+  }
+  else {
+    if (g_verbose) {
+      printf("Removing file %s\n", id);
     }
+    remove(path);
+  }
+}
 
-    instrument_file(s, d, p->name, instrument_this);
+/*
+Instruments a file in a child process (which inherits the initialized
+JavaScript engine), so that a syntax error in a file being edited is reported
+without stopping --watch.
+*/
+static void watch_instrument_file(const char * source_file, const char * destination_file, const char * id, int instrumenting) {
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1) {
+    fatal("cannot create process");
+  }
+  if (pid == 0) {
+    FileIO * io = FileIO_new();
+    instrument_file(source_file, destination_file, id, instrumenting, io, NULL);
+    FileIO_delete(io);
+    exit(EXIT_SUCCESS);
+  }
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      fatal("cannot wait for process");
+    }
+  }
+  if (! (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS)) {
+    /* do not leave a partly written file */
+    remove(destination_file);
+  }
+}
+
+static void handle_changes(struct Watch * watch,
+                           const char * source,
+                           const char * destination,
+                           const PathPatterns * exclude,
+                           const PathPatterns * no_instrument)
+{
+  /* files are about to change without the manifest of --incremental knowing */
+  char * manifest_path = make_path(destination, MANIFEST_FILE);
+  remove(manifest_path);
+  free(manifest_path);
+
+  for (size_t i = 0; i < watch->num_changes; i++) {
+    const char * id = watch->changes[i];
+    char * s = make_path(source, id);
+    char * d = make_path(destination, id);
+
+    struct stat buf;
+    if (stat(s, &buf) == -1) {
+      remove_destination(d, id);
+      char * source_file;
+      xasprintf(&source_file, "%s%s", d, JSCOVERAGE_SOURCE_SUFFIX);
+      remove(source_file);
+      free(source_file);
+    }
+    else if (S_ISREG(buf.st_mode) && ! PathPatterns_match(exclude, id)) {
+      char * dd = make_dirname(d);
+      mkdirs(dd);
+      free(dd);
+      watch_instrument_file(s, d, id, ! PathPatterns_match(no_instrument, id));
+    }
 
-  cleanup:
     free(s);
     free(d);
+    free(watch->changes[i]);
   }
+  watch->num_changes = 0;
+  fflush(stdout);
+}
 
-  free_dir_list(list);
+void jscoverage_watch(const char * source,
+                      const char * destination,
+                      int verbose,
+                      char ** exclude,
+                      int num_exclude,
+                      char ** no_instrument,
+                      int num_no_instrument,
+                      int link)
+{
+  g_verbose = verbose;
+  g_link = link;
+
+  struct Watch watch;
+  watch.fd = inotify_init();
+  if (watch.fd == -1) {
+    fatal("cannot watch directory: %s", source);
+  }
+  watch.directories = NULL;
+  watch.num_directories = 0;
+  watch.changes = NULL;
+  watch.num_changes = 0;
+  watch.changes_capacity = 0;
+  add_watches(&watch, source, NULL, false);
+  PathPatterns * exclude_patterns = make_path_patterns(exclude, num_exclude);
+  PathPatterns * no_instrument_patterns = make_path_patterns(no_instrument, num_no_instrument);
+
+  if (g_verbose) {
+    printf("Watching directory %s\n", source);
+    fflush(stdout);
+  }
+
+  struct pollfd p;
+  p.fd = watch.fd;
+  p.events = POLLIN;
+  for (;;) {
+    /* wait for a change, then until changes stop arriving */
+    read_events(&watch, source);
+    double start = get_time();
+    while (watch.num_changes == 0 || (get_time() - start) * 1000 < WATCH_MAX_DELAY_MILLISECONDS) {
+      int result = poll(&p, 1, watch.num_changes == 0? -1: WATCH_QUIET_MILLISECONDS);
+      if (result == -1 && errno != EINTR) {
+        fatal("cannot read file system events");
+      }
+      if (result == 0) {
+        break;
+      }
+      if (result > 0) {
+        read_events(&watch, source);
+      }
+    }
+    handle_changes(&watch, source, destination, exclude_patterns, no_instrument_patterns);
+  }
 }
+
+#else
+
+void jscoverage_watch(const char * source,
+                      const char * destination,
+                      int verbose,
+                      char ** exclude,
+                      int num_exclude,
+                      char ** no_instrument,
+                      int num_no_instrument,
+                      int link)
+{
+  fatal("--watch is not supported on this platform");
+}
+
+#endif
@@ -26,6 +26,26 @@ void jscoverage_instrument(const char * source,
                            char ** exclude,
                            int num_exclude,
                            char ** no_instrument,
-                           int num_no_instrument);
+                           int num_no_instrument,
+                           int jobs,
+                           int incremental,
+                           int link);
+
+/*
+Instruments a single JavaScript file as id, with no resources copied.  A NULL
+source_file or destination_file means standard input or standard output.
+*/
+void jscoverage_instrument_file(const char * source_file,
+                                const char * destination_file,
+                                const char * id);
+
+void jscoverage_watch(const char * source,
+                      const char * destination,
+                      int verbose,
+                      char ** exclude,
+                      int num_exclude,
+                      char ** no_instrument,
+                      int num_no_instrument,
+                      int link);
 
 #endif /* INSTRUMENT_H_ */
@@ -67,6 +67,40 @@ function jscoverage_view() {
   openAndReuseOneTabPerURL('chrome://jscoverage/content/jscoverage.html');
 }
 
+// counters stored in a typed array (--typed-arrays) or per basic block
+// (--granularity=block) are converted to an ordinary array of line counters
+function jscoverage_getCounters(coverage) {
+  var executable = coverage.executable;
+  var blocks = coverage.blocks;
+  if (typeof executable !== 'string' && ! blocks) {
+    return coverage;
+  }
+  var result = [];
+  var length = coverage.length;
+  for (var line = 0; line < length; line++) {
+    if (typeof executable === 'string'? (parseInt(executable.charAt(line >> 2), 16) >> (line & 3)) & 1: coverage[line] !== undefined) {
+      result[line] = coverage[line];
+    }
+  }
+  if (blocks) {
+    for (var i = 0; i < blocks.length; i++) {
+      var lines = blocks.lines[i];
+      for (var j = 0; j < lines.length; j++) {
+        /* with --mode=boolean, a line is covered if any of its blocks is */
+        if (blocks.isBoolean) {
+          result[lines[j]] = result[lines[j]] || blocks[i];
+        }
+        else {
+          result[lines[j]] += blocks[i];
+        }
+      }
+    }
+  }
+  result.source = coverage.source;
+  result.conditionals = coverage.conditionals;
+  return result;
+}
+
 function jscoverage_pad(s) {
   return '0000'.substr(s.length) + s;
 }
@@ -173,7 +207,7 @@ function jscoverage_store() {
         }
         write(jscoverage_quote(file));
         write(':{"coverage":[');
-        var coverage = _$jscoverage[file];
+        var coverage = jscoverage_getCounters(_$jscoverage[file]);
         var length = coverage.length;
         for (var line = 0; line < length; line++) {
           if (line > 0) {
@@ -194,7 +228,11 @@ function jscoverage_store() {
           }
           write(jscoverage_quote(source[line]));
         }
-        write(']}');
+        write(']');
+        if (typeof _$jscoverage[file].samples === 'number') {
+          write(',"samples":' + _$jscoverage[file].samples);
+        }
+        write('}');
       }
       write('}');
       alert('Coverage data stored.');
@@ -21,22 +21,29 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <dirent.h>
+#include <fcntl.h>
 #ifdef HAVE_PTHREAD_H
 #include <pthread.h>
 #endif
+#ifndef __MINGW32__
+#include <sys/file.h>
+#endif
 
 #include "encoding.h"
 #include "global.h"
 #include "http-server.h"
 #include "instrument-js.h"
+#include "path-patterns.h"
 #include "resource-manager.h"
 #include "stream.h"
 #include "util.h"
+#include "worker-pool.h"
 
 static const char * specified_encoding = NULL;
 const char * jscoverage_encoding = "ISO-8859-1";
@@ -73,6 +80,23 @@ static const char * document_root = ".";
 static bool proxy = false;
 static const char ** no_instrument;
 static size_t num_no_instrument = 0;
+static PathPatterns * no_instrument_patterns = NULL;
+
+/* with --proxy, the time allowed for the remote server to send or accept data (see --timeout) */
+static unsigned int proxy_timeout = 60;
+
+/*
+With --js-workers, instrumentation and coverage data are handled by worker
+processes, each with its own JavaScript engine, instead of by the engine in
+this process (which can be used by only one thread at a time).
+*/
+static WorkerPool * javascript_workers = NULL;
+
+enum JavaScriptRequest {
+  JAVASCRIPT_INSTRUMENT = 'I',
+  JAVASCRIPT_SOURCE = 'S',
+  JAVASCRIPT_STORE = 'C'
+};
 
 #ifdef __MINGW32__
 CRITICAL_SECTION javascript_mutex;
@@ -86,6 +110,16 @@ pthread_mutex_t source_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define UNLOCK pthread_mutex_unlock
 #endif
 
+#ifndef __MINGW32__
+static void lock_source_cache(void) {
+  LOCK(&source_cache_mutex);
+}
+
+static void unlock_source_cache(void) {
+  UNLOCK(&source_cache_mutex);
+}
+#endif
+
 static const SourceCache * find_cached_source(const char * url) {
   SourceCache * result = NULL;
   LOCK(&source_cache_mutex);
@@ -345,20 +379,25 @@ Checks whether a URI is on the no-instrument list.
 static bool is_no_instrument(const char * uri) {
   assert(*uri != '\0');
 
+  return PathPatterns_match(no_instrument_patterns, uri);
+}
+
+/* compiles the no-instrument list: each entry matches the URIs beginning with it */
+static void make_no_instrument_patterns(void) {
+  no_instrument_patterns = PathPatterns_new();
   for (size_t i = 0; i < num_no_instrument; i++) {
-    if (str_starts_with(uri, no_instrument[i])) {
-      return true;
-    }
+    PathPatterns_add_prefix(no_instrument_patterns, no_instrument[i]);
 
     /*
     For a local URL, accept "/foo/bar" and "foo/bar" on the no-instrument list.
     */
-    if (! proxy && str_starts_with(uri + 1, no_instrument[i])) {
-      return true;
+    if (! proxy) {
+      char * uri;
+      xasprintf(&uri, "/%s", no_instrument[i]);
+      PathPatterns_add_prefix(no_instrument_patterns, uri);
+      free(uri);
     }
   }
-
-  return false;
 }
 
 static bool is_javascript(HTTPExchange * exchange) {
@@ -464,11 +503,103 @@ static void write_js_quoted_string(FILE * f, char * data, size_t length) {
   putc('"', f);
 }
 
-static void write_source(const char * id, const uint16_t * characters, size_t num_characters, FILE * f) {
-  Stream * output = Stream_new(num_characters);
+static int call_javascript_worker(enum JavaScriptRequest request, const char * name, const void * data, size_t length, Stream * response) __attribute__((warn_unused_result));
+
+static int call_javascript_worker(enum JavaScriptRequest request, const char * name, const void * data, size_t length, Stream * response) {
+  Stream * message = Stream_new(addst(addst(strlen(name), 2), length));
+  Stream_write_char(message, request);
+  Stream_write(message, name, strlen(name) + 1);
+  Stream_write(message, data, length);
+  int result = WorkerPool_call(javascript_workers, message->data, message->length, response);
+  Stream_delete(message);
+  return result;
+}
+
+static int write_source(const char * id, const uint16_t * characters, size_t num_characters, Stream * output) __attribute__((warn_unused_result));
+
+static int write_source(const char * id, const uint16_t * characters, size_t num_characters, Stream * output) {
+  if (javascript_workers != NULL) {
+    Stream * source = Stream_new(0);
+    int result = call_javascript_worker(JAVASCRIPT_SOURCE, id, characters, mulst(num_characters, sizeof(uint16_t)), source);
+    if (result == 0) {
+      Stream_write(output, source->data, source->length);
+    }
+    else {
+      HTTPServer_log_err("Warning: could not highlight %s\n", id);
+    }
+    Stream_delete(source);
+    return result;
+  }
+
+  LOCK(&javascript_mutex);
   jscoverage_write_source(id, characters, num_characters, output);
-  fwrite(output->data, 1, output->length, f);
-  Stream_delete(output);
+  UNLOCK(&javascript_mutex);
+  return 0;
+}
+
+/*
+Writes the highlighted source for a file to the given stream, retrieving it
+from the origin server (in proxy mode) or the document root.  Returns 0 on
+success, -1 if the source could not be retrieved.
+*/
+static int get_source(const char * id, Stream * output) __attribute__((warn_unused_result));
+
+static int get_source(const char * id, Stream * output) {
+  if (proxy) {
+    const SourceCache * cached = find_cached_source(id);
+    if (cached == NULL) {
+      uint16_t * characters;
+      size_t num_characters;
+      if (get(id, &characters, &num_characters) != 0) {
+        HTTPServer_log_err("Warning: cannot retrieve URL: %s\n", id);
+        return -1;
+      }
+      int result = write_source(id, characters, num_characters, output);
+      add_cached_source(id, characters, num_characters);
+      return result;
+    }
+    else {
+      return write_source(id, cached->characters, cached->num_characters, output);
+    }
+  }
+
+  /* check that the path begins with / */
+  if (id[0] != '/') {
+    HTTPServer_log_err("Warning: invalid source path: %s\n", id);
+    return -1;
+  }
+  char * decoded_path = decode_uri_component(id);
+  if (strstr(decoded_path, "..") != NULL) {
+    free(decoded_path);
+    HTTPServer_log_err("Warning: invalid source path: %s\n", id);
+    return -1;
+  }
+  char * source_path = make_path(document_root, decoded_path + 1);
+  free(decoded_path);
+  FILE * source_file = fopen(source_path, "rb");
+  free(source_path);
+  if (source_file == NULL) {
+    HTTPServer_log_err("Warning: cannot open file: %s\n", id);
+    return -1;
+  }
+  Stream * stream = Stream_new(0);
+  Stream_write_file_contents(stream, source_file);
+  fclose(source_file);
+  uint16_t * characters;
+  size_t num_characters;
+  int result = jscoverage_bytes_to_characters(jscoverage_encoding, stream->data, stream->length, &characters, &num_characters);
+  Stream_delete(stream);
+  if (result == JSCOVERAGE_ERROR_ENCODING_NOT_SUPPORTED) {
+    HTTPServer_log_err("Warning: encoding %s not supported\n", jscoverage_encoding);
+    return -1;
+  }
+  else if (result == JSCOVERAGE_ERROR_INVALID_BYTE_SEQUENCE) {
+    HTTPServer_log_err("Warning: error decoding %s in file %s\n", jscoverage_encoding, id);
+    return -1;
+  }
+  result = write_source(id, characters, num_characters, output);
+  free(characters);
+  return result;
 }
 
 static void write_json_for_file(const FileCoverage * file_coverage, int i, void * p) {
@@ -495,70 +626,14 @@ static void write_json_for_file(const FileCoverage * file_coverage, int i, void
   }
   fputs("],\"source\":", f);
   if (file_coverage->source_lines == NULL) {
-    if (proxy) {
-      const SourceCache * cached = find_cached_source(file_coverage->id);
-      if (cached == NULL) {
-        uint16_t * characters;
-        size_t num_characters;
-        if (get(file_coverage->id, &characters, &num_characters) == 0) {
-          write_source(file_coverage->id, characters, num_characters, f);
-          add_cached_source(file_coverage->id, characters, num_characters);
-        }
-        else {
-          fputs("[]", f);
-          HTTPServer_log_err("Warning: cannot retrieve URL: %s\n", file_coverage->id);
-        }
-      }
-      else {
-        write_source(file_coverage->id, cached->characters, cached->num_characters, f);
-      }
+    Stream * source = Stream_new(0);
+    if (get_source(file_coverage->id, source) == 0) {
+      fwrite(source->data, 1, source->length, f);
     }
     else {
-      /* check that the path begins with / */
-      if (file_coverage->id[0] == '/') {
-        char * decoded_path = decode_uri_component(file_coverage->id);
-        if (strstr(decoded_path, "..") != NULL) {
-          free(decoded_path);
-          fputs("[]", f);
-          HTTPServer_log_err("Warning: invalid source path: %s\n", file_coverage->id);
-          goto done;
-        }
-        char * source_path = make_path(document_root, decoded_path + 1);
-        free(decoded_path);
-        FILE * source_file = fopen(source_path, "rb");
-        free(source_path);
-        if (source_file == NULL) {
-          fputs("[]", f);
-          HTTPServer_log_err("Warning: cannot open file: %s\n", file_coverage->id);
-        }
-        else {
-          Stream * stream = Stream_new(0);
-          Stream_write_file_contents(stream, source_file);
-          fclose(source_file);
-          uint16_t * characters;
-          size_t num_characters;
-          int result = jscoverage_bytes_to_characters(jscoverage_encoding, stream->data, stream->length, &characters, &num_characters);
-          Stream_delete(stream);
-          if (result == JSCOVERAGE_ERROR_ENCODING_NOT_SUPPORTED) {
-            fputs("[]", f);
-            HTTPServer_log_err("Warning: encoding %s not supported\n", jscoverage_encoding);
-          }
-          else if (result == JSCOVERAGE_ERROR_INVALID_BYTE_SEQUENCE) {
-            fputs("[]", f);
-            HTTPServer_log_err("Warning: error decoding %s in file %s\n", jscoverage_encoding, file_coverage->id);
-          }
-          else {
-            write_source(file_coverage->id, characters, num_characters, f);
-            free(characters);
-          }
-        }
-      }
-      else {
-        /* path does not begin with / */
-        fputs("[]", f);
-        HTTPServer_log_err("Warning: invalid source path: %s\n", file_coverage->id);
-      }
+      fputs("[]", f);
     }
+    Stream_delete(source);
   }
   else {
     fputc('[', f);
@@ -571,7 +646,9 @@ static void write_json_for_file(const FileCoverage * file_coverage, int i, void
     }
     fputc(']', f);
   }
-done:
+  if (file_coverage->samples >= 0) {
+    fprintf(f, ",\"samples\":%d", file_coverage->samples);
+  }
   fputc('}', f);
 }
 
@@ -592,6 +669,133 @@ static int write_json(Coverage * coverage, const char * path) {
   return 0;
 }
 
+/*
+Parses the coverage data sent by the browser, merges it with the data already
+stored in the report directory and writes the report.  Returns the HTTP status
+code and sets *message to the response body.
+*/
+static uint16_t store_coverage(const char * current_report_directory, const uint8_t * json, size_t length, const char ** message) {
+  Coverage * coverage = Coverage_new();
+  LOCK(&javascript_mutex);
+  int result = jscoverage_parse_json(coverage, json, length);
+  UNLOCK(&javascript_mutex);
+
+  if (result != 0) {
+    Coverage_delete(coverage);
+    *message = "Could not parse coverage data\n";
+    return 400;
+  }
+
+  mkdir_if_necessary(report_directory);
+  mkdir_if_necessary(current_report_directory);
+
+#ifndef __MINGW32__
+  /* stores to the same directory may run concurrently in different processes */
+  int lock = open(current_report_directory, O_RDONLY);
+  if (lock != -1) {
+    flock(lock, LOCK_EX);
+  }
+#endif
+
+  uint16_t status_code = 200;
+  *message = "Coverage data stored\n";
+  char * path = make_path(current_report_directory, "jscoverage.json");
+
+  /* check if the JSON file exists */
+  struct stat buf;
+  if (stat(path, &buf) == 0) {
+    /* it exists: merge */
+    FILE * f = fopen(path, "rb");
+    if (f == NULL) {
+      result = 1;
+    }
+    else {
+      result = merge(coverage, f);
+      if (fclose(f) == EOF) {
+        result = 1;
+      }
+    }
+    if (result != 0) {
+      free(path);
+      status_code = 500;
+      *message = "Could not merge with existing coverage data\n";
+      goto done;
+    }
+  }
+
+  result = write_json(coverage, path);
+  free(path);
+  if (result != 0) {
+    status_code = 500;
+    *message = "Could not write coverage data\n";
+    goto done;
+  }
+
+  /* copy other files */
+  jscoverage_copy_resources(current_report_directory);
+  path = make_path(current_report_directory, "jscoverage.js");
+  FILE * f = fopen(path, "ab");
+  free(path);
+  if (f == NULL) {
+    status_code = 500;
+    *message = "Could not write to file: jscoverage.js\n";
+    goto done;
+  }
+  fputs("jscoverage_isReport = true;\r\n", f);
+  if (fclose(f) == EOF) {
+    status_code = 500;
+    *message = "Could not write to file: jscoverage.js\n";
+    goto done;
+  }
+
+done:
+#ifndef __MINGW32__
+  if (lock != -1) {
+    close(lock);
+  }
+#endif
+  Coverage_delete(coverage);
+  return status_code;
+}
+
+static void javascript_worker(const uint8_t * request, size_t length, Stream * response) {
+  /* this process is itself a worker: use its own engine */
+  javascript_workers = NULL;
+
+  const char * name = (const char *) request + 1;
+  size_t offset = strlen(name) + 2;
+  const uint8_t * data = request + offset;
+  length -= offset;
+
+  switch (request[0]) {
+  case JAVASCRIPT_INSTRUMENT:
+  case JAVASCRIPT_SOURCE:
+    {
+      /* copy the characters: they are not aligned in the request */
+      size_t num_characters = length / sizeof(uint16_t);
+      uint16_t * characters = xnew(uint16_t, num_characters);
+      memcpy(characters, data, num_characters * sizeof(uint16_t));
+      if (request[0] == JAVASCRIPT_INSTRUMENT) {
+        jscoverage_instrument_js(name, characters, num_characters, response);
+      }
+      else {
+        jscoverage_write_source(name, characters, num_characters, response);
+      }
+      free(characters);
+    }
+    break;
+  case JAVASCRIPT_STORE:
+    {
+      const char * message;
+      uint16_t status_code = store_coverage(name, data, length, &message);
+      Stream_printf(response, "%u %s", (unsigned int) status_code, message);
+    }
+    break;
+  default:
+    fatal("invalid worker request");
+  }
+}
+
 static void handle_jscoverage_request(HTTPExchange * exchange) {
   /* set the `Server' response-header (RFC 2616 14.38, 3.8) */
   HTTPExchange_set_response_header(exchange, HTTP_SERVER, "jscoverage-server/" VERSION);
@@ -614,19 +818,6 @@ static void handle_jscoverage_request(HTTPExchange * exchange) {
       return;
     }
 
-    Coverage * coverage = Coverage_new();
-    LOCK(&javascript_mutex);
-    int result = jscoverage_parse_json(coverage, json->data, json->length);
-    UNLOCK(&javascript_mutex);
-    Stream_delete(json);
-
-    if (result != 0) {
-      Coverage_delete(coverage);
-      send_response(exchange, 400, "Could not parse coverage data\n");
-      return;
-    }
-
-    mkdir_if_necessary(report_directory);
     char * current_report_directory;
     if (str_starts_with(abs_path, "/jscoverage-store/") && abs_path[18] != '\0') {
       char * dir = decode_uri_component(abs_path + 18);
@@ -636,58 +827,49 @@ static void handle_jscoverage_request(HTTPExchange * exchange) {
     else {
       current_report_directory = xstrdup(report_directory);
     }
-    mkdir_if_necessary(current_report_directory);
-    char * path = make_path(current_report_directory, "jscoverage.json");
 
-    /* check if the JSON file exists */
-    struct stat buf;
-    if (stat(path, &buf) == 0) {
-      /* it exists: merge */
-      FILE * f = fopen(path, "rb");
-      if (f == NULL) {
-        result = 1;
+    if (javascript_workers != NULL) {
+      Stream * response = Stream_new(0);
+      if (call_javascript_worker(JAVASCRIPT_STORE, current_report_directory, json->data, json->length, response) == 0) {
+        /* the response is the status code, a space and the message */
+        Stream_write_char(response, '\0');
+        char * message;
+        unsigned long status_code = strtoul((char *) response->data, &message, 10);
+        send_response(exchange, (uint16_t) status_code, message + 1);
       }
       else {
-        result = merge(coverage, f);
-        if (fclose(f) == EOF) {
-          result = 1;
-        }
-      }
-      if (result != 0) {
-        free(current_report_directory);
-        free(path);
-        Coverage_delete(coverage);
-        send_response(exchange, 500, "Could not merge with existing coverage data\n");
-        return;
+        send_response(exchange, 500, "Could not store coverage data\n");
       }
+      Stream_delete(response);
     }
-
-    result = write_json(coverage, path);
-    free(path);
-    Coverage_delete(coverage);
-    if (result != 0) {
-      free(current_report_directory);
-      send_response(exchange, 500, "Could not write coverage data\n");
-      return;
+    else {
+      const char * message;
+      uint16_t status_code = store_coverage(current_report_directory, json->data, json->length, &message);
+      send_response(exchange, status_code, message);
     }
-
-    /* copy other files */
-    jscoverage_copy_resources(current_report_directory);
-    path = make_path(current_report_directory, "jscoverage.js");
     free(current_report_directory);
-    FILE * f = fopen(path, "ab");
-    free(path);
-    if (f == NULL) {
-      send_response(exchange, 500, "Could not write to file: jscoverage.js\n");
+    Stream_delete(json);
+  }
+  else if (strcmp(abs_path, "/jscoverage-source") == 0) {
+    const char * query = HTTPExchange_get_query(exchange);
+    if (query == NULL) {
+      send_response(exchange, 400, "Missing file name\n");
       return;
     }
-    fputs("jscoverage_isReport = true;\r\n", f);
-    if (fclose(f) == EOF) {
-      send_response(exchange, 500, "Could not write to file: jscoverage.js\n");
+    char * id = decode_uri_component(query);
+    Stream * source = Stream_new(0);
+    int result = get_source(id, source);
+    free(id);
+    if (result != 0) {
+      Stream_delete(source);
+      send_response(exchange, 404, "Not found\n");
       return;
     }
-
-    send_response(exchange, 200, "Coverage data stored\n");
+    HTTPExchange_set_response_header(exchange, HTTP_CONTENT_TYPE, "application/json");
+    if (HTTPExchange_write_response(exchange, source->data, source->length) != 0) {
+      HTTPServer_log_err("Warning: error writing to client\n");
+    }
+    Stream_delete(source);
   }
   else if (str_starts_with(abs_path, "/jscoverage-shutdown")) {
     if (strcmp(HTTPExchange_get_method(exchange), "POST") != 0) {
@@ -702,7 +884,8 @@ static void handle_jscoverage_request(HTTPExchange * exchange) {
       send_response(exchange, 500, "Cannot get client address\n");
       return;
     }
-    if (client.sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+    /* a client of a Unix domain socket is on this host */
+    if (client.sin_family != AF_UNIX && client.sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
       send_response(exchange, 403, "This operation can be performed only by localhost\n");
       return;
     }
@@ -731,13 +914,29 @@ static void handle_jscoverage_request(HTTPExchange * exchange) {
   }
 }
 
-static void instrument_js(const char * id, const uint16_t * characters, size_t num_characters, Stream * output_stream) {
+static int instrument_js(const char * id, const uint16_t * characters, size_t num_characters, Stream * output_stream) __attribute__((warn_unused_result));
+
+static int instrument_js(const char * id, const uint16_t * characters, size_t num_characters, Stream * output_stream) {
   const struct Resource * resource = get_resource("report.js");
   Stream_write(output_stream, resource->data, resource->length);
 
+  if (javascript_workers != NULL) {
+    Stream * instrumented = Stream_new(0);
+    int result = call_javascript_worker(JAVASCRIPT_INSTRUMENT, id, characters, mulst(num_characters, sizeof(uint16_t)), instrumented);
+    if (result == 0) {
+      Stream_write(output_stream, instrumented->data, instrumented->length);
+    }
+    else {
+      HTTPServer_log_err("Warning: could not instrument %s\n", id);
+    }
+    Stream_delete(instrumented);
+    return result;
+  }
+
   LOCK(&javascript_mutex);
   jscoverage_instrument_js(id, characters, num_characters, output_stream);
   UNLOCK(&javascript_mutex);
+  return 0;
 }
 
 static bool is_hop_by_hop_header(const char * h) {
@@ -796,7 +995,13 @@ static void handle_proxy_request(HTTPExchange * client_exchange) {
   server_connection = HTTPConnection_new_client(host, port);
   if (server_connection == NULL) {
     send_response(client_exchange, 504, "Could not connect to server\n");
-    goto done;
+    goto error;
+  }
+
+  /* a server which stalls would otherwise hold one of the server's threads for good */
+  if (HTTPConnection_set_timeout(server_connection, proxy_timeout) != 0) {
+    send_response(client_exchange, 502, "Could not set timeout for server connection\n");
+    goto error;
   }
 
   /* create a new exchange */
@@ -839,7 +1044,7 @@ static void handle_proxy_request(HTTPExchange * client_exchange) {
   /* send the request */
   if (HTTPExchange_write_request_headers(server_exchange) != 0) {
     send_response(client_exchange, 502, "Could not write to server\n");
-    goto done;
+    goto error;
   }
 
   /* handle POST or PUT */
@@ -848,19 +1053,19 @@ static void handle_proxy_request(HTTPExchange * client_exchange) {
     HTTPMessage * server_request = HTTPExchange_get_request_message(server_exchange);
     if (copy_http_message_body(client_request, server_request) != 0) {
       send_response(client_exchange, 400, "Error copying request body from client to server\n");
-      goto done;
+      goto error;
     }
   }
 
   if (HTTPExchange_flush_request(server_exchange) != 0) {
     send_response(client_exchange, 502, "Could not write to server\n");
-    goto done;
+    goto error;
   }
 
   /* receive the response */
   if (HTTPExchange_read_response_headers(server_exchange) != 0) {
     send_response(client_exchange, 502, "Could not read headers from server\n");
-    goto done;
+    goto error;
   }
 
   HTTPExchange_set_status_code(client_exchange, HTTPExchange_get_status_code(server_exchange));
@@ -871,7 +1076,7 @@ static void handle_proxy_request(HTTPExchange * client_exchange) {
     if (HTTPExchange_read_entire_response_entity_body(server_exchange, input_stream) != 0) {
       Stream_delete(input_stream);
       send_response(client_exchange, 502, "Could not read body from server\n");
-      goto done;
+      goto error;
     }
 
     const char * request_uri = HTTPExchange_get_request_uri(client_exchange);
@@ -886,15 +1091,20 @@ static void handle_proxy_request(HTTPExchange * client_exchange) {
     Stream_delete(input_stream);
     if (result == JSCOVERAGE_ERROR_ENCODING_NOT_SUPPORTED) {
       send_response(client_exchange, 500, "Encoding not supported\n");
-      goto done;
+      goto error;
     }
     else if (result == JSCOVERAGE_ERROR_INVALID_BYTE_SEQUENCE) {
       send_response(client_exchange, 502, "Error decoding response\n");
-      goto done;
+      goto error;
     }
 
     Stream * output_stream = Stream_new(0);
-    instrument_js(request_uri, characters, num_characters, output_stream);
+    if (instrument_js(request_uri, characters, num_characters, output_stream) != 0) {
+      Stream_delete(output_stream);
+      free(characters);
+      send_response(client_exchange, 500, "Could not instrument JavaScript\n");
+      goto error;
+    }
 
     /* send the headers to the client */
     for (const HTTPHeader * h = HTTPExchange_get_response_headers(server_exchange); h != NULL; h = h->next) {
@@ -939,7 +1149,7 @@ static void handle_proxy_request(HTTPExchange * client_exchange) {
 
     if (HTTPExchange_write_response_headers(client_exchange) != 0) {
       HTTPServer_log_err("Warning: error writing to client\n");
-      goto done;
+      goto error;
     }
 
     if (HTTPExchange_response_has_body(server_exchange)) {
@@ -948,10 +1158,15 @@ static void handle_proxy_request(HTTPExchange * client_exchange) {
       HTTPMessage * server_response = HTTPExchange_get_response_message(server_exchange);
       if (copy_http_message_body(server_response, client_response) != 0) {
         HTTPServer_log_err("Warning: error copying response body from server to client\n");
-        goto done;
+        goto error;
       }
     }
   }
+  goto done;
+
+error:
+  /* the client cannot rely on the connection after a failed exchange with the server */
+  HTTPExchange_set_persistent(client_exchange, false);
 
 done:
   if (server_exchange != NULL) {
@@ -1075,8 +1290,14 @@ static void handle_local_request(HTTPExchange * exchange) {
       }
 
       Stream * output_stream = Stream_new(0);
-      instrument_js(abs_path, characters, num_characters, output_stream);
+      result = instrument_js(abs_path, characters, num_characters, output_stream);
       free(characters);
+      if (result != 0) {
+        Stream_delete(output_stream);
+        fclose(f);
+        send_response(exchange, 500, "Could not instrument JavaScript\n");
+        goto done;
+      }
 
       if (HTTPExchange_write_response(exchange, output_stream->data, output_stream->length) != 0) {
         HTTPServer_log_err("Warning: error writing to client\n");
@@ -1133,6 +1354,12 @@ int main(int argc, char ** argv) {
 
   const char * ip_address = "127.0.0.1";
   const char * port = "8080";
+  const char * js_workers = NULL;
+  const char * backlog = NULL;
+  const char * threads = NULL;
+  const char * timeout = NULL;
+  const char * workers = NULL;
+  const char * unix_socket = NULL;
   int shutdown = 0;
 
   no_instrument = xnew(const char *, argc - 1);
@@ -1160,6 +1387,17 @@ int main(int argc, char ** argv) {
       report_directory = argv[i] + 13;
     }
 
+    else if (strcmp(argv[i], "--backlog") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--backlog: option requires an argument");
+      }
+      backlog = argv[i];
+    }
+    else if (strncmp(argv[i], "--backlog=", 10) == 0) {
+      backlog = argv[i] + 10;
+    }
+
     else if (strcmp(argv[i], "--document-root") == 0) {
       i++;
       if (i == argc) {
@@ -1184,6 +1422,17 @@ int main(int argc, char ** argv) {
       specified_encoding = jscoverage_encoding;
     }
 
+    else if (strcmp(argv[i], "--granularity") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--granularity: option requires an argument");
+      }
+      jscoverage_set_granularity(argv[i]);
+    }
+    else if (strncmp(argv[i], "--granularity=", 14) == 0) {
+      jscoverage_set_granularity(argv[i] + 14);
+    }
+
     else if (strcmp(argv[i], "--ip-address") == 0) {
       i++;
       if (i == argc) {
@@ -1206,6 +1455,44 @@ int main(int argc, char ** argv) {
       jscoverage_set_js_version(argv[i] + 13);
     }
 
+    else if (strcmp(argv[i], "--js-workers") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--js-workers: option requires an argument");
+      }
+      js_workers = argv[i];
+    }
+    else if (strncmp(argv[i], "--js-workers=", 13) == 0) {
+      js_workers = argv[i] + 13;
+    }
+
+    else if (strcmp(argv[i], "--mode") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--mode: option requires an argument");
+      }
+      jscoverage_set_counter_mode(argv[i]);
+    }
+    else if (strncmp(argv[i], "--mode=", 7) == 0) {
+      jscoverage_set_counter_mode(argv[i] + 7);
+    }
+
+    else if (strcmp(argv[i], "--local-counters") == 0) {
+      jscoverage_local_counters = true;
+    }
+    else if (strcmp(argv[i], "--typed-arrays") == 0) {
+      jscoverage_typed_arrays = true;
+    }
+    else if (strcmp(argv[i], "--compact-prologue") == 0) {
+      jscoverage_compact_prologue = true;
+    }
+    else if (strcmp(argv[i], "--compact-output") == 0) {
+      jscoverage_compact_output = true;
+    }
+    else if (strcmp(argv[i], "--external-source") == 0) {
+      jscoverage_external_source = true;
+    }
+
     else if (strcmp(argv[i], "--no-highlight") == 0) {
       jscoverage_highlight = false;
     }
@@ -1238,10 +1525,65 @@ int main(int argc, char ** argv) {
       proxy = 1;
     }
 
+    else if (strcmp(argv[i], "--sample-rate") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--sample-rate: option requires an argument");
+      }
+      jscoverage_set_sample_rate(argv[i]);
+    }
+    else if (strncmp(argv[i], "--sample-rate=", 14) == 0) {
+      jscoverage_set_sample_rate(argv[i] + 14);
+    }
+
     else if (strcmp(argv[i], "--shutdown") == 0) {
       shutdown = 1;
     }
 
+    else if (strcmp(argv[i], "--threads") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--threads: option requires an argument");
+      }
+      threads = argv[i];
+    }
+    else if (strncmp(argv[i], "--threads=", 10) == 0) {
+      threads = argv[i] + 10;
+    }
+
+    else if (strcmp(argv[i], "--timeout") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--timeout: option requires an argument");
+      }
+      timeout = argv[i];
+    }
+    else if (strncmp(argv[i], "--timeout=", 10) == 0) {
+      timeout = argv[i] + 10;
+    }
+
+    else if (strcmp(argv[i], "--unix-socket") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--unix-socket: option requires an argument");
+      }
+      unix_socket = argv[i];
+    }
+    else if (strncmp(argv[i], "--unix-socket=", 14) == 0) {
+      unix_socket = argv[i] + 14;
+    }
+
+    else if (strcmp(argv[i], "--workers") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--workers: option requires an argument");
+      }
+      workers = argv[i];
+    }
+    else if (strncmp(argv[i], "--workers=", 10) == 0) {
+      workers = argv[i] + 10;
+    }
+
     else if (strncmp(argv[i], "-", 1) == 0) {
       fatal_command_line("unrecognized option `%s'", argv[i]);
     }
@@ -1260,6 +1602,69 @@ int main(int argc, char ** argv) {
     fatal_command_line("--port: option must be 16 bits");
   }
 
+  /* check the number of JavaScript workers */
+  unsigned long num_js_workers = 0;
+  if (js_workers != NULL) {
+    num_js_workers = strtoul(js_workers, &end, 10);
+    if (*js_workers == '\0' || *end != '\0') {
+      fatal_command_line("--js-workers: option must be an integer");
+    }
+#ifdef __MINGW32__
+    if (num_js_workers > 0) {
+      fatal_command_line("--js-workers: option not supported on this platform");
+    }
+#endif
+  }
+
+  /* check the listen backlog, the number of threads and the timeout */
+  if (backlog != NULL) {
+    unsigned long value = strtoul(backlog, &end, 10);
+    if (*backlog == '\0' || *end != '\0' || value == 0 || value > INT_MAX) {
+      fatal_command_line("--backlog: option must be a positive integer");
+    }
+    HTTPServer_set_backlog((int) value);
+  }
+  if (threads != NULL) {
+    unsigned long value = strtoul(threads, &end, 10);
+    if (*threads == '\0' || *end != '\0' || value == 0 || value > INT_MAX) {
+      fatal_command_line("--threads: option must be a positive integer");
+    }
+    HTTPServer_set_num_threads((int) value);
+  }
+  if (timeout != NULL) {
+    /* the timeout is given to Windows in milliseconds */
+    unsigned long value = strtoul(timeout, &end, 10);
+    if (*timeout == '\0' || *end != '\0' || value == 0 || value > UINT_MAX / 1000) {
+      fatal_command_line("--timeout: option must be a positive integer");
+    }
+    HTTPServer_set_timeout((unsigned int) value);
+    proxy_timeout = (unsigned int) value;
+  }
+
+  /* check the number of server processes */
+  unsigned long num_workers = 0;
+  if (workers != NULL) {
+    num_workers = strtoul(workers, &end, 10);
+    if (*workers == '\0' || *end != '\0' || num_workers > INT_MAX) {
+      fatal_command_line("--workers: option must be an integer");
+    }
+  }
+
+  /* check the Unix domain socket */
+  if (unix_socket != NULL) {
+    if (*unix_socket == '\0') {
+      fatal_command_line("--unix-socket: option requires an argument");
+    }
+    if (HTTPServer_set_unix_socket(unix_socket) != 0) {
+      fatal_command_line("--unix-socket: option not supported on this platform");
+    }
+    if (num_workers > 0) {
+      fatal_command_line("--unix-socket: option cannot be used with --workers");
+    }
+  }
+
+  make_no_instrument_patterns();
+
   /* check the document root exists and is a directory */
   struct stat buf;
   xstat(document_root, &buf);
@@ -1276,8 +1681,14 @@ int main(int argc, char ** argv) {
     }
 #endif
 
-    /* INADDR_LOOPBACK */
-    HTTPConnection * connection = HTTPConnection_new_client("127.0.0.1", numeric_port);
+    HTTPConnection * connection;
+    if (unix_socket != NULL) {
+      connection = HTTPConnection_new_unix_client(unix_socket);
+    }
+    else {
+      /* INADDR_LOOPBACK */
+      connection = HTTPConnection_new_client("127.0.0.1", numeric_port);
+    }
     if (connection == NULL) {
       fatal("could not connect to server");
     }
@@ -1303,6 +1714,21 @@ int main(int argc, char ** argv) {
     exit(EXIT_SUCCESS);
   }
 
+  if (verbose) {
+    if (unix_socket != NULL) {
+      printf("Starting HTTP server on %s\n", unix_socket);
+    }
+    else {
+      printf("Starting HTTP server on %s:%lu\n", ip_address, numeric_port);
+    }
+    fflush(stdout);
+  }
+
+  /* everything from here on is done in each server process: each has its own JavaScript engine */
+  if (num_workers > 0 && HTTPServer_fork((int) num_workers) != 0) {
+    fatal_command_line("--workers: option not supported on this platform");
+  }
+
   jscoverage_init();
 
 #ifndef __MINGW32__
@@ -1315,19 +1741,28 @@ InitializeCriticalSection(&javascript_mutex);
 InitializeCriticalSection(&source_cache_mutex);
 #endif
 
-  if (verbose) {
-    printf("Starting HTTP server on %s:%lu\n", ip_address, numeric_port);
-    fflush(stdout);
+  if (num_js_workers > 0) {
+#ifndef __MINGW32__
+    /* a worker forked while another thread holds the cache lock would never see it released */
+    pthread_atfork(lock_source_cache, unlock_source_cache, unlock_source_cache);
+#endif
+    javascript_workers = WorkerPool_new(num_js_workers, javascript_worker);
   }
+
   HTTPServer_run(ip_address, (uint16_t) numeric_port, handler);
   if (verbose) {
     printf("Stopping HTTP server\n");
     fflush(stdout);
   }
 
+  if (javascript_workers != NULL) {
+    WorkerPool_delete(javascript_workers);
+  }
+
   jscoverage_cleanup();
 
   free(no_instrument);
+  PathPatterns_delete(no_instrument_patterns);
 
   LOCK(&source_cache_mutex);
   while (source_cache != NULL) {
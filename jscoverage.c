@@ -19,6 +19,7 @@
 
 #include <config.h>
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,11 @@ bool jscoverage_highlight = true;
 
 int main(int argc, char ** argv) {
   int verbose = 0;
+  const char * jobs = NULL;
+  int incremental = 0;
+  int watch = 0;
+  int link = 0;
+  const char * id = NULL;
 
   program = "jscoverage";
 
@@ -60,6 +66,33 @@ int main(int argc, char ** argv) {
     else if (strcmp(argv[i], "--no-highlight") == 0) {
       jscoverage_highlight = false;
     }
+    else if (strcmp(argv[i], "--local-counters") == 0) {
+      jscoverage_local_counters = true;
+    }
+    else if (strcmp(argv[i], "--typed-arrays") == 0) {
+      jscoverage_typed_arrays = true;
+    }
+    else if (strcmp(argv[i], "--compact-prologue") == 0) {
+      jscoverage_compact_prologue = true;
+    }
+    else if (strcmp(argv[i], "--compact-output") == 0) {
+      jscoverage_compact_output = true;
+    }
+    else if (strcmp(argv[i], "--external-source") == 0) {
+      jscoverage_external_source = true;
+    }
+    else if (strcmp(argv[i], "--incremental") == 0) {
+      incremental = 1;
+    }
+    else if (strcmp(argv[i], "--link") == 0) {
+      link = 1;
+    }
+    else if (strcmp(argv[i], "--watch") == 0) {
+#ifndef HAVE_SYS_INOTIFY_H
+      fatal_command_line("--watch: option not supported on this platform");
+#endif
+      watch = 1;
+    }
     else if (strcmp(argv[i], "--mozilla") == 0) {
       jscoverage_mode = JSCOVERAGE_MOZILLA;
       jscoverage_set_js_version("180");
@@ -108,10 +141,60 @@ int main(int argc, char ** argv) {
       }
       jscoverage_set_js_version(argv[i]);
     }
+    else if (strcmp(argv[i], "--granularity") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--granularity: option requires an argument");
+      }
+      jscoverage_set_granularity(argv[i]);
+    }
+    else if (strncmp(argv[i], "--granularity=", 14) == 0) {
+      jscoverage_set_granularity(argv[i] + 14);
+    }
     else if (strncmp(argv[i], "--js-version=", 13) == 0) {
       jscoverage_set_js_version(argv[i] + 13);
     }
-    else if (strncmp(argv[i], "-", 1) == 0) {
+    else if (strcmp(argv[i], "--jobs") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--jobs: option requires an argument");
+      }
+      jobs = argv[i];
+    }
+    else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+      jobs = argv[i] + 7;
+    }
+    else if (strcmp(argv[i], "--id") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--id: option requires an argument");
+      }
+      id = argv[i];
+    }
+    else if (strncmp(argv[i], "--id=", 5) == 0) {
+      id = argv[i] + 5;
+    }
+    else if (strcmp(argv[i], "--sample-rate") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--sample-rate: option requires an argument");
+      }
+      jscoverage_set_sample_rate(argv[i]);
+    }
+    else if (strncmp(argv[i], "--sample-rate=", 14) == 0) {
+      jscoverage_set_sample_rate(argv[i] + 14);
+    }
+    else if (strcmp(argv[i], "--mode") == 0) {
+      i++;
+      if (i == argc) {
+        fatal_command_line("--mode: option requires an argument");
+      }
+      jscoverage_set_counter_mode(argv[i]);
+    }
+    else if (strncmp(argv[i], "--mode=", 7) == 0) {
+      jscoverage_set_counter_mode(argv[i] + 7);
+    }
+    else if (strncmp(argv[i], "-", 1) == 0 && strcmp(argv[i], "-") != 0) {
       fatal_command_line("unrecognized option `%s'", argv[i]);
     }
     else if (source == NULL) {
@@ -125,15 +208,79 @@ int main(int argc, char ** argv) {
     }
   }
 
+  if (jscoverage_external_source && jscoverage_mode == JSCOVERAGE_MOZILLA) {
+    fatal_command_line("--external-source cannot be used with --mozilla");
+  }
+
+  if (id != NULL) {
+    /* a single file: "-" (or no argument) is standard input or output */
+    if (*id == '\0') {
+      fatal_command_line("--id: option must not be empty");
+    }
+    if (num_exclude > 0) {
+      fatal_command_line("--exclude cannot be used with --id");
+    }
+    if (num_no_instrument > 0) {
+      fatal_command_line("--no-instrument cannot be used with --id");
+    }
+    if (incremental) {
+      fatal_command_line("--incremental cannot be used with --id");
+    }
+    if (jobs != NULL) {
+      fatal_command_line("--jobs cannot be used with --id");
+    }
+    if (link) {
+      fatal_command_line("--link cannot be used with --id");
+    }
+    if (watch) {
+      fatal_command_line("--watch cannot be used with --id");
+    }
+    if (source != NULL && strcmp(source, "-") == 0) {
+      source = NULL;
+    }
+    if (destination != NULL && strcmp(destination, "-") == 0) {
+      destination = NULL;
+    }
+    if (jscoverage_external_source && destination == NULL) {
+      fatal_command_line("--external-source cannot be used with standard output");
+    }
+
+    jscoverage_init();
+    jscoverage_instrument_file(source, destination, id);
+    jscoverage_cleanup();
+
+    free(exclude);
+    free(no_instrument);
+    exit(EXIT_SUCCESS);
+  }
+
   if (source == NULL || destination == NULL) {
     fatal_command_line("missing argument");
   }
 
+  int num_jobs = 1;
+  if (jobs != NULL) {
+    char * end;
+    unsigned long n = strtoul(jobs, &end, 10);
+    if (*jobs == '\0' || *end != '\0' || n == 0 || n > INT_MAX) {
+      fatal_command_line("--jobs: option must be a positive integer");
+    }
+#ifdef __MINGW32__
+    if (n > 1) {
+      fatal_command_line("--jobs: option not supported on this platform");
+    }
+#endif
+    num_jobs = (int) n;
+  }
+
   source = make_canonical_path(source);
   destination = make_canonical_path(destination);
 
   jscoverage_init();
-  jscoverage_instrument(source, destination, verbose, exclude, num_exclude, no_instrument, num_no_instrument);
+  jscoverage_instrument(source, destination, verbose, exclude, num_exclude, no_instrument, num_no_instrument, num_jobs, incremental, link);
+  if (watch) {
+    jscoverage_watch(source, destination, verbose, exclude, num_exclude, no_instrument, num_no_instrument, link);
+  }
   jscoverage_cleanup();
 
   free(source);
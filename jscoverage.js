@@ -67,6 +67,47 @@ var jscoverage_isReport = false;
 
 jscoverage_init(window);
 
+/**
+Returns the coverage counters for a file as an ordinary array with no element
+for lines which are not executable.  Files instrumented with --typed-arrays may
+store their counters in a typed array together with a bitmap of the executable
+lines; files instrumented with --granularity=block keep counters for basic
+blocks, which are added to the counters for their lines (or, with --mode=boolean,
+combined with them).
+@param  coverage  the entry in _$jscoverage for the file
+*/
+function jscoverage_getCounters(coverage) {
+  var executable = coverage.executable;
+  var blocks = coverage.blocks;
+  if (typeof executable !== 'string' && ! blocks) {
+    return coverage;
+  }
+  var result = [];
+  var length = coverage.length;
+  for (var line = 0; line < length; line++) {
+    if (typeof executable === 'string'? (parseInt(executable.charAt(line >> 2), 16) >> (line & 3)) & 1: coverage[line] !== undefined) {
+      result[line] = coverage[line];
+    }
+  }
+  if (blocks) {
+    for (var i = 0; i < blocks.length; i++) {
+      var lines = blocks.lines[i];
+      for (var j = 0; j < lines.length; j++) {
+        /* with --mode=boolean, a line is covered if any of its blocks is */
+        if (blocks.isBoolean) {
+          result[lines[j]] = result[lines[j]] || blocks[i];
+        }
+        else {
+          result[lines[j]] += blocks[i];
+        }
+      }
+    }
+  }
+  result.source = coverage.source;
+  result.conditionals = coverage.conditionals;
+  return result;
+}
+
 function jscoverage_createRequest() {
   // Note that the IE7 XMLHttpRequest does not support file URL's.
   // http://xhab.blogspot.com/2006/11/ie7-support-for-xmlhttprequest.html
@@ -485,7 +526,7 @@ function jscoverage_recalculateSummaryTab(cc) {
     var num_statements = 0;
     var num_executed = 0;
     var missing = [];
-    var fileCC = cc[file];
+    var fileCC = jscoverage_getCounters(cc[file]);
     var length = fileCC.length;
     var currentConditionalEnd = 0;
     var conditionals = null;
@@ -668,7 +709,7 @@ function jscoverage_checkbox_click() {
 // tab 3
 
 function jscoverage_makeTable() {
-  var coverage = _$jscoverage[jscoverage_currentFile];
+  var coverage = jscoverage_getCounters(_$jscoverage[jscoverage_currentFile]);
   var lines = coverage.source;
 
   // this can happen if there is an error in the original JavaScript file
@@ -795,6 +836,46 @@ function jscoverage_get(file, line) {
   }, 50);
 }
 
+/**
+Retrieves the source for a file instrumented with --external-source, which is
+not included in the instrumented file itself, and calls the callback when done.
+If the source cannot be retrieved, it is set to null.
+*/
+function jscoverage_loadSource(file, callback) {
+  var coverage = _$jscoverage[file];
+  var url;
+  if (jscoverage_isServer) {
+    url = 'jscoverage-source?' + encodeURIComponent(file);
+  }
+  else {
+    url = encodeURI(file) + '.jscoverage-source.json';
+  }
+  var request = jscoverage_createRequest();
+  try {
+    request.open('GET', url, true);
+    request.onreadystatechange = function (event) {
+      if (request.readyState === 4) {
+        coverage.source = null;
+        try {
+          var response = request.responseText;
+          if ((request.status === 0 || request.status === 200) && response !== '') {
+            coverage.source = eval('(' + response + ')');
+          }
+        }
+        catch (e) {
+          // the source is reported as empty
+        }
+        callback();
+      }
+    };
+    request.send(null);
+  }
+  catch (e) {
+    coverage.source = null;
+    callback();
+  }
+}
+
 /**
 Calculates coverage statistics for the current source file.
 */
@@ -807,6 +888,12 @@ function jscoverage_recalculateSourceTab() {
   progressLabel.innerHTML = 'Calculating coverage ...';
   var progressBar = document.getElementById('progressBar');
   ProgressBar.setPercentage(progressBar, 20);
+  if (_$jscoverage[jscoverage_currentFile].source === undefined) {
+    jscoverage_loadSource(jscoverage_currentFile, function () {
+      setTimeout(jscoverage_makeTable, 0);
+    });
+    return;
+  }
   setTimeout(jscoverage_makeTable, 0);
 }
 
@@ -1032,7 +1119,7 @@ function jscoverage_quote(s) {
 function jscoverage_serializeCoverageToJSON() {
   var json = [];
   for (var file in _$jscoverage) {
-    var coverage = _$jscoverage[file];
+    var coverage = jscoverage_getCounters(_$jscoverage[file]);
 
     var array = [];
     var length = coverage.length;
@@ -1044,14 +1131,28 @@ function jscoverage_serializeCoverageToJSON() {
       array.push(value);
     }
 
+    // files instrumented with --external-source have no source until it is viewed
     var source = coverage.source;
-    var lines = [];
-    length = source.length;
-    for (var line = 0; line < length; line++) {
-      lines.push(jscoverage_quote(source[line]));
+    var lines = null;
+    if (source) {
+      lines = [];
+      length = source.length;
+      for (var line = 0; line < length; line++) {
+        lines.push(jscoverage_quote(source[line]));
+      }
+    }
+
+    var samples = '';
+    if (typeof _$jscoverage[file].samples === 'number') {
+      samples = ',"samples":' + _$jscoverage[file].samples;
+    }
+
+    var sourceJSON = '';
+    if (lines) {
+      sourceJSON = ',"source":[' + lines.join(',') + ']';
     }
 
-    json.push(jscoverage_quote(file) + ':{"coverage":[' + array.join(',') + '],"source":[' + lines.join(',') + ']}');
+    json.push(jscoverage_quote(file) + ':{"coverage":[' + array.join(',') + ']' + sourceJSON + samples + '}');
   }
   return '{' + json.join(',') + '}';
 }
@@ -0,0 +1,223 @@
+/*
+    libjscoverage.c - instrumenting JavaScript in memory
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <config.h>
+
+#include "libjscoverage.h"
+
+#include <setjmp.h>
+#include <string.h>
+
+#include "encoding.h"
+#include "global.h"
+#include "instrument-js.h"
+#include "stream.h"
+#include "util.h"
+
+const char * jscoverage_encoding = "ISO-8859-1";
+bool jscoverage_highlight = true;
+
+static bool initialized = false;
+
+/*
+The instrumenting code calls fatal (or fatal_source) on bad input.  While a
+file is being instrumented, the fatal handler jumps back to
+libjscoverage_instrument, which frees what was allocated for the file.  The
+messages are collected in a fixed buffer, since running out of memory may be
+what is being reported.
+*/
+static jmp_buf fatal_jump;
+static char messages[4096];
+static size_t messages_length = 0;
+
+/* allocated for the current file; kept here so that they can be freed after a jump */
+static uint16_t * characters = NULL;
+static Stream * output = NULL;
+static Stream * source = NULL;
+
+static void add_message(const char * message) {
+  size_t length = strlen(message);
+  if (messages_length > 0 && messages_length < sizeof(messages) - 1) {
+    messages[messages_length] = '\n';
+    messages_length++;
+  }
+  if (length > sizeof(messages) - 1 - messages_length) {
+    length = sizeof(messages) - 1 - messages_length;
+  }
+  memcpy(messages + messages_length, message, length);
+  messages_length += length;
+  messages[messages_length] = '\0';
+}
+
+static void handle_warning(const char * message) {
+  add_message(message);
+}
+
+static void handle_fatal(const char * message) {
+  add_message(message);
+  longjmp(fatal_jump, 1);
+}
+
+/*
+options may be NULL for the defaults.  This is resolved here rather than in
+libjscoverage_instrument, where assigning to the parameter would leave it
+liable to be clobbered by longjmp.
+*/
+static void set_options(const JSCoverageOptions * options) {
+  static const JSCoverageOptions default_options;
+  if (options == NULL) {
+    options = &default_options;
+  }
+
+  jscoverage_encoding = options->encoding == NULL? "ISO-8859-1": options->encoding;
+  jscoverage_highlight = ! options->no_highlight;
+
+  switch (options->environment) {
+  case LIBJSCOVERAGE_BROWSER:
+    jscoverage_mode = JSCOVERAGE_NORMAL;
+    break;
+  case LIBJSCOVERAGE_NO_BROWSER:
+    jscoverage_mode = JSCOVERAGE_NO_BROWSER;
+    break;
+  case LIBJSCOVERAGE_MOZILLA:
+    jscoverage_mode = JSCOVERAGE_MOZILLA;
+    break;
+  default:
+    fatal("invalid environment: %d", options->environment);
+  }
+
+  if (options->js_version != NULL) {
+    jscoverage_set_js_version(options->js_version);
+  }
+  else {
+    jscoverage_set_js_version(jscoverage_mode == JSCOVERAGE_MOZILLA? "180": "ECMAv3");
+  }
+  jscoverage_set_counter_mode(options->counter_mode == NULL? "count": options->counter_mode);
+  jscoverage_set_granularity(options->granularity == NULL? "statement": options->granularity);
+  if (! (options->sample_rate >= 0 && options->sample_rate <= 1)) {
+    fatal("invalid sample rate: %g", options->sample_rate);
+  }
+  jscoverage_sample_rate = options->sample_rate;
+
+  jscoverage_local_counters = options->local_counters;
+  jscoverage_typed_arrays = options->typed_arrays;
+  jscoverage_compact_prologue = options->compact_prologue;
+  jscoverage_compact_output = options->compact_output;
+  jscoverage_external_source = options->external_source;
+  if (jscoverage_external_source && jscoverage_mode == JSCOVERAGE_MOZILLA) {
+    fatal("external_source cannot be used with LIBJSCOVERAGE_MOZILLA");
+  }
+}
+
+/* takes the contents of a stream, with a NUL character added */
+static char * take_string(Stream ** stream, size_t * length) {
+  Stream_write_char(*stream, '\0');
+  char * result = (char *) (*stream)->data;
+  *length = (*stream)->length - 1;
+  (*stream)->data = NULL;
+  Stream_delete(*stream);
+  *stream = NULL;
+  return result;
+}
+
+static void free_file(void) {
+  free(characters);
+  characters = NULL;
+  if (output != NULL) {
+    Stream_delete(output);
+    output = NULL;
+  }
+  if (source != NULL) {
+    Stream_delete(source);
+    source = NULL;
+  }
+  set_fatal_handler(NULL);
+  set_warning_handler(NULL);
+}
+
+int libjscoverage_instrument(const char * id, const void * data, size_t length, const JSCoverageOptions * options, JSCoverageResult * result) {
+  memset(result, 0, sizeof(JSCoverageResult));
+  messages_length = 0;
+  messages[0] = '\0';
+
+  set_fatal_handler(handle_fatal);
+  set_warning_handler(handle_warning);
+  if (setjmp(fatal_jump) != 0) {
+    if (initialized) {
+      jscoverage_abandon_file();
+    }
+    free_file();
+    libjscoverage_free_result(result);
+    result->error = strdup(messages);
+    return -1;
+  }
+
+  if (! initialized) {
+    jscoverage_init();
+    initialized = true;
+  }
+  set_options(options);
+
+  const uint8_t * bytes = data;
+  if (length >= JSCOVERAGE_INSTRUMENTED_HEADER_LENGTH &&
+      memcmp(bytes, JSCOVERAGE_INSTRUMENTED_HEADER, JSCOVERAGE_INSTRUMENTED_HEADER_LENGTH) == 0) {
+    fatal("file %s appears to be already instrumented", id);
+  }
+
+  size_t num_characters;
+  int error = jscoverage_bytes_to_characters(jscoverage_encoding, bytes, length, &characters, &num_characters);
+  if (error == JSCOVERAGE_ERROR_ENCODING_NOT_SUPPORTED) {
+    fatal("encoding %s not supported", jscoverage_encoding);
+  }
+  else if (error == JSCOVERAGE_ERROR_INVALID_BYTE_SEQUENCE) {
+    fatal("error decoding %s in file %s", jscoverage_encoding, id);
+  }
+
+  output = Stream_new(0);
+  InstrumentedFileInfo info;
+  jscoverage_instrument_js_with_info(id, characters, num_characters, output, &info);
+  result->num_lines = info.num_lines;
+  result->executable_lines = info.executable_lines;
+  result->num_executable_lines = info.num_executable_lines;
+  result->num_statements = info.num_statements;
+  if (jscoverage_external_source) {
+    source = Stream_new(0);
+    jscoverage_write_source(id, characters, num_characters, source);
+    result->source = take_string(&source, &result->source_length);
+  }
+  result->code = take_string(&output, &result->code_length);
+
+  free_file();
+  return 0;
+}
+
+void libjscoverage_free_result(JSCoverageResult * result) {
+  free(result->code);
+  free(result->source);
+  free(result->executable_lines);
+  free(result->error);
+  memset(result, 0, sizeof(JSCoverageResult));
+}
+
+void libjscoverage_cleanup(void) {
+  if (initialized) {
+    jscoverage_cleanup();
+    initialized = false;
+  }
+}
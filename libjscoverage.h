@@ -0,0 +1,128 @@
+/*
+    libjscoverage.h - instrumenting JavaScript in memory
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef LIBJSCOVERAGE_H_
+#define LIBJSCOVERAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The library instruments JavaScript held in memory, producing the same code as
+the jscoverage program does for a .js file.  It never prints anything or exits:
+bad input is reported in the result.
+
+The library is not thread-safe: all calls must be made from one thread (or
+serialized by the caller).  A program using it links with libjscoverage.a and
+with the SpiderMonkey library it was built with (js/libjs_static.a), the C++
+standard library, and -lm (and libiconv, where it is separate from libc).
+*/
+
+enum {
+  LIBJSCOVERAGE_BROWSER = 0,
+  LIBJSCOVERAGE_NO_BROWSER,
+  LIBJSCOVERAGE_MOZILLA
+};
+
+/*
+The options of the jscoverage program which affect instrumented code.  A
+structure filled with zeros (and NULLs) gives the defaults.
+*/
+typedef struct JSCoverageOptions {
+  /* the character encoding of the source (--encoding); NULL for ISO-8859-1 */
+  const char * encoding;
+
+  /* --js-version; NULL for ECMAv3 (or 1.8 with LIBJSCOVERAGE_MOZILLA) */
+  const char * js_version;
+
+  /* --mode: "count" (or NULL) or "boolean" */
+  const char * counter_mode;
+
+  /* --granularity: "statement" (or NULL), "block" or "function" */
+  const char * granularity;
+
+  /* --sample-rate; 0 to count every page */
+  double sample_rate;
+
+  /* LIBJSCOVERAGE_BROWSER, LIBJSCOVERAGE_NO_BROWSER (--no-browser) or LIBJSCOVERAGE_MOZILLA (--mozilla) */
+  int environment;
+
+  /* nonzero for --no-highlight, --local-counters and so on */
+  int no_highlight;
+  int local_counters;
+  int typed_arrays;
+  int compact_prologue;
+  int compact_output;
+
+  /* the source is returned separately instead of being included in the code */
+  int external_source;
+} JSCoverageOptions;
+
+/* Everything in a result is allocated with malloc; see libjscoverage_free_result. */
+typedef struct JSCoverageResult {
+  /* the instrumented code, followed by a NUL character (not counted in code_length) */
+  char * code;
+  size_t code_length;
+
+  /*
+  With external_source, the JSON which jscoverage writes to the file's
+  .jscoverage-source.json file, followed by a NUL character; otherwise NULL.
+  */
+  char * source;
+  size_t source_length;
+
+  /* the number of lines in the source */
+  uint32_t num_lines;
+
+  /* the lines with a counter (numbered from 1), in increasing order */
+  uint32_t * executable_lines;
+  uint32_t num_executable_lines;
+
+  /* the number of statements counted (0 with function granularity) */
+  uint32_t num_statements;
+
+  /*
+  NULL on success.  Otherwise the error (preceded by any syntax errors, one per
+  line), and every other member is 0 or NULL.
+  */
+  char * error;
+} JSCoverageResult;
+
+/*
+Instruments the source code in data (length bytes) as the file id (its path
+relative to the root of the instrumented tree).  options may be NULL for the
+defaults.  Returns 0 on success, or -1 with result->error set.  In either case
+result must be freed with libjscoverage_free_result.
+*/
+int libjscoverage_instrument(const char * id, const void * data, size_t length, const JSCoverageOptions * options, JSCoverageResult * result);
+
+void libjscoverage_free_result(JSCoverageResult * result);
+
+/* frees the JavaScript engine, which is created by the first call to libjscoverage_instrument */
+void libjscoverage_cleanup(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBJSCOVERAGE_H_ */
@@ -0,0 +1,409 @@
+/*
+    path-patterns.c - matching paths against a list of patterns
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <config.h>
+
+#include "path-patterns.h"
+
+#include <string.h>
+
+#include "util.h"
+
+/*
+Each node of the tree stands for the components matched so far.  Matching a
+path follows every edge whose component matches, so the nodes reached after
+each component of the path form a set (as in a nondeterministic automaton).
+*/
+
+/* the separators accepted in patterns given by PathPatterns_add */
+#ifdef _WIN32
+#define SEPARATORS "/\\"
+#else
+#define SEPARATORS "/"
+#endif
+
+struct Node;
+
+struct Edge {
+  char * component;
+  struct Node * node;
+};
+
+struct Node {
+  /* components without wildcards, sorted */
+  struct Edge * literals;
+  size_t num_literals;
+
+  /* components with wildcards, in the order added */
+  struct Edge * wildcards;
+  size_t num_wildcards;
+
+  /* the node reached by a ** component */
+  struct Node * any;
+
+  /* reached by a ** component: the node matches any number of further components */
+  bool repeat;
+
+  /* a pattern ends here */
+  bool terminal;
+};
+
+struct PathPatterns {
+  struct Node * root;
+  size_t num_nodes;
+};
+
+static struct Node * Node_new(PathPatterns * patterns) {
+  struct Node * node = xmalloc(sizeof(struct Node));
+  node->literals = NULL;
+  node->num_literals = 0;
+  node->wildcards = NULL;
+  node->num_wildcards = 0;
+  node->any = NULL;
+  node->repeat = false;
+  node->terminal = false;
+  patterns->num_nodes++;
+  return node;
+}
+
+static void Node_delete(struct Node * node) {
+  for (size_t i = 0; i < node->num_literals; i++) {
+    free(node->literals[i].component);
+    Node_delete(node->literals[i].node);
+  }
+  free(node->literals);
+  for (size_t i = 0; i < node->num_wildcards; i++) {
+    free(node->wildcards[i].component);
+    Node_delete(node->wildcards[i].node);
+  }
+  free(node->wildcards);
+  if (node->any != NULL) {
+    Node_delete(node->any);
+  }
+  free(node);
+}
+
+static bool has_wildcard(const char * component) {
+  return strpbrk(component, "*?[\\") != NULL;
+}
+
+/* compares a component of a path (not NUL-terminated) with a literal component */
+static int compare_component(const char * s, size_t length, const char * component) {
+  int result = strncmp(s, component, length);
+  if (result == 0 && component[length] != '\0') {
+    result = -1;
+  }
+  return result;
+}
+
+/*
+Matches one character against the first element of a pattern (a character, ?,
+a [...] class or a \-escaped character).  Returns the rest of the pattern, or
+NULL if the character does not match.
+*/
+static const char * match_character(const char * pattern, char c) {
+  switch (*pattern) {
+  case '\0':
+    return NULL;
+  case '?':
+    return pattern + 1;
+  case '\\':
+    if (pattern[1] == '\0') {
+      return c == '\\'? pattern + 1: NULL;
+    }
+    return c == pattern[1]? pattern + 2: NULL;
+  case '[':
+    {
+      const char * p = pattern + 1;
+      bool negate = false;
+      if (*p == '!' || *p == '^') {
+        negate = true;
+        p++;
+      }
+      bool found = false;
+      const char * start = p;
+      while (*p != '\0' && (*p != ']' || p == start)) {
+        if (p[1] == '-' && p[2] != '\0' && p[2] != ']') {
+          if ((unsigned char) p[0] <= (unsigned char) c && (unsigned char) c <= (unsigned char) p[2]) {
+            found = true;
+          }
+          p += 3;
+        }
+        else {
+          if (*p == c) {
+            found = true;
+          }
+          p++;
+        }
+      }
+      if (*p == '\0') {
+        /* no closing bracket: an ordinary character */
+        return c == '['? pattern + 1: NULL;
+      }
+      return found != negate? p + 1: NULL;
+    }
+  default:
+    return c == *pattern? pattern + 1: NULL;
+  }
+}
+
+static bool match_component(const char * pattern, const char * s, size_t length) {
+  /* where to resume after the last * if the rest fails to match */
+  const char * star_pattern = NULL;
+  size_t star_position = 0;
+
+  size_t i = 0;
+  while (i < length) {
+    if (*pattern == '*') {
+      pattern++;
+      star_pattern = pattern;
+      star_position = i;
+      continue;
+    }
+    const char * rest = match_character(pattern, s[i]);
+    if (rest != NULL) {
+      pattern = rest;
+      i++;
+      continue;
+    }
+    if (star_pattern == NULL) {
+      return false;
+    }
+    pattern = star_pattern;
+    star_position++;
+    i = star_position;
+  }
+  while (*pattern == '*') {
+    pattern++;
+  }
+  return *pattern == '\0';
+}
+
+static struct Node * add_component(PathPatterns * patterns, struct Node * node, const char * s, size_t length) {
+  if (length == 2 && s[0] == '*' && s[1] == '*') {
+    if (node->any == NULL) {
+      node->any = Node_new(patterns);
+      node->any->repeat = true;
+    }
+    return node->any;
+  }
+
+  char * component = xstrndup(s, length);
+  if (has_wildcard(component)) {
+    for (size_t i = 0; i < node->num_wildcards; i++) {
+      if (strcmp(node->wildcards[i].component, component) == 0) {
+        free(component);
+        return node->wildcards[i].node;
+      }
+    }
+    node->wildcards = xrealloc(node->wildcards, mulst(node->num_wildcards + 1, sizeof(struct Edge)));
+    struct Edge * edge = node->wildcards + node->num_wildcards;
+    node->num_wildcards++;
+    edge->component = component;
+    edge->node = Node_new(patterns);
+    return edge->node;
+  }
+
+  size_t low = 0;
+  size_t high = node->num_literals;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int cmp = strcmp(component, node->literals[middle].component);
+    if (cmp == 0) {
+      free(component);
+      return node->literals[middle].node;
+    }
+    else if (cmp < 0) {
+      high = middle;
+    }
+    else {
+      low = middle + 1;
+    }
+  }
+  node->literals = xrealloc(node->literals, mulst(node->num_literals + 1, sizeof(struct Edge)));
+  memmove(node->literals + low + 1, node->literals + low, (node->num_literals - low) * sizeof(struct Edge));
+  node->num_literals++;
+  node->literals[low].component = component;
+  node->literals[low].node = Node_new(patterns);
+  return node->literals[low].node;
+}
+
+static const struct Node * find_literal(const struct Node * node, const char * s, size_t length) {
+  size_t low = 0;
+  size_t high = node->num_literals;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int cmp = compare_component(s, length, node->literals[middle].component);
+    if (cmp == 0) {
+      return node->literals[middle].node;
+    }
+    else if (cmp < 0) {
+      high = middle;
+    }
+    else {
+      low = middle + 1;
+    }
+  }
+  return NULL;
+}
+
+PathPatterns * PathPatterns_new(void) {
+  PathPatterns * patterns = xmalloc(sizeof(PathPatterns));
+  patterns->num_nodes = 0;
+  patterns->root = Node_new(patterns);
+  return patterns;
+}
+
+void PathPatterns_add(PathPatterns * patterns, const char * pattern) {
+  /* the components left after removing "." and "..": start and length of each */
+  size_t length = strlen(pattern);
+  const char ** starts = xnew(const char *, length + 1);
+  size_t * lengths = xnew(size_t, length + 1);
+  size_t num_components = 0;
+
+  const char * p = pattern;
+  for (;;) {
+    size_t n = strcspn(p, SEPARATORS);
+    if (n == 0 || (n == 1 && p[0] == '.')) {
+      /* nothing */
+    }
+    else if (n == 2 && p[0] == '.' && p[1] == '.') {
+      if (num_components == 0) {
+        /* outside the directory: matches nothing in it */
+        goto done;
+      }
+      num_components--;
+    }
+    else {
+      starts[num_components] = p;
+      lengths[num_components] = n;
+      num_components++;
+    }
+    if (p[n] == '\0') {
+      break;
+    }
+    p += n + 1;
+  }
+
+  struct Node * node = patterns->root;
+  for (size_t i = 0; i < num_components; i++) {
+    node = add_component(patterns, node, starts[i], lengths[i]);
+  }
+  node->terminal = true;
+
+done:
+  free(starts);
+  free(lengths);
+}
+
+void PathPatterns_add_prefix(PathPatterns * patterns, const char * pattern) {
+  struct Node * node = patterns->root;
+  const char * p = pattern;
+  for (;;) {
+    size_t n = strcspn(p, "/");
+    if (p[n] == '\0') {
+      /* the last component matches the beginning of a component */
+      if (n == 2 && p[0] == '*' && p[1] == '*') {
+        node = add_component(patterns, node, p, n);
+      }
+      else {
+        char * component;
+        xasprintf(&component, "%s*", p);
+        node = add_component(patterns, node, component, n + 1);
+        free(component);
+      }
+      break;
+    }
+    node = add_component(patterns, node, p, n);
+    p += n + 1;
+  }
+  node->terminal = true;
+}
+
+/* adds a node to a set, with the nodes reached from it by ** matching no components */
+static void add_node(const struct Node ** set, size_t * size, const struct Node * node) {
+  while (node != NULL) {
+    for (size_t i = 0; i < *size; i++) {
+      if (set[i] == node) {
+        return;
+      }
+    }
+    set[*size] = node;
+    (*size)++;
+    node = node->any;
+  }
+}
+
+static bool contains_terminal(const struct Node ** set, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (set[i]->terminal) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PathPatterns_match(const PathPatterns * patterns, const char * path) {
+  const struct Node ** current = xnew(const struct Node *, patterns->num_nodes);
+  const struct Node ** next = xnew(const struct Node *, patterns->num_nodes);
+  size_t num_current = 0;
+  add_node(current, &num_current, patterns->root);
+
+  const char * p = path;
+  bool result = contains_terminal(current, num_current);
+  while (! result && num_current > 0) {
+    size_t n = strcspn(p, "/");
+    size_t num_next = 0;
+    for (size_t i = 0; i < num_current; i++) {
+      const struct Node * node = current[i];
+      if (node->repeat) {
+        add_node(next, &num_next, node);
+      }
+      const struct Node * literal = find_literal(node, p, n);
+      if (literal != NULL) {
+        add_node(next, &num_next, literal);
+      }
+      for (size_t j = 0; j < node->num_wildcards; j++) {
+        if (match_component(node->wildcards[j].component, p, n)) {
+          add_node(next, &num_next, node->wildcards[j].node);
+        }
+      }
+    }
+
+    const struct Node ** swap = current;
+    current = next;
+    next = swap;
+    num_current = num_next;
+    result = contains_terminal(current, num_current);
+
+    if (p[n] == '\0') {
+      break;
+    }
+    p += n + 1;
+  }
+
+  free(current);
+  free(next);
+  return result;
+}
+
+void PathPatterns_delete(PathPatterns * patterns) {
+  Node_delete(patterns->root);
+  free(patterns);
+}
@@ -0,0 +1,56 @@
+/*
+    path-patterns.h - matching paths against a list of patterns
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PATH_PATTERNS_H_
+#define PATH_PATTERNS_H_
+
+#include <stdbool.h>
+
+/*
+A set of patterns for '/'-separated paths.  Each component of a pattern may
+contain the wildcards *, ? and [...] (which never match '/'); a component **
+matches any number of components.  A path matches a pattern if the pattern
+matches the whole path or one of its ancestors: "vendor" matches
+"vendor/lib/x.js".
+
+The patterns are compiled into a tree of components, so matching a path does
+not depend on the number of literal patterns and makes no system calls.
+*/
+typedef struct PathPatterns PathPatterns;
+
+PathPatterns * PathPatterns_new(void);
+
+/*
+Adds a pattern for paths relative to a directory: "." and ".." components and
+repeated or trailing slashes are removed.
+*/
+void PathPatterns_add(PathPatterns * patterns, const char * pattern);
+
+/*
+Adds a pattern for URIs, which match if they begin with the pattern: the last
+component of the pattern is matched against the beginning of a component, so
+that "/lib/x" matches "/lib/x.js" and "/lib/x.js?v=1".
+*/
+void PathPatterns_add_prefix(PathPatterns * patterns, const char * pattern);
+
+bool PathPatterns_match(const PathPatterns * patterns, const char * path);
+
+void PathPatterns_delete(PathPatterns * patterns);
+
+#endif /* PATH_PATTERNS_H_ */
@@ -41,9 +41,42 @@ if (! window.jscoverage_report) {
       }) + '"';
     };
 
+    // counters stored in a typed array (--typed-arrays) or per basic block
+    // (--granularity=block) are converted to an ordinary array of line counters
+    var getCounters = function (coverage) {
+      var executable = coverage.executable;
+      var blocks = coverage.blocks;
+      if (typeof executable !== 'string' && ! blocks) {
+        return coverage;
+      }
+      var result = [];
+      var length = coverage.length;
+      for (var line = 0; line < length; line++) {
+        if (typeof executable === 'string'? (parseInt(executable.charAt(line >> 2), 16) >> (line & 3)) & 1: coverage[line] !== undefined) {
+          result[line] = coverage[line];
+        }
+      }
+      if (blocks) {
+        for (var i = 0; i < blocks.length; i++) {
+          var lines = blocks.lines[i];
+          for (var j = 0; j < lines.length; j++) {
+            /* with --mode=boolean, a line is covered if any of its blocks is */
+            if (blocks.isBoolean) {
+              result[lines[j]] = result[lines[j]] || blocks[i];
+            }
+            else {
+              result[lines[j]] += blocks[i];
+            }
+          }
+        }
+      }
+      result.source = coverage.source;
+      return result;
+    };
+
     var json = [];
     for (var file in _$jscoverage) {
-      var coverage = _$jscoverage[file];
+      var coverage = getCounters(_$jscoverage[file]);
 
       var array = [];
       var length = coverage.length;
@@ -55,14 +88,24 @@ if (! window.jscoverage_report) {
         array.push(value);
       }
 
+      // with --external-source the server supplies the source
       var source = coverage.source;
-      var lines = [];
-      length = source.length;
-      for (var line = 0; line < length; line++) {
-        lines.push(quote(source[line]));
+      var sourceJSON = '';
+      if (source) {
+        var lines = [];
+        length = source.length;
+        for (var line = 0; line < length; line++) {
+          lines.push(quote(source[line]));
+        }
+        sourceJSON = ',"source":[' + lines.join(',') + ']';
+      }
+
+      var samples = '';
+      if (typeof _$jscoverage[file].samples === 'number') {
+        samples = ',"samples":' + _$jscoverage[file].samples;
       }
 
-      json.push(quote(file) + ':{"coverage":[' + array.join(',') + '],"source":[' + lines.join(',') + ']}');
+      json.push(quote(file) + ':{"coverage":[' + array.join(',') + ']' + sourceJSON + samples + '}');
     }
     json = '{' + json.join(',') + '}';
 
@@ -0,0 +1,106 @@
+/*
+    http-client-keep-alive.c - HTTP client that sends several requests on one connection
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <config.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "http-server.h"
+#include "stream.h"
+#include "util.h"
+
+/*
+Sends all the requests before reading any response (pipelining), then writes
+the response bodies to standard output.
+*/
+
+struct Request {
+  const char * method;
+  const char * path;
+  const char * connection;
+  const char * expected_connection;
+  const char * expected_framing;
+};
+
+static const struct Request requests[] = {
+  {"GET", "/index.html", "TE", "keep-alive", HTTP_CONTENT_LENGTH},
+  {"HEAD", "/style.css", "TE", "keep-alive", NULL},
+  {"GET", "/big.txt", "keep-alive", "keep-alive", HTTP_TRANSFER_ENCODING},
+  {"GET", "/style.css", "close", "close", NULL},
+};
+
+int main(void) {
+#ifdef __MINGW32__
+  WSADATA data;
+  if (WSAStartup(MAKEWORD(1, 1), &data) != 0) {
+    return 1;
+  }
+#endif
+
+  int result;
+  size_t num_requests = sizeof(requests) / sizeof(requests[0]);
+  HTTPExchange * exchanges[sizeof(requests) / sizeof(requests[0])];
+
+  HTTPConnection * connection = HTTPConnection_new_client("127.0.0.1", 8000);
+  assert(connection != NULL);
+
+  for (size_t i = 0; i < num_requests; i++) {
+    exchanges[i] = HTTPExchange_new(connection);
+    HTTPExchange_set_method(exchanges[i], requests[i].method);
+    HTTPExchange_set_request_uri(exchanges[i], requests[i].path);
+    /* with neither "close" nor "keep-alive", the HTTP/1.1 default (persistent) applies */
+    HTTPExchange_set_request_header(exchanges[i], HTTP_CONNECTION, requests[i].connection);
+    result = HTTPExchange_write_request_headers(exchanges[i]);
+    assert(result == 0);
+  }
+
+  for (size_t i = 0; i < num_requests; i++) {
+    result = HTTPExchange_read_response_headers(exchanges[i]);
+    assert(result == 0);
+    assert(HTTPExchange_get_status_code(exchanges[i]) == 200);
+
+    const char * connection_header = HTTPExchange_find_response_header(exchanges[i], HTTP_CONNECTION);
+    assert(connection_header != NULL);
+    assert(strcmp(connection_header, requests[i].expected_connection) == 0);
+    if (requests[i].expected_framing != NULL) {
+      assert(HTTPExchange_find_response_header(exchanges[i], requests[i].expected_framing) != NULL);
+    }
+
+    if (HTTPExchange_response_has_body(exchanges[i])) {
+      Stream * stream = Stream_new(0);
+      result = HTTPExchange_read_entire_response_entity_body(exchanges[i], stream);
+      assert(result == 0);
+      fwrite(stream->data, 1, stream->length, stdout);
+      Stream_delete(stream);
+    }
+    HTTPExchange_delete(exchanges[i]);
+  }
+
+  /* the server closes the connection after "Connection: close" */
+  int octet;
+  result = HTTPConnection_read_octet(connection, &octet);
+  assert(result == 0);
+  assert(octet == -1);
+
+  result = HTTPConnection_delete(connection);
+  assert(result == 0);
+  return 0;
+}
@@ -0,0 +1,77 @@
+/*
+    http-client-unix-socket.c - HTTP client connecting to a Unix domain socket
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <config.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http-server.h"
+#include "stream.h"
+#include "util.h"
+
+/*
+With arguments SOCKET METHOD URI [BODY], sends one request to the server
+listening on SOCKET and writes the response body to standard output.  Exits
+with status 1 unless the response is 200 OK.
+*/
+int main(int argc, char ** argv) {
+  assert(argc == 4 || argc == 5);
+
+  int result;
+
+  HTTPConnection * connection = HTTPConnection_new_unix_client(argv[1]);
+  assert(connection != NULL);
+
+  HTTPExchange * exchange = HTTPExchange_new(connection);
+  HTTPExchange_set_method(exchange, argv[2]);
+  HTTPExchange_set_request_uri(exchange, argv[3]);
+  if (argc == 5) {
+    size_t length = strlen(argv[4]);
+    HTTPExchange_set_request_content_length(exchange, length);
+    result = HTTPExchange_write_request_headers(exchange);
+    assert(result == 0);
+    result = HTTPMessage_write(HTTPExchange_get_request_message(exchange), argv[4], length);
+    assert(result == 0);
+  }
+  else {
+    result = HTTPExchange_write_request_headers(exchange);
+    assert(result == 0);
+  }
+  result = HTTPExchange_flush_request(exchange);
+  assert(result == 0);
+
+  result = HTTPExchange_read_response_headers(exchange);
+  assert(result == 0);
+  uint16_t status_code = HTTPExchange_get_status_code(exchange);
+
+  Stream * stream = Stream_new(0);
+  result = HTTPExchange_read_entire_response_entity_body(exchange, stream);
+  assert(result == 0);
+  fwrite(stream->data, 1, stream->length, stdout);
+  Stream_delete(stream);
+
+  HTTPExchange_delete(exchange);
+  result = HTTPConnection_delete(connection);
+  assert(result == 0);
+
+  return status_code == 200? 0: 1;
+}
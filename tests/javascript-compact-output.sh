@@ -0,0 +1,74 @@
+#!/bin/sh
+#    javascript-compact-output.sh - test --compact-output option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 DIR3 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2 DIR3
+mkdir -p DIR
+cat > DIR/compact.js <<'END'
+function f(n) {
+  var x = 0.5;
+
+  for (var i = 0; i < n; i++) {
+    x += (i + 1) * 10 - -i / 100;
+  }
+  return x > 1e21? 1e-7: x + 0.001;
+}
+f(3);
+
+END
+$VALGRIND jscoverage --no-browser --compact-output DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+
+# no indentation, minimal parentheses and shortest numbers (integers in full,
+# others in exponent form only where that is shorter)
+cat > OUT <<'END'
+_$jscoverage['compact.js'][1]++;function f(n){_$jscoverage['compact.js'][2]++;var x=.5;_$jscoverage['compact.js'][4]++;for(var i=0;i<n;i++){_$jscoverage['compact.js'][5]++;x+=(i+1)*10- -i/100;}_$jscoverage['compact.js'][7]++;return x>1e21?1e-7:x+.001;}_$jscoverage['compact.js'][9]++;f(3);
+END
+tail -n 1 DIR2/compact.js | diff OUT -
+
+# the counters are the same as without --compact-output
+$VALGRIND jscoverage --no-browser DIR DIR3
+echo 'print(_$jscoverage["compact.js"].join(","));' > OUT
+js -f DIR3/compact.js -f OUT > ERR
+echo ',1,1,,1,3,,1,,1' | diff - ERR
+js -f DIR2/compact.js -f OUT > ERR
+echo ',1,1,,1,3,,1,,1' | diff - ERR
+
+# every test file compiles to the same code
+rm -fr DIR2 DIR3
+$VALGRIND jscoverage --js-version=180 --exclude=javascript-iso-8859-1.js --no-browser javascript DIR2
+$VALGRIND jscoverage --js-version=180 --exclude=javascript-iso-8859-1.js --no-browser --compact-output javascript DIR3
+cat > OUT <<'END'
+version(180);
+if (Function(snarf(arguments[0])).toString() !== Function(snarf(arguments[1])).toString()) {
+  throw 'different code: ' + arguments[1];
+}
+END
+for i in DIR2/*.js
+do
+  js OUT $i DIR3/${i##DIR2/}
+done
+
+rm -fr DIR DIR2 DIR3 OUT ERR
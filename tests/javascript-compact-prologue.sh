@@ -0,0 +1,56 @@
+#!/bin/sh
+#    javascript-compact-prologue.sh - test --compact-prologue option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 DIR3 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2 DIR3
+mkdir -p DIR
+cat > DIR/counters.js <<'END'
+function f(n) {
+  var x = 0;
+
+  for (var i = 0; i < n; i++) {
+    x += i;
+  }
+  return x;
+}
+f(3);
+
+END
+$VALGRIND jscoverage --no-browser --compact-prologue DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+
+# executable lines are 1, 2, 4, 5, 7 and 9
+! grep -q -F "_\$jscoverage['counters.js'][1] = 0;" DIR2/counters.js
+grep -q -F "_\$jscoverage['counters.js'] = _\$jscoverage_decode(\"1,2,1,2,1,1,1,1\");" DIR2/counters.js
+
+# the counters are the same as without --compact-prologue
+$VALGRIND jscoverage --no-browser DIR DIR3
+echo 'print(_$jscoverage["counters.js"].join(","));' > OUT
+js -f DIR3/counters.js -f OUT > ERR
+echo ',1,1,,1,3,,1,,1' | diff - ERR
+js -f DIR2/counters.js -f OUT > ERR
+echo ',1,1,,1,3,,1,,1' | diff - ERR
+
+rm -fr DIR DIR2 DIR3 OUT ERR
@@ -0,0 +1,69 @@
+#!/bin/sh
+#    javascript-external-source.sh - test --external-source option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 DIR3 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2 DIR3
+mkdir -p DIR/sub
+cat > DIR/sub/counters.js <<'END'
+function f(n) {
+  var x = 0;
+
+  for (var i = 0; i < n; i++) {
+    x += i;
+  }
+  return x;
+}
+f(3);
+
+END
+$VALGRIND jscoverage --no-browser --external-source DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+
+# the source is not in the instrumented file
+! grep -q -F "_\$jscoverage['sub/counters.js'].source" DIR2/sub/counters.js
+
+# the source file contains what would have been in the instrumented file
+$VALGRIND jscoverage --no-browser DIR DIR3
+test ! -f DIR3/sub/counters.js.jscoverage-source.json
+grep -F "_\$jscoverage['sub/counters.js'].source = " DIR3/sub/counters.js | sed -e 's/^[^=]*= //' -e 's/;$//' > OUT
+cat DIR2/sub/counters.js.jscoverage-source.json > ERR
+echo >> ERR
+diff OUT ERR
+
+# the counters are the same
+echo 'print(_$jscoverage["sub/counters.js"].join(","));' > OUT
+js -f DIR2/sub/counters.js -f OUT > ERR
+echo ',1,1,,1,3,,1,,1' | diff - ERR
+
+# not allowed with --mozilla
+rm -fr DIR2
+if jscoverage --external-source --mozilla DIR DIR2 > OUT 2> ERR
+then
+  exit 1
+fi
+test ! -s OUT
+grep -q -F 'jscoverage: --external-source cannot be used with --mozilla' ERR
+
+rm -fr DIR DIR2 DIR3 OUT ERR
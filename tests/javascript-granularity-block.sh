@@ -0,0 +1,107 @@
+#!/bin/sh
+#    javascript-granularity-block.sh - test --granularity=block option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 DIR3 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2 DIR3
+mkdir -p DIR
+cat > DIR/block.js <<'END'
+function f(n) {
+  var x = 0; var y = 1;
+  for (var i = 0; i < n; i++) {
+    x += i;
+    if (x > 2) {
+      y++;
+    }
+    else {
+      y--;
+    }
+    x--;
+  }
+  return x;
+}
+f(3);
+f(2);
+try {
+  f(4);
+  throw 1;
+  f(5);
+}
+catch (e) {
+  f(1);
+}
+END
+$VALGRIND jscoverage --no-browser --granularity=block DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+$VALGRIND jscoverage --no-browser DIR DIR3
+
+# one counter per basic block
+test $(grep -c -F "_\$jscoverage['block.js'].blocks[" DIR2/block.js) -eq 10
+grep -q -F "_\$jscoverage['block.js'].blocks = _\$jscoverage_blocks(\"1,f,g,h;2,2,3;4,5;6;9;b;d;i,j;k;n\");" DIR2/block.js
+
+# the line counts rebuilt from the block counts are the same as without --granularity=block
+cat > OUT <<'END'
+var coverage = _$jscoverage['block.js'];
+var lines = [];
+for (var line = 0; line < coverage.length; line++) {
+  lines[line] = coverage[line];
+}
+if (coverage.blocks) {
+  for (var i = 0; i < coverage.blocks.length; i++) {
+    for (var j = 0; j < coverage.blocks.lines[i].length; j++) {
+      lines[coverage.blocks.lines[i][j]] += coverage.blocks[i];
+    }
+  }
+}
+print(lines.join(','));
+END
+js -f DIR3/block.js -f OUT > ERR
+echo ',1,8,4,10,10,1,,,9,,10,,4,,1,1,1,1,1,0,,,1' | diff - ERR
+js -f DIR2/block.js -f OUT > ERR
+echo ',1,8,4,10,10,1,,,9,,10,,4,,1,1,1,1,1,0,,,1' | diff - ERR
+
+# with --local-counters, the variable refers to the block counters
+rm -fr DIR2
+$VALGRIND jscoverage --no-browser --granularity=block --local-counters DIR DIR2
+grep -q "^var _\$jscoverage_[0-9a-f]* = _\$jscoverage\['block.js'\].blocks;$" DIR2/block.js
+js -f DIR2/block.js -f OUT > ERR
+echo ',1,8,4,10,10,1,,,9,,10,,4,,1,1,1,1,1,0,,,1' | diff - ERR
+
+# with --mode=boolean, the blocks on a line are combined with "or" rather than added
+cat > DIR/boolean.js <<'END'
+function g(a) {
+  if (a) { a--; } else { a++; }
+}
+g(true);
+g(false);
+END
+rm -fr DIR2
+$VALGRIND jscoverage --no-browser --granularity=block --mode=boolean DIR DIR2
+grep -q -F "_\$jscoverage['boolean.js'].blocks = _\$jscoverage_blocks(\"" DIR2/boolean.js
+sed -n '/^function jscoverage_getCounters/,/^}/p' ../jscoverage.js | tr -d '\r' > OUT
+echo "print(jscoverage_getCounters(_\$jscoverage['boolean.js']).join(','));" >> OUT
+js -f DIR2/boolean.js -f OUT > ERR
+echo ',1,1,,1,1' | diff - ERR
+
+rm -fr DIR DIR2 DIR3 OUT ERR
@@ -0,0 +1,59 @@
+#!/bin/sh
+#    javascript-granularity-function.sh - test --granularity=function option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2
+mkdir -p DIR
+cat > DIR/function.js <<'END'
+function f(n) {
+  var x = 0;
+  for (var i = 0; i < n; i++) {
+    x += i;
+  }
+  return x;
+}
+var o = {
+  get p() {
+    return f(1);
+  }
+};
+function g() {
+  return 0;
+}
+f(3); f(2);
+o.p;
+END
+$VALGRIND jscoverage --no-browser --granularity=function DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+
+# only function entries are counted
+test $(grep -c -F "++;" DIR2/function.js) -eq 3
+grep -q -F "  _\$jscoverage['function.js'][9]++;" DIR2/function.js
+
+echo 'print(_$jscoverage["function.js"].join(","));' > OUT
+js -f DIR2/function.js -f OUT > ERR
+echo ',3,,,,,,,,1,,,,0' | diff - ERR
+
+rm -fr DIR DIR2 OUT ERR
@@ -33,4 +33,10 @@ test ! -s ERR
 grep -q -F "_\$jscoverage['big.js'][65536] = 0;" DIR2/big.js
 grep -q -F "_\$jscoverage['big.js'][65536]++;" DIR2/big.js
 
+rm -fr DIR2
+$VALGRIND jscoverage --compact-prologue DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+grep -q -F "_\$jscoverage['big.js'] = _\$jscoverage_decode(\"1,1ekg\");" DIR2/big.js
+
 # rm -fr DIR DIR2 OUT ERR
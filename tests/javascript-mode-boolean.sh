@@ -0,0 +1,59 @@
+#!/bin/sh
+#    javascript-mode-boolean.sh - test --mode=boolean option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2
+mkdir -p DIR
+cat > DIR/counters.js <<'END'
+function f(n) {
+  var x = 0;
+  for (var i = 0; i < n; i++) {
+    x += i;
+  }
+  return x;
+}
+f(3);
+END
+$VALGRIND jscoverage --no-browser --mode=boolean DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+
+# lines are marked instead of counted
+! grep -q -F "++;" DIR2/counters.js
+grep -q -F "_\$jscoverage['counters.js'][4] = 1;" DIR2/counters.js
+
+echo 'print(_$jscoverage["counters.js"].join(","));' > OUT
+js -f DIR2/counters.js -f OUT > ERR
+echo ',1,1,1,1,,1,,1' | diff - ERR
+
+# invalid mode
+rm -fr DIR2
+if jscoverage --mode=foo DIR DIR2 > OUT 2> ERR
+then
+  exit 1
+fi
+test ! -s OUT
+echo 'jscoverage: invalid mode: foo' | diff - ERR
+
+rm -fr DIR DIR2 OUT ERR
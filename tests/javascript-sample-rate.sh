@@ -0,0 +1,85 @@
+#!/bin/sh
+#    javascript-sample-rate.sh - test --sample-rate option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2
+mkdir -p DIR
+cat > DIR/sample.js <<'END'
+function f(n) {
+  var x = 0;
+  function g() {
+    return 1;
+  }
+  for (var i = 0; i < n; i++) {
+    x += g();
+  }
+  return x;
+}
+f(3);
+END
+$VALGRIND jscoverage --no-browser --sample-rate=1 DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+
+# one branch for each function and for the top level
+test $(grep -c -F "if (_\$jscoverage_sampled) {" DIR2/sample.js) -eq 3
+grep -q -F "  var _\$jscoverage_sampled = Math.random() < 1;" DIR2/sample.js
+
+# a sampled page
+echo 'print(_$jscoverage["sample.js"].join(","), _$jscoverage["sample.js"].samples);' > OUT
+js -f DIR2/sample.js -f OUT > ERR
+echo ',1,1,1,3,,1,3,,1,,1 1' | diff - ERR
+
+# a page which is not sampled
+echo 'var _$jscoverage_sampled = false;' > DIR/unsampled.js
+js -f DIR/unsampled.js -f DIR2/sample.js -f OUT > ERR
+echo ',0,0,0,0,,0,0,,0,,0 0' | diff - ERR
+
+# const definitions, at the top level and in a function
+rm -fr DIR2
+cat > DIR/sample.js <<'END'
+const X = 1;
+function f() {
+  const Y = 2;
+  return X + Y;
+}
+print(f());
+END
+$VALGRIND jscoverage --no-browser --sample-rate=1 DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+test $(grep -c -F "if (_\$jscoverage_sampled) {" DIR2/sample.js) -eq 0
+js -f DIR2/sample.js > OUT 2> ERR
+test ! -s ERR
+echo 3 | diff - OUT
+
+# invalid rate
+rm -fr DIR2
+if jscoverage --sample-rate=2 DIR DIR2 > OUT 2> ERR
+then
+  exit 1
+fi
+echo 'jscoverage: invalid sample rate: 2' | diff - ERR
+
+rm -fr DIR DIR2 OUT ERR
@@ -0,0 +1,64 @@
+#!/bin/sh
+#    javascript-typed-arrays.sh - test --typed-arrays option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR DIR2 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2
+mkdir -p DIR
+cat > DIR/counters.js <<'END'
+function f(n) {
+  var x = 0;
+  for (var i = 0; i < n; i++) {
+    x += i;
+  }
+  return x;
+}
+f(3);
+END
+$VALGRIND jscoverage --no-browser --typed-arrays DIR DIR2 > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+
+# executable lines are 1, 2, 3, 4, 6 and 8
+grep -q -F "_\$jscoverage['counters.js'] = _\$jscoverage_counters(9, \"e51\");" DIR2/counters.js
+
+# without typed arrays, the counters are the same as without --typed-arrays
+echo 'print(_$jscoverage["counters.js"].join(","));' > OUT
+js -f DIR2/counters.js -f OUT > ERR
+echo ',1,1,1,3,,1,,1' | diff - ERR
+
+# with typed arrays, the counters are dense
+cat > OUT <<'END'
+function Uint32Array(length) {
+  var array = [];
+  for (var i = 0; i < length; i++) {
+    array[i] = 0;
+  }
+  return array;
+}
+END
+echo 'print(_$jscoverage["counters.js"].join(","), _$jscoverage["counters.js"].executable);' > DIR/print.js
+js -f OUT -f DIR2/counters.js -f DIR/print.js > ERR
+echo '0,1,1,1,3,0,1,0,1 e51' | diff - ERR
+
+rm -fr DIR DIR2 OUT ERR
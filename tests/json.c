@@ -27,6 +27,31 @@
 
 bool jscoverage_highlight = true;
 
+static void check_merged_coverage(const FileCoverage * file_coverage, int i, void * p) {
+  const int * expected = (const int *) p;
+  assert(strcmp(file_coverage->id, "a.js") == 0);
+  assert(file_coverage->num_coverage_lines == 4);
+  for (uint32_t line = 0; line < file_coverage->num_coverage_lines; line++) {
+    assert(file_coverage->coverage_lines[line] == expected[line]);
+  }
+}
+
+static void check_samples(const FileCoverage * file_coverage, int i, void * p) {
+  assert(file_coverage->samples == 5);
+}
+
+static void merge(const int * expected) {
+  const char * json1 = "{\"a.js\":{\"coverage\":[null,2,0,0],\"source\":[\"a\",\"b\",\"c\"]}}";
+  const char * json2 = "{\"a.js\":{\"coverage\":[null,3,0,1],\"source\":[\"a\",\"b\",\"c\"]}}";
+  Coverage * coverage = Coverage_new();
+  int result = jscoverage_parse_json(coverage, (const uint8_t *) json1, strlen(json1));
+  assert(result == 0);
+  result = jscoverage_parse_json(coverage, (const uint8_t *) json2, strlen(json2));
+  assert(result == 0);
+  Coverage_foreach_file(coverage, check_merged_coverage, (void *) expected);
+  Coverage_delete(coverage);
+}
+
 int main(void) {
   jscoverage_init();
 
@@ -42,6 +67,26 @@ int main(void) {
 
   Coverage_delete(coverage);
   Stream_delete(stream);
+
+  /* counts are added */
+  const int counts[] = {-1, 5, 0, 1};
+  merge(counts);
+
+  /* with --mode=boolean, hits are ORed */
+  jscoverage_counter_mode = JSCOVERAGE_BOOLEAN;
+  const int hits[] = {-1, 1, 0, 1};
+  merge(hits);
+
+  /* sample counts are added */
+  const char * json1 = "{\"a.js\":{\"coverage\":[null,1],\"source\":[\"a\"],\"samples\":2}}";
+  const char * json2 = "{\"a.js\":{\"coverage\":[null,0],\"source\":[\"a\"],\"samples\":3}}";
+  coverage = Coverage_new();
+  result = jscoverage_parse_json(coverage, (const uint8_t *) json1, strlen(json1));
+  assert(result == 0);
+  result = jscoverage_parse_json(coverage, (const uint8_t *) json2, strlen(json2));
+  assert(result == 0);
+  Coverage_foreach_file(coverage, check_samples, NULL);
+  Coverage_delete(coverage);
   jscoverage_cleanup();
 
   exit(EXIT_SUCCESS);
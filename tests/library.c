@@ -0,0 +1,156 @@
+/*
+    library.c - test libjscoverage
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libjscoverage.h"
+
+static const char * counters_js =
+  "function f(n) {\n"
+  "  var x = 0;\n"
+  "\n"
+  "  for (var i = 0; i < n; i++) {\n"
+  "    x += i;\n"
+  "  }\n"
+  "  return x;\n"
+  "}\n"
+  "f(3);\n";
+
+static void check_counters(const JSCoverageOptions * options) {
+  static const uint32_t expected_lines[] = {1, 2, 4, 5, 7, 9};
+  JSCoverageResult result;
+  int status = libjscoverage_instrument("sub/counters.js", counters_js, strlen(counters_js), options, &result);
+  assert(status == 0);
+  assert(result.error == NULL);
+  assert(result.code != NULL);
+  assert(strlen(result.code) == result.code_length);
+  assert(strncmp(result.code, "/* automatically generated by JSCoverage", 40) == 0);
+  assert(strstr(result.code, "_$jscoverage['sub/counters.js']") != NULL);
+  assert(result.num_lines == 9);
+  assert(result.num_executable_lines == 6);
+  assert(memcmp(result.executable_lines, expected_lines, sizeof(expected_lines)) == 0);
+  assert(result.num_statements == 6);
+  libjscoverage_free_result(&result);
+}
+
+static void check_error(const char * source, const JSCoverageOptions * options, const char * expected) {
+  JSCoverageResult result;
+  int status = libjscoverage_instrument("error.js", source, strlen(source), options, &result);
+  assert(status == -1);
+  assert(result.error != NULL);
+  assert(strstr(result.error, expected) != NULL);
+  assert(result.code == NULL);
+  assert(result.executable_lines == NULL);
+  libjscoverage_free_result(&result);
+}
+
+/* with arguments FILE ID, writes the instrumented file to standard output, as jscoverage --no-browser --js-version=180 --id=ID FILE */
+static void instrument_file(const char * file, const char * id) {
+  FILE * f = fopen(file, "rb");
+  assert(f != NULL);
+  char * data = NULL;
+  size_t length = 0;
+  size_t n;
+  char buffer[8192];
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    data = realloc(data, length + n);
+    assert(data != NULL);
+    memcpy(data + length, buffer, n);
+    length += n;
+  }
+  fclose(f);
+
+  JSCoverageOptions options;
+  memset(&options, 0, sizeof(options));
+  options.environment = LIBJSCOVERAGE_NO_BROWSER;
+  options.js_version = "180";
+  JSCoverageResult result;
+  int status = libjscoverage_instrument(id, data, length, &options, &result);
+  if (status != 0) {
+    fprintf(stderr, "%s\n", result.error);
+    exit(EXIT_FAILURE);
+  }
+  fwrite(result.code, 1, result.code_length, stdout);
+  libjscoverage_free_result(&result);
+  free(data);
+  libjscoverage_cleanup();
+}
+
+int main(int argc, char ** argv) {
+  if (argc == 3) {
+    instrument_file(argv[1], argv[2]);
+    exit(EXIT_SUCCESS);
+  }
+
+  JSCoverageOptions options;
+  memset(&options, 0, sizeof(options));
+
+  /* the defaults */
+  check_counters(NULL);
+
+  /* errors are returned, and do not stop the next file being instrumented */
+  check_error("var x = ;\n", NULL, "parse error in file error.js");
+  check_error("x = 1;\nvar y = ;\n", NULL, "error.js:2: SyntaxError");
+  check_counters(NULL);
+  check_error("/* automatically generated by JSCoverage - do not edit */\nx;\n", NULL, "appears to be already instrumented");
+
+  options.granularity = "line";
+  check_error("x;\n", &options, "invalid granularity: line");
+  options.granularity = NULL;
+
+  options.encoding = "UTF-8";
+  check_error("x = '\xff';\n", &options, "error decoding UTF-8 in file error.js");
+  options.encoding = "NO-SUCH-ENCODING";
+  check_error("x;\n", &options, "encoding NO-SUCH-ENCODING not supported");
+  options.encoding = NULL;
+
+  /* a parse error with block counters */
+  options.granularity = "block";
+  check_error("function f() {\n  a();\n  b();\n}\nfunction g() {\n", &options, "parse error");
+  options.granularity = NULL;
+  check_counters(&options);
+
+  /* the source is returned separately */
+  options.external_source = 1;
+  options.environment = LIBJSCOVERAGE_NO_BROWSER;
+  JSCoverageResult result;
+  assert(libjscoverage_instrument("a.js", "x;\n", 3, &options, &result) == 0);
+  assert(strstr(result.code, ".source") == NULL);
+  assert(result.source != NULL);
+  assert(strlen(result.source) == result.source_length);
+  assert(result.source[0] == '[');
+  libjscoverage_free_result(&result);
+
+  options.environment = LIBJSCOVERAGE_MOZILLA;
+  check_error("x;\n", &options, "external_source cannot be used with LIBJSCOVERAGE_MOZILLA");
+  options.external_source = 0;
+  options.environment = LIBJSCOVERAGE_NO_BROWSER;
+  check_counters(&options);
+
+  libjscoverage_cleanup();
+
+  /* the engine is created again */
+  check_counters(NULL);
+  libjscoverage_cleanup();
+
+  exit(EXIT_SUCCESS);
+}
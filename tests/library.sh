@@ -0,0 +1,36 @@
+#!/bin/sh
+#    library.sh - test libjscoverage
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+set -e
+
+trap 'rm -f OUT' 1 2 3 15
+
+. ./common.sh
+
+$VALGRIND ./library
+
+# the library writes the same code as the program
+for file in javascript/*.js
+do
+  id=${file##javascript/}
+  ./library $file $id > OUT
+  jscoverage --no-browser --js-version=180 --id=$id $file | diff - OUT
+done
+
+rm -f OUT
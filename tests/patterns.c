@@ -0,0 +1,116 @@
+/*
+    patterns.c - test `PathPatterns' object
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "path-patterns.h"
+
+int main(void) {
+  PathPatterns * patterns;
+
+  /* no patterns */
+  patterns = PathPatterns_new();
+  assert(! PathPatterns_match(patterns, "a.js"));
+  PathPatterns_delete(patterns);
+
+  /* literal paths match themselves and anything in them */
+  patterns = PathPatterns_new();
+  PathPatterns_add(patterns, "1/2");
+  PathPatterns_add(patterns, "./script.js");
+  PathPatterns_add(patterns, "lib//x/");
+  PathPatterns_add(patterns, "a/../b");
+  PathPatterns_add(patterns, "../outside");
+  assert(PathPatterns_match(patterns, "1/2"));
+  assert(PathPatterns_match(patterns, "1/2/2.js"));
+  assert(! PathPatterns_match(patterns, "1/22.js"));
+  assert(! PathPatterns_match(patterns, "1/1.js"));
+  assert(! PathPatterns_match(patterns, "1"));
+  assert(PathPatterns_match(patterns, "script.js"));
+  assert(! PathPatterns_match(patterns, "script.json"));
+  assert(PathPatterns_match(patterns, "lib/x/y.js"));
+  assert(! PathPatterns_match(patterns, "lib/xy.js"));
+  assert(PathPatterns_match(patterns, "b/c.js"));
+  assert(! PathPatterns_match(patterns, "a/b"));
+  assert(! PathPatterns_match(patterns, "outside"));
+  assert(! PathPatterns_match(patterns, "../outside"));
+  PathPatterns_delete(patterns);
+
+  /* "." is everything */
+  patterns = PathPatterns_new();
+  PathPatterns_add(patterns, ".");
+  assert(PathPatterns_match(patterns, "a.js"));
+  assert(PathPatterns_match(patterns, "a/b.js"));
+  PathPatterns_delete(patterns);
+
+  /* wildcards */
+  patterns = PathPatterns_new();
+  PathPatterns_add(patterns, "**/*.min.js");
+  PathPatterns_add(patterns, "vendor/**");
+  PathPatterns_add(patterns, "test?/[a-c]*.js");
+  PathPatterns_add(patterns, "x/[!0-9].js");
+  PathPatterns_add(patterns, "y/\\*.js");
+  assert(PathPatterns_match(patterns, "a.min.js"));
+  assert(PathPatterns_match(patterns, "lib/jquery/jquery.min.js"));
+  assert(! PathPatterns_match(patterns, "lib/min.js"));
+  assert(! PathPatterns_match(patterns, "a.min.json"));
+  assert(PathPatterns_match(patterns, "vendor/a.js"));
+  assert(PathPatterns_match(patterns, "vendor/a/b/c.js"));
+  assert(! PathPatterns_match(patterns, "lib/vendor/a.js"));
+  assert(PathPatterns_match(patterns, "test1/alpha.js"));
+  assert(PathPatterns_match(patterns, "test2/c.js"));
+  assert(! PathPatterns_match(patterns, "test/alpha.js"));
+  assert(! PathPatterns_match(patterns, "test1/delta.js"));
+  assert(! PathPatterns_match(patterns, "test1/sub/alpha.js"));
+  assert(PathPatterns_match(patterns, "x/a.js"));
+  assert(! PathPatterns_match(patterns, "x/1.js"));
+  assert(PathPatterns_match(patterns, "y/*.js"));
+  assert(! PathPatterns_match(patterns, "y/a.js"));
+  PathPatterns_delete(patterns);
+
+  patterns = PathPatterns_new();
+  PathPatterns_add(patterns, "a/**/b/*.js");
+  PathPatterns_add(patterns, "*a*a*a*b");
+  assert(PathPatterns_match(patterns, "a/b/c.js"));
+  assert(PathPatterns_match(patterns, "a/x/y/b/c.js"));
+  assert(PathPatterns_match(patterns, "a/b/b/c.js"));
+  assert(! PathPatterns_match(patterns, "a/x/c.js"));
+  assert(PathPatterns_match(patterns, "aaaaab"));
+  assert(! PathPatterns_match(patterns, "aaaaaa"));
+  PathPatterns_delete(patterns);
+
+  /* prefixes, as used for URIs */
+  patterns = PathPatterns_new();
+  PathPatterns_add_prefix(patterns, "/lib/x");
+  PathPatterns_add_prefix(patterns, "/vendor/");
+  PathPatterns_add_prefix(patterns, "http://example.com/**/*.min.js");
+  assert(PathPatterns_match(patterns, "/lib/x"));
+  assert(PathPatterns_match(patterns, "/lib/x.js"));
+  assert(PathPatterns_match(patterns, "/lib/xyz/a.js"));
+  assert(! PathPatterns_match(patterns, "/lib/a.js"));
+  assert(! PathPatterns_match(patterns, "lib/x.js"));
+  assert(PathPatterns_match(patterns, "/vendor/a.js"));
+  assert(! PathPatterns_match(patterns, "/vendor"));
+  assert(! PathPatterns_match(patterns, "/vendors/a.js"));
+  assert(PathPatterns_match(patterns, "http://example.com/a/b.min.js?v=1"));
+  assert(! PathPatterns_match(patterns, "http://example.org/a/b.min.js"));
+  PathPatterns_delete(patterns);
+
+  exit(EXIT_SUCCESS);
+}
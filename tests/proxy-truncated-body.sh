@@ -0,0 +1,68 @@
+#!/bin/sh
+#    proxy-truncated-body.sh - test jscoverage-server --proxy with truncated response bodies
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+shutdown() {
+  wget -q -O- --post-data= "http://127.0.0.1:${proxy_server_port}/jscoverage-shutdown" > /dev/null
+  wait $proxy_server_pid
+  kill -9 $origin_server_pid
+}
+
+cleanup() {
+  shutdown
+  rm -f OUT ERR
+}
+
+trap 'cleanup' 0 1 2 3 15
+
+. ./common.sh
+
+./http-server-truncated-body &
+origin_server_pid=$!
+
+$VALGRIND jscoverage-server --proxy > OUT 2> ERR &
+proxy_server_pid=$!
+proxy_server_port=8080
+
+wait_for_server http://127.0.0.1:8000/ping
+wait_for_server http://127.0.0.1:8080/jscoverage.html
+
+# sends a request for the given path and then one for /ping on the same connection, and prints the responses
+request() {
+  perl -MIO::Socket::INET -e '
+    $SIG{ALRM} = sub { exit 1; };
+    alarm 10;
+    $s = IO::Socket::INET->new("127.0.0.1:8080") or die;
+    binmode $s;
+    print $s "GET http://127.0.0.1:8000$ARGV[0] HTTP/1.1\r\nHost: 127.0.0.1:8000\r\n\r\n";
+    print $s "GET http://127.0.0.1:8000/ping HTTP/1.1\r\nHost: 127.0.0.1:8000\r\n\r\n";
+    print while <$s>;
+  ' "$1"
+}
+
+# the connection must be closed after a body shorter than its Content-Length ...
+request /short.txt > OUT
+test $(grep -c '^HTTP/1.1 200' OUT) -eq 1
+grep -q '^Content-Length: 100' OUT
+tail -n 1 OUT | grep -q '^Hello$'
+
+# ... and after a chunked body without its last chunk, which must not be added
+request /chunked.txt > OUT
+test $(grep -c '^HTTP/1.1 200' OUT) -eq 1
+perl -0777 -ne 's/^.*?\r\n\r\n//s; exit(/(^|\n)0\r\n/ ? 1 : 0)' OUT
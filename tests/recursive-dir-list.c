@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "dir-walk.h"
 #include "util.h"
 
 struct Expected {
@@ -59,6 +60,14 @@ void verify(struct Expected * expected, struct DirListEntry * actual, int length
   }
 }
 
+void add_entry(const char * name, void * data) {
+  struct DirListEntry ** list = data;
+  struct DirListEntry * p = xmalloc(sizeof(struct DirListEntry));
+  p->name = xstrdup(name);
+  p->next = *list;
+  *list = p;
+}
+
 int main(void) {
   atexit(cleanup);
 
@@ -89,5 +98,14 @@ int main(void) {
   verify(expected, list, sizeof(expected) / sizeof(expected[0]));
   free_dir_list(list);
 
+  /* the same with several threads */
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+    expected[i].count = 0;
+  }
+  list = NULL;
+  walk_directory("DIR", 4, add_entry, &list);
+  verify(expected, list, sizeof(expected) / sizeof(expected[0]));
+  free_dir_list(list);
+
   exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,68 @@
+#!/bin/sh
+#    recursive-duplicates.sh - test instrumenting copies of the same file
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr DIR SRC OUT OUT.jscoverage-source.json' 1 2 3 15
+
+export PATH=.:..:$PATH
+
+rm -fr DIR SRC
+mkdir -p SRC/a SRC/b/c SRC/d
+cat > SRC/a/lib.js <<'END'
+function f(n) {
+  var x = 0;
+  for (var i = 0; i < n; i++) {
+    x += i;
+  }
+  return x;
+}
+//#JSCOVERAGE_IF 0
+f(3);
+//#JSCOVERAGE_ENDIF
+END
+cp SRC/a/lib.js SRC/b/c/lib.js
+cp SRC/a/lib.js SRC/d/copy.js
+echo 'var y = 1;' > SRC/d/other.js
+
+# each copy is the same as when it is instrumented on its own
+for options in '' '--local-counters' '--external-source --granularity=block' '--mozilla' '--typed-arrays --sample-rate=0.5'
+do
+  rm -fr DIR
+  $VALGRIND jscoverage $options SRC DIR
+  for file in a/lib.js b/c/lib.js d/copy.js d/other.js
+  do
+    jscoverage $options --id=$file SRC/$file OUT
+    diff OUT DIR/$file
+    if [ -f DIR/$file.jscoverage-source.json ]
+    then
+      diff OUT.jscoverage-source.json DIR/$file.jscoverage-source.json
+    fi
+  done
+done
+
+# the same with several processes
+rm -fr DIR
+$VALGRIND jscoverage --jobs=2 --local-counters SRC DIR
+for file in a/lib.js b/c/lib.js d/copy.js d/other.js
+do
+  jscoverage --local-counters --id=$file SRC/$file OUT
+  diff OUT DIR/$file
+done
+
+rm -fr DIR SRC OUT OUT.jscoverage-source.json
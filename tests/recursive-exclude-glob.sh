@@ -0,0 +1,37 @@
+#!/bin/sh
+#    recursive-exclude-glob.sh - test `--exclude' and `--no-instrument' with wildcards
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr EXPECTED DIR SRC' 1 2 3 15
+
+export PATH=.:..:$PATH
+
+rm -fr EXPECTED DIR SRC
+cp -r recursive SRC
+find SRC -name .svn | xargs rm -fr
+
+$VALGRIND jscoverage SRC EXPECTED
+rm EXPECTED/style.css EXPECTED/1/1.css EXPECTED/1/2/2.css EXPECTED/image.png
+cp SRC/1/2/2.js EXPECTED/1/2/2.js
+cp SRC/script.js EXPECTED/script.js
+
+$VALGRIND jscoverage --exclude='**/*.css' --exclude '*.[gp]ng' --no-instrument='1/**/2.js' --no-instrument 's*.js' SRC DIR
+diff -r EXPECTED DIR
+
+rm -fr EXPECTED DIR SRC
@@ -0,0 +1,70 @@
+#!/bin/sh
+#    recursive-incremental.sh - test instrumenting a directory with --incremental
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr EXPECTED DIR SRC OUT' 1 2 3 15
+
+export PATH=.:..:$PATH
+
+rm -fr EXPECTED DIR SRC OUT
+cp -r recursive SRC
+find SRC -name .svn | xargs rm -fr
+
+# the first run writes everything, and the manifest
+$VALGRIND jscoverage --incremental SRC DIR
+$VALGRIND jscoverage SRC EXPECTED
+test -f DIR/jscoverage-manifest.txt
+diff -r -x jscoverage-manifest.txt EXPECTED DIR
+
+# nothing has changed
+$VALGRIND jscoverage --incremental --verbose SRC DIR > OUT
+! grep -v '^Skipping unchanged file ' OUT
+test `wc -l < OUT` = 13
+diff -r -x jscoverage-manifest.txt EXPECTED DIR
+
+# change one file (keeping its size), add one and remove one
+sed 's/1/2/' SRC/1/1.js > OUT
+cat OUT > SRC/1/1.js
+echo 'var added = 1;' > SRC/new.js
+rm SRC/style.css
+$VALGRIND jscoverage --incremental --verbose SRC DIR > OUT
+grep -v '^Skipping unchanged file ' OUT | sort > OUT.2
+printf 'Instrumenting file 1/1.js\nInstrumenting file new.js\nRemoving file style.css\n' | diff - OUT.2
+rm -f OUT.2
+rm -fr EXPECTED
+$VALGRIND jscoverage SRC EXPECTED
+diff -r -x jscoverage-manifest.txt EXPECTED DIR
+
+# a file removed from the destination directory is written again
+rm DIR/1/2/2.js
+$VALGRIND jscoverage --incremental SRC DIR
+diff -r -x jscoverage-manifest.txt EXPECTED DIR
+
+# different options: everything is written again
+$VALGRIND jscoverage --incremental --no-highlight --verbose SRC DIR > OUT
+! grep '^Skipping' OUT
+rm -fr EXPECTED
+$VALGRIND jscoverage --no-highlight SRC EXPECTED
+diff -r -x jscoverage-manifest.txt EXPECTED DIR
+
+# a run without --incremental removes the manifest
+$VALGRIND jscoverage SRC DIR
+test ! -f DIR/jscoverage-manifest.txt
+
+rm -fr EXPECTED DIR SRC OUT
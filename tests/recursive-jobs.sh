@@ -0,0 +1,60 @@
+#!/bin/sh
+#    recursive-jobs.sh - test instrumenting a directory with --jobs
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr EXPECTED DIR OUT ERR' 1 2 3 15
+
+export PATH=.:..:$PATH
+
+rm -fr DIR EXPECTED OUT ERR
+
+# the output is the same as with a single process
+$VALGRIND jscoverage --exclude=.svn --exclude=1/.svn --exclude=1/2/.svn recursive EXPECTED
+$VALGRIND jscoverage --jobs=3 --exclude=.svn --exclude=1/.svn --exclude=1/2/.svn recursive DIR
+diff -r EXPECTED DIR
+rm -fr DIR
+$VALGRIND jscoverage --jobs 2 --exclude .svn --exclude 1/.svn --exclude 1/2/.svn recursive DIR
+diff -r EXPECTED DIR
+rm -fr DIR EXPECTED
+
+$VALGRIND jscoverage --js-version=1.8 javascript EXPECTED
+$VALGRIND jscoverage --js-version=1.8 --jobs=4 javascript DIR
+diff -r EXPECTED DIR
+rm -fr DIR
+
+# more processes than files
+$VALGRIND jscoverage --jobs=100 --exclude=.svn --exclude=1/.svn --exclude=1/2/.svn recursive DIR
+test -f DIR/1/2/2.js
+
+# verbose output lists every file and reports each process
+rm -fr DIR
+$VALGRIND jscoverage --jobs=2 --verbose --exclude=.svn --exclude=1/.svn --exclude=1/2/.svn recursive DIR > OUT
+grep -v '^Worker ' OUT | sort | diff --strip-trailing-cr verbose.expected.out -
+test `grep -c '^Worker [12]: ' OUT` = 2
+
+# an error in one process stops the run
+rm -fr DIR
+$VALGRIND jscoverage --jobs=2 javascript-invalid DIR 2> ERR && exit 1
+test -s ERR
+
+$VALGRIND jscoverage --jobs=0 recursive DIR 2> ERR && exit 1
+$VALGRIND jscoverage --jobs=x recursive DIR 2> ERR && exit 1
+$VALGRIND jscoverage --jobs recursive DIR 2> ERR && exit 1
+
+rm -fr DIR OUT ERR
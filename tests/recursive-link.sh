@@ -0,0 +1,57 @@
+#!/bin/sh
+#    recursive-link.sh - test instrumenting a directory with --link
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+trap 'rm -fr EXPECTED DIR SRC ORIGINAL' 1 2 3 15
+
+export PATH=.:..:$PATH
+
+rm -fr EXPECTED DIR SRC ORIGINAL
+cp -r recursive SRC
+find SRC -name .svn | xargs rm -fr
+cp -r SRC ORIGINAL
+
+$VALGRIND jscoverage SRC EXPECTED
+$VALGRIND jscoverage --link SRC DIR
+diff -r EXPECTED DIR
+test DIR/style.css -ef SRC/style.css
+test DIR/1/1.html -ef SRC/1/1.html
+! test DIR/1/1.js -ef SRC/1/1.js
+
+# again, over the links
+$VALGRIND jscoverage --link SRC DIR
+diff -r EXPECTED DIR
+test DIR/style.css -ef SRC/style.css
+
+# without --link the links are replaced by copies, leaving the source alone
+$VALGRIND jscoverage SRC DIR
+diff -r EXPECTED DIR
+! test DIR/style.css -ef SRC/style.css
+diff -r ORIGINAL SRC
+
+# a linked file which is later instrumented
+rm -fr DIR
+$VALGRIND jscoverage --link --no-instrument=1 SRC DIR
+test DIR/1/1.js -ef SRC/1/1.js
+$VALGRIND jscoverage --link SRC DIR
+diff -r EXPECTED DIR
+! test DIR/1/1.js -ef SRC/1/1.js
+diff -r ORIGINAL SRC
+
+rm -fr EXPECTED DIR SRC ORIGINAL
@@ -69,3 +69,52 @@ test -s ERR
 ! jscoverage-server --encoding > OUT 2> ERR
 test ! -s OUT
 test -s ERR
+
+! jscoverage-server --js-workers > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --js-workers x > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --backlog > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --backlog=0 > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --threads > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --threads=x > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --timeout > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --timeout=0 > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --workers > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --workers=x > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --unix-socket > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+
+! jscoverage-server --unix-socket=SOCKET --workers=2 > OUT 2> ERR
+test ! -s OUT
+test -s ERR
+test ! -e SOCKET
@@ -0,0 +1,84 @@
+#!/bin/sh
+#    server-js-workers.sh - test jscoverage-server --js-workers
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+shutdown() {
+  wget -q -O- --post-data= "http://127.0.0.1:${server_port}/jscoverage-shutdown" > /dev/null
+  wait $server_pid
+}
+
+cleanup() {
+  rm -fr EXPECTED ACTUAL DIR OUT
+  # kill $server_pid
+  shutdown
+}
+
+trap 'cleanup' 0 1 2 3 15
+
+. ./common.sh
+
+rm -fr EXPECTED ACTUAL DIR OUT
+mkdir DIR
+$VALGRIND jscoverage-server --no-highlight --port=8083 --document-root=recursive --report-dir=DIR --js-workers=2 &
+server_pid=$!
+server_port=8083
+
+wait_for_server http://127.0.0.1:8083/jscoverage.html
+
+# instrumented code is the same as without workers
+wget -q -O- http://127.0.0.1:8083/script.js > OUT
+cat ../report.js ../header.txt ../header.js recursive.expected/script.js | sed 's/@PREFIX@/\//g' | diff --strip-trailing-cr - OUT
+wget -q -O- http://127.0.0.1:8083/1/1.js > OUT
+cat ../report.js ../header.txt ../header.js recursive.expected/1/1.js | sed 's/@PREFIX@/\//g' | diff --strip-trailing-cr - OUT
+wget -q -O- http://127.0.0.1:8083/1/2/2.js > OUT
+cat ../report.js ../header.txt ../header.js recursive.expected/1/2/2.js | sed 's/@PREFIX@/\//g' | diff --strip-trailing-cr - OUT
+
+# more requests than workers at once
+pids=
+for i in 1 2 3 4 5 6
+do
+  wget -q -O- http://127.0.0.1:8083/script.js > /dev/null &
+  pids="$pids $!"
+done
+wait $pids
+
+# load/store
+wget --post-data='{}' -q -O- http://127.0.0.1:8083/jscoverage-store > /dev/null
+echo -n '{}' | diff - DIR/jscoverage.json
+echo 'jscoverage_isReport = true;' | cat ../jscoverage.js - | diff --strip-trailing-cr - DIR/jscoverage.js
+echo 400 > EXPECTED
+! curl -f -w '%{http_code}\n' --data-binary 'x' http://127.0.0.1:8083/jscoverage-store 2> /dev/null > ACTUAL
+diff EXPECTED ACTUAL
+
+# kill $server_pid
+shutdown
+
+# a worker which fails is replaced
+$VALGRIND jscoverage-server --port=8083 --document-root=javascript-invalid --js-workers=1 2> /dev/null &
+server_pid=$!
+server_port=8083
+
+wait_for_server http://127.0.0.1:8083/jscoverage.html
+
+echo 500 > EXPECTED
+! curl -f -w '%{http_code}\n' http://127.0.0.1:8083/javascript-invalid.js 2> /dev/null > ACTUAL
+diff EXPECTED ACTUAL
+! curl -f -w '%{http_code}\n' http://127.0.0.1:8083/javascript-invalid.js 2> /dev/null > ACTUAL
+diff EXPECTED ACTUAL
+wget -q -O- http://127.0.0.1:8083/jscoverage.html | diff ../jscoverage.html -
@@ -0,0 +1,85 @@
+#!/bin/sh
+#    server-unix-socket.sh - test jscoverage-server --unix-socket
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+shutdown() {
+  jscoverage-server --unix-socket=SOCKET --shutdown > /dev/null
+  wait $server_pid
+}
+
+cleanup() {
+  shutdown
+  rm -fr DIR OUT ERR SOCKET
+}
+
+trap 'cleanup' 0 1 2 3 15
+
+. ./common.sh
+
+wait_for_socket() {
+  i=0
+  while [ ! -S SOCKET ]
+  do
+    i=$((i + 1))
+    if [ $i -gt 30 ]
+    then
+      echo "timed out waiting for socket"
+      exit 1
+    fi
+    sleep 1
+  done
+}
+
+rm -fr DIR OUT ERR SOCKET
+mkdir DIR
+$VALGRIND jscoverage-server --no-highlight --unix-socket=SOCKET --document-root=recursive --report-dir=DIR &
+server_pid=$!
+wait_for_socket
+
+./http-client-unix-socket SOCKET GET /script.js > OUT
+cat ../report.js ../header.txt ../header.js recursive.expected/script.js | sed 's/@PREFIX@/\//g' | diff --strip-trailing-cr - OUT
+
+./http-client-unix-socket SOCKET POST /jscoverage-store '{"/script.js":[null,1]}' > OUT
+grep -q '"coverage":\[null,1\]' DIR/jscoverage.json
+
+# a socket which a server is listening on is not taken over
+! jscoverage-server --unix-socket=SOCKET --document-root=recursive > OUT 2> ERR
+test ! -s OUT
+grep -q 'could not bind to socket' ERR
+./http-client-unix-socket SOCKET GET /index.html | diff recursive/index.html -
+
+# the socket is removed when the server stops
+jscoverage-server --unix-socket=SOCKET --shutdown > OUT
+echo 'The server will now shut down' | diff - OUT
+wait $server_pid
+test ! -e SOCKET
+
+# a socket left behind by a server which was killed is replaced
+$VALGRIND jscoverage-server --unix-socket=SOCKET --document-root=recursive &
+server_pid=$!
+wait_for_socket
+kill -9 $server_pid
+wait $server_pid || true
+test -S SOCKET
+
+$VALGRIND jscoverage-server --unix-socket=SOCKET --document-root=recursive &
+server_pid=$!
+sleep 1
+wait_for_socket
+./http-client-unix-socket SOCKET GET /index.html | diff recursive/index.html -
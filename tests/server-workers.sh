@@ -0,0 +1,68 @@
+#!/bin/sh
+#    server-workers.sh - test jscoverage-server --workers
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+shutdown() {
+  wget -q -O- --post-data= "http://127.0.0.1:${server_port}/jscoverage-shutdown" > /dev/null
+  wait $server_pid
+}
+
+cleanup() {
+  rm -fr EXPECTED ACTUAL DIR OUT
+  shutdown
+}
+
+trap 'cleanup' 0 1 2 3 15
+
+. ./common.sh
+
+rm -fr EXPECTED ACTUAL DIR OUT
+mkdir DIR
+$VALGRIND jscoverage-server --no-highlight --port=8084 --document-root=recursive --report-dir=DIR --workers=2 &
+server_pid=$!
+server_port=8084
+
+wait_for_server http://127.0.0.1:8084/jscoverage.html
+
+# each request may go to either process
+for i in 1 2 3 4
+do
+  wget -q -O- http://127.0.0.1:8084/script.js > OUT
+  cat ../report.js ../header.txt ../header.js recursive.expected/script.js | sed 's/@PREFIX@/\//g' | diff --strip-trailing-cr - OUT
+done
+
+# stores from different processes are merged
+pids=
+for i in 1 2 3 4 5 6
+do
+  wget --post-data='{"/script.js":[null,1]}' -q -O- http://127.0.0.1:8084/jscoverage-store > /dev/null &
+  pids="$pids $!"
+done
+for pid in $pids
+do
+  wait $pid
+done
+grep -q '"coverage":\[null,6\]' DIR/jscoverage.json
+
+# a server process which crashes is replaced
+test $(pgrep -P $server_pid | wc -l) -eq 2
+kill -9 $(pgrep -P $server_pid | head -n 1)
+sleep 2
+test $(pgrep -P $server_pid | wc -l) -eq 2
+wget -q -O- http://127.0.0.1:8084/index.html | diff recursive/index.html -
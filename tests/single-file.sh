@@ -0,0 +1,100 @@
+#!/bin/sh
+#    single-file.sh - test --id option
+#    Copyright (C) 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+set -e
+
+trap 'rm -fr DIR DIR2 DIR3 OUT ERR' 1 2 3 15
+
+. ./common.sh
+
+
+rm -fr DIR DIR2 DIR3
+mkdir -p DIR/sub DIR3
+cat > DIR/sub/counters.js <<'END'
+function f(n) {
+  var x = 0;
+
+  for (var i = 0; i < n; i++) {
+    x += i;
+  }
+  return x;
+}
+f(3);
+END
+jscoverage --no-browser DIR DIR2
+
+# files are the same as in a directory
+$VALGRIND jscoverage --no-browser --id=sub/counters.js DIR/sub/counters.js DIR3/counters.js > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+diff DIR2/sub/counters.js DIR3/counters.js
+test "`ls DIR3`" = counters.js
+
+# standard input and output
+$VALGRIND jscoverage --no-browser --id sub/counters.js < DIR/sub/counters.js > OUT 2> ERR
+test ! -s ERR
+diff DIR2/sub/counters.js OUT
+$VALGRIND jscoverage --no-browser --id=sub/counters.js - - < DIR/sub/counters.js > OUT 2> ERR
+test ! -s ERR
+diff DIR2/sub/counters.js OUT
+rm -f DIR3/counters.js
+$VALGRIND jscoverage --no-browser --id=sub/counters.js - DIR3/counters.js < DIR/sub/counters.js > OUT 2> ERR
+test ! -s OUT
+test ! -s ERR
+diff DIR2/sub/counters.js DIR3/counters.js
+
+# --external-source writes the source next to the output file
+rm -fr DIR2 DIR3
+mkdir DIR3
+jscoverage --no-browser --external-source DIR DIR2
+$VALGRIND jscoverage --no-browser --external-source --id=sub/counters.js DIR/sub/counters.js DIR3/counters.js
+diff DIR2/sub/counters.js DIR3/counters.js
+diff DIR2/sub/counters.js.jscoverage-source.json DIR3/counters.js.jscoverage-source.json
+if jscoverage --external-source --id=sub/counters.js DIR/sub/counters.js > OUT 2> ERR
+then
+  exit 1
+fi
+test ! -s OUT
+grep -q -F 'jscoverage: --external-source cannot be used with standard output' ERR
+
+# an instrumented file is rejected, and no output is written
+if jscoverage --id=sub/counters.js DIR2/sub/counters.js DIR3/x.js > OUT 2> ERR
+then
+  exit 1
+fi
+test ! -s OUT
+test ! -f DIR3/x.js
+grep -q -F 'jscoverage: file DIR2/sub/counters.js appears to be already instrumented' ERR
+
+# options for directories
+if jscoverage --id=sub/counters.js --jobs=2 DIR/sub/counters.js > OUT 2> ERR
+then
+  exit 1
+fi
+test ! -s OUT
+grep -q -F 'jscoverage: --jobs cannot be used with --id' ERR
+
+if jscoverage --id= DIR/sub/counters.js > OUT 2> ERR
+then
+  exit 1
+fi
+test ! -s OUT
+grep -q -F 'jscoverage: --id: option must not be empty' ERR
+
+rm -fr DIR DIR2 DIR3 OUT ERR
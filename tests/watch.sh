@@ -0,0 +1,100 @@
+#!/bin/sh
+#    watch.sh - test jscoverage --watch
+#    Copyright (C) 2008, 2009, 2010 siliconforks.com
+#
+#    This program is free software; you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation; either version 2 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License along
+#    with this program; if not, write to the Free Software Foundation, Inc.,
+#    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+set -e
+
+cleanup() {
+  if [ -n "$watch_pid" ]
+  then
+    kill $watch_pid
+  fi
+  rm -fr EXPECTED DIR SRC OUT ERR
+}
+
+trap 'cleanup' 0 1 2 3 15
+
+export PATH=.:..:$PATH
+
+if jscoverage --watch 2>&1 | grep -q 'not supported'
+then
+  exit 0
+fi
+
+# waits until a test succeeds
+wait_for() {
+  i=0
+  while [ $i -lt 40 ] && ! eval "$1"
+  do
+    i=`expr $i + 1`
+    sleep 0.25
+  done
+  if [ $i = 40 ]
+  then
+    echo "timed out waiting for: $1"
+    exit 1
+  fi
+}
+
+rm -fr EXPECTED DIR SRC OUT ERR
+cp -r recursive SRC
+find SRC -name .svn | xargs rm -fr
+
+$VALGRIND jscoverage --watch --verbose --exclude=excluded SRC DIR > OUT 2> ERR &
+watch_pid=$!
+wait_for "grep -q '^Watching directory' OUT"
+
+# a new file
+echo 'var added = 1;' > SRC/added.js
+wait_for "test -f DIR/added.js"
+
+# a changed file
+sed 's/1/2/' SRC/1/1.js > SRC/1/1.js.tmp
+cat SRC/1/1.js.tmp > SRC/1/1.js
+rm SRC/1/1.js.tmp
+wait_for "grep -q 'This is 2' DIR/1/1.js"
+
+# a new directory
+mkdir -p SRC/new/sub
+echo 'x();' > SRC/new/sub/new.js
+wait_for "test -f DIR/new/sub/new.js"
+
+# removed files
+rm SRC/style.css
+wait_for "test ! -f DIR/style.css"
+rm -r SRC/new
+wait_for "test ! -d DIR/new"
+
+# a syntax error is reported, but does not stop watching
+echo 'var = ;' > SRC/bad.js
+wait_for "grep -q 'parse error in file bad.js' ERR"
+test ! -f DIR/bad.js
+echo 'var good = 1;' > SRC/bad.js
+wait_for "test -f DIR/bad.js"
+
+# excluded files are not copied
+mkdir SRC/excluded
+echo 'var x = 1;' > SRC/excluded/x.js
+echo 'var last = 1;' > SRC/last.js
+wait_for "test -f DIR/last.js"
+test ! -d DIR/excluded
+
+# the result is the same as copying the directory again
+kill $watch_pid
+watch_pid=
+$VALGRIND jscoverage --exclude=excluded SRC EXPECTED
+diff -r EXPECTED DIR
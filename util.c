@@ -33,17 +33,54 @@
 #include <strings.h>
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 const char * program = NULL;
 
+static MessageHandler fatal_handler = NULL;
+static MessageHandler warning_handler = NULL;
+
+void set_fatal_handler(MessageHandler handler) {
+  fatal_handler = handler;
+}
+
+void set_warning_handler(MessageHandler handler) {
+  warning_handler = handler;
+}
+
+/* formats a message (without allocating memory, which may be what failed) and passes it to a handler */
+static void call_handler(MessageHandler handler, const char * source_file, unsigned int line_number, const char * format, va_list ap) {
+  char message[1024];
+  size_t length = 0;
+  if (source_file != NULL) {
+    int n = snprintf(message, sizeof(message), "%s:%u: ", source_file, line_number);
+    if (n > 0) {
+      length = (size_t) n < sizeof(message)? (size_t) n: sizeof(message) - 1;
+    }
+  }
+  vsnprintf(message + length, sizeof(message) - length, format, ap);
+  handler(message);
+}
+
 void fatal(const char * format, ...) {
-  fprintf(stderr, "%s: ", program);
   va_list ap;
   va_start(ap, format);
+  if (fatal_handler != NULL) {
+    call_handler(fatal_handler, NULL, 0, format, ap);
+    abort();
+  }
+  fprintf(stderr, "%s: ", program);
   vfprintf(stderr, format, ap);
   va_end(ap);
   fputc('\n', stderr);
@@ -51,9 +88,13 @@ void fatal(const char * format, ...) {
 }
 
 void fatal_command_line(const char * format, ...) {
-  fprintf(stderr, "%s: ", program);
   va_list ap;
   va_start(ap, format);
+  if (fatal_handler != NULL) {
+    call_handler(fatal_handler, NULL, 0, format, ap);
+    abort();
+  }
+  fprintf(stderr, "%s: ", program);
   vfprintf(stderr, format, ap);
   va_end(ap);
   fputc('\n', stderr);
@@ -62,9 +103,13 @@ void fatal_command_line(const char * format, ...) {
 }
 
 void fatal_source(const char * source_file, unsigned int line_number, const char * format, ...) {
-  fprintf(stderr, "%s:%s:%u: ", program, source_file, line_number);
   va_list ap;
   va_start(ap, format);
+  if (fatal_handler != NULL) {
+    call_handler(fatal_handler, source_file, line_number, format, ap);
+    abort();
+  }
+  fprintf(stderr, "%s:%s:%u: ", program, source_file, line_number);
   vfprintf(stderr, format, ap);
   va_end(ap);
   fputc('\n', stderr);
@@ -72,9 +117,14 @@ void fatal_source(const char * source_file, unsigned int line_number, const char
 }
 
 void warn_source(const char * source_file, unsigned int line_number, const char * format, ...) {
-  fprintf(stderr, "%s:%s:%u: ", program, source_file, line_number);
   va_list ap;
   va_start(ap, format);
+  if (warning_handler != NULL) {
+    call_handler(warning_handler, source_file, line_number, format, ap);
+    va_end(ap);
+    return;
+  }
+  fprintf(stderr, "%s:%s:%u: ", program, source_file, line_number);
   vfprintf(stderr, format, ap);
   va_end(ap);
   fputc('\n', stderr);
@@ -245,6 +295,17 @@ void xchdir(const char * directory) {
   }
 }
 
+/* 64-bit FNV-1a */
+uint64_t hash_bytes(const void * p, size_t size) {
+  const uint8_t * bytes = p;
+  uint64_t result = UINT64_C(14695981039346656037);
+  for (size_t i = 0; i < size; i++) {
+    result ^= bytes[i];
+    result *= UINT64_C(1099511628211);
+  }
+  return result;
+}
+
 bool str_starts_with(const char * string, const char * prefix) {
   const char * string_ptr = string;
   const char * prefix_ptr = prefix;
@@ -410,10 +471,56 @@ void copy_stream(FILE * source, FILE * destination) {
   }
 }
 
+/*
+Copies as much as it can of one file to another without passing the data
+through user space: first by sharing the data (a reflink, on file systems which
+support it), then by copying within the kernel.  Each method continues from
+where the previous one stopped, so the caller finishes the copy with ordinary
+reads and writes.
+*/
+static void copy_file_descriptor(int source, int destination) {
+#ifdef FICLONE
+  if (ioctl(destination, FICLONE, source) == 0) {
+    lseek(source, 0, SEEK_END);
+    lseek(destination, 0, SEEK_END);
+    return;
+  }
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+  for (;;) {
+    ssize_t n = copy_file_range(source, NULL, destination, NULL, 1 << 30, 0);
+    if (n == 0) {
+      return;
+    }
+    if (n == -1) {
+      break;
+    }
+  }
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+  for (;;) {
+    ssize_t n = sendfile(destination, source, NULL, 1 << 30);
+    if (n == 0) {
+      return;
+    }
+    if (n == -1) {
+      break;
+    }
+  }
+#endif
+}
+
 void copy_file(const char * source_file, const char * destination_file) {
   FILE * source = xfopen(source_file, "rb");
   FILE * destination = xfopen(destination_file, "wb");
 
+  copy_file_descriptor(fileno(source), fileno(destination));
+
+  /* copy whatever is left: start the streams where the descriptors are */
+  fseek(source, 0, SEEK_CUR);
+  fseek(destination, 0, SEEK_CUR);
   copy_stream(source, destination);
 
 #ifndef _WIN32
@@ -430,6 +537,19 @@ void copy_file(const char * source_file, const char * destination_file) {
   fclose(destination);
 }
 
+void link_file(const char * source_file, const char * destination_file) {
+#ifndef _WIN32
+  if (unlink(destination_file) == -1 && errno != ENOENT) {
+    fatal("cannot remove file: %s", destination_file);
+  }
+  /* the source may be a symbolic link: link what it points to */
+  if (linkat(AT_FDCWD, source_file, AT_FDCWD, destination_file, AT_SYMLINK_FOLLOW) == 0) {
+    return;
+  }
+#endif
+  copy_file(source_file, destination_file);
+}
+
 bool directory_is_empty(const char * directory) {
   bool result = true;
   DIR * dir = xopendir(directory);
@@ -445,67 +565,6 @@ bool directory_is_empty(const char * directory) {
   return result;
 }
 
-static struct DirListEntry * recursive_dir_list(const char * root, const char * directory_wrt_root, struct DirListEntry * head) {
-  char * directory = directory_wrt_root == NULL? xstrdup(root): make_path(root, directory_wrt_root);
-  DIR * dir = xopendir(directory);
-  struct dirent * e;
-  while ((e = readdir(dir)) != NULL) {
-    if (strcmp(e->d_name, ".") == 0 ||
-        strcmp(e->d_name, "..") == 0) {
-      continue;
-    }
-    char * entry = make_path(directory, e->d_name);
-    char * entry_wrt_root = directory_wrt_root == NULL? xstrdup(e->d_name): make_path(directory_wrt_root, e->d_name);
-    struct stat buf;
-    xlstat(entry, &buf);
-    if (S_ISREG(buf.st_mode)) {
-      struct DirListEntry * p = xmalloc(sizeof(struct DirListEntry));
-      p->name = entry_wrt_root;
-      p->next = head;
-      head = p;
-    }
-    else if (S_ISDIR(buf.st_mode)) {
-      head = recursive_dir_list(root, entry_wrt_root, head);
-      free(entry_wrt_root);
-    }
-#ifndef _WIN32
-    else if (S_ISLNK(buf.st_mode)) {
-      /* check what it points to */
-      xstat(entry, &buf);
-      if (S_ISREG(buf.st_mode)) {
-        struct DirListEntry * p = xmalloc(sizeof(struct DirListEntry));
-        p->name = entry_wrt_root;
-        p->next = head;
-        head = p;
-      }
-      else {
-        fatal("refusing to follow symbolic link: %s", entry);
-      }
-    }
-#endif
-    else {
-      fatal("unknown file type: %s", entry);
-    }
-    free(entry);
-  }
-  closedir(dir);
-  free(directory);
-  return head;
-}
-
-struct DirListEntry * make_recursive_dir_list(const char * directory) {
-  return recursive_dir_list(directory, NULL, NULL);
-}
-
-void free_dir_list(struct DirListEntry * list) {
-  while (list != NULL) {
-    struct DirListEntry * next = list->next;
-    free(list->name);
-    free(list);
-    list = next;
-  }
-}
-
 #ifndef HAVE_STRNDUP
 char * strndup(const char * s, size_t size) {
   size_t length = strlen(s);
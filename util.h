@@ -24,6 +24,7 @@
 #include <stdarg.h>
 #endif
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -50,6 +51,19 @@ void fatal_source(const char * source_file, unsigned int line_number, const char
 void warn_source(const char * source_file, unsigned int line_number, const char * format, ...)
   __attribute__((__format__(printf, 3, 4)));
 
+/*
+By default fatal and friends print the message (after the program name) and
+exit, and warn_source prints the message.  A program using this code as a
+library may instead have the message (with the file name and line number, if
+any, but no program name) passed to a handler.  A fatal handler must not
+return: it is expected to longjmp out.  Passing NULL restores the default.
+*/
+typedef void (*MessageHandler)(const char * message);
+
+void set_fatal_handler(MessageHandler handler);
+
+void set_warning_handler(MessageHandler handler);
+
 void version(void)
   __attribute__((__noreturn__));
 
@@ -83,6 +97,8 @@ void mkdir_if_necessary(const char * directory);
 
 void mkdirs(const char * path);
 
+uint64_t hash_bytes(const void * p, size_t size);
+
 bool str_starts_with(const char * string, const char * prefix);
 
 bool str_ends_with(const char * string, const char * suffix);
@@ -103,16 +119,10 @@ void copy_stream(FILE * source, FILE * destination);
 
 void copy_file(const char * source_file, const char * destination_file);
 
-bool directory_is_empty(const char * directory);
-
-struct DirListEntry {
-  char * name;
-  struct DirListEntry * next;
-};
+/* makes destination_file a hard link to source_file, or a copy where that is not possible */
+void link_file(const char * source_file, const char * destination_file);
 
-struct DirListEntry * make_recursive_dir_list(const char * directory);
-
-void free_dir_list(struct DirListEntry * list);
+bool directory_is_empty(const char * directory);
 
 #ifndef HAVE_STRNDUP
 char * strndup(const char * s, size_t size);
@@ -0,0 +1,299 @@
+/*
+    worker-pool.c - pool of worker processes
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include <config.h>
+
+#include "worker-pool.h"
+
+#ifndef __MINGW32__
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "util.h"
+
+/*
+Each worker is a forked process connected to the parent by a socket.  Messages
+in both directions are a 32-bit length (in host byte order) followed by that
+many bytes.
+*/
+
+struct Worker {
+  pid_t pid;
+  int fd;
+  bool busy;
+};
+
+struct WorkerPool {
+  WorkerFunction f;
+  struct Worker * workers;
+  size_t num_workers;
+  pthread_mutex_t mutex;
+  pthread_cond_t idle;
+};
+
+static int write_all(int fd, const void * p, size_t size) {
+  const uint8_t * bytes = p;
+  while (size > 0) {
+    ssize_t n = write(fd, bytes, size);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    bytes += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static int read_all(int fd, void * p, size_t size) {
+  uint8_t * bytes = p;
+  while (size > 0) {
+    ssize_t n = read(fd, bytes, size);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (n == 0) {
+      return -1;
+    }
+    bytes += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static int write_message(int fd, const uint8_t * data, size_t length) {
+  if (length > UINT32_MAX) {
+    return -1;
+  }
+  uint32_t n = length;
+  if (write_all(fd, &n, sizeof(n)) != 0) {
+    return -1;
+  }
+  return write_all(fd, data, length);
+}
+
+static int read_message(int fd, Stream * stream) {
+  uint32_t n;
+  if (read_all(fd, &n, sizeof(n)) != 0) {
+    return -1;
+  }
+  Stream_reset(stream);
+  uint8_t buffer[8192];
+  while (n > 0) {
+    size_t size = n < sizeof(buffer)? n: sizeof(buffer);
+    if (read_all(fd, buffer, size) != 0) {
+      return -1;
+    }
+    Stream_write(stream, buffer, size);
+    n -= size;
+  }
+  return 0;
+}
+
+/*
+A worker may be forked while other threads hold sockets (client connections,
+the listening socket, other workers): close everything except its own socket
+so that it never keeps those open.
+*/
+static void close_inherited_descriptors(int keep) {
+  DIR * d = opendir("/proc/self/fd");
+  if (d == NULL) {
+    long max = sysconf(_SC_OPEN_MAX);
+    for (int fd = 3; fd < max; fd++) {
+      if (fd != keep) {
+        close(fd);
+      }
+    }
+    return;
+  }
+
+  /* collect the descriptors first: closing them while reading the directory is not safe */
+  int dir_fd = dirfd(d);
+  size_t count = 0;
+  size_t capacity = 64;
+  int * fds = xnew(int, capacity);
+  struct dirent * e;
+  while ((e = readdir(d)) != NULL) {
+    char * end;
+    long fd = strtol(e->d_name, &end, 10);
+    if (*end != '\0' || end == e->d_name || fd < 3 || fd == keep || fd == dir_fd) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity = mulst(capacity, 2);
+      fds = xrealloc(fds, mulst(capacity, sizeof(int)));
+    }
+    fds[count] = fd;
+    count++;
+  }
+  closedir(d);
+  for (size_t i = 0; i < count; i++) {
+    close(fds[i]);
+  }
+  free(fds);
+}
+
+static void worker_main(int fd, WorkerFunction f) {
+  close_inherited_descriptors(fd);
+
+  Stream * request = Stream_new(0);
+  Stream * response = Stream_new(0);
+  while (read_message(fd, request) == 0) {
+    Stream_reset(response);
+    f(request->data, request->length, response);
+    if (write_message(fd, response->data, response->length) != 0) {
+      break;
+    }
+  }
+  Stream_delete(request);
+  Stream_delete(response);
+  exit(EXIT_SUCCESS);
+}
+
+static int start_worker(WorkerPool * pool, struct Worker * worker) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    return -1;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    worker_main(fds[1], pool->f);
+  }
+  close(fds[1]);
+  worker->pid = pid;
+  worker->fd = fds[0];
+  return 0;
+}
+
+static void stop_worker(struct Worker * worker) {
+  close(worker->fd);
+  worker->fd = -1;
+  while (waitpid(worker->pid, NULL, 0) == -1 && errno == EINTR) {
+    ;
+  }
+  worker->pid = -1;
+}
+
+WorkerPool * WorkerPool_new(size_t num_workers, WorkerFunction f) {
+  WorkerPool * pool = xmalloc(sizeof(WorkerPool));
+  pool->f = f;
+  pool->workers = xnew(struct Worker, num_workers);
+  pool->num_workers = num_workers;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+  for (size_t i = 0; i < num_workers; i++) {
+    pool->workers[i].busy = false;
+    if (start_worker(pool, pool->workers + i) != 0) {
+      fatal("cannot start worker process");
+    }
+  }
+  return pool;
+}
+
+int WorkerPool_call(WorkerPool * pool, const uint8_t * request, size_t length, Stream * response) {
+  pthread_mutex_lock(&pool->mutex);
+  struct Worker * worker = NULL;
+  for (;;) {
+    for (size_t i = 0; i < pool->num_workers; i++) {
+      if (! pool->workers[i].busy) {
+        worker = pool->workers + i;
+        break;
+      }
+    }
+    if (worker != NULL) {
+      break;
+    }
+    pthread_cond_wait(&pool->idle, &pool->mutex);
+  }
+  worker->busy = true;
+  pthread_mutex_unlock(&pool->mutex);
+
+  int result = 0;
+  if (worker->fd == -1) {
+    result = start_worker(pool, worker);
+  }
+  if (result == 0) {
+    result = write_message(worker->fd, request, length);
+  }
+  if (result == 0) {
+    result = read_message(worker->fd, response);
+  }
+  if (result != 0 && worker->fd != -1) {
+    /* the worker died (or is unusable): replace it on its next use */
+    stop_worker(worker);
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  worker->busy = false;
+  pthread_cond_broadcast(&pool->idle);
+  pthread_mutex_unlock(&pool->mutex);
+  return result;
+}
+
+void WorkerPool_delete(WorkerPool * pool) {
+  pthread_mutex_lock(&pool->mutex);
+  for (size_t i = 0; i < pool->num_workers; i++) {
+    while (pool->workers[i].busy) {
+      pthread_cond_wait(&pool->idle, &pool->mutex);
+    }
+    if (pool->workers[i].fd != -1) {
+      stop_worker(pool->workers + i);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->idle);
+  free(pool->workers);
+  free(pool);
+}
+
+#else
+
+WorkerPool * WorkerPool_new(size_t num_workers, WorkerFunction f) {
+  return NULL;
+}
+
+int WorkerPool_call(WorkerPool * pool, const uint8_t * request, size_t length, Stream * response) {
+  return -1;
+}
+
+void WorkerPool_delete(WorkerPool * pool) {
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+    worker-pool.h - pool of worker processes
+    Copyright (C) 2008, 2009, 2010 siliconforks.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "stream.h"
+
+/*
+Called in a worker process for each request.  The function writes its result
+to the response stream.  It may call fatal(): the worker process exits, the
+call fails in the parent and a fresh worker is started in its place.
+*/
+typedef void (*WorkerFunction)(const uint8_t * request, size_t length, Stream * response);
+
+typedef struct WorkerPool WorkerPool;
+
+/*
+Starts num_workers worker processes, each a fork of the calling process.
+Returns NULL if worker processes are not supported on this platform.
+*/
+WorkerPool * WorkerPool_new(size_t num_workers, WorkerFunction f);
+
+/*
+Sends a request to an idle worker (waiting for one if necessary) and reads its
+response.  May be called from any thread.  Returns 0 on success, -1 if the
+worker failed.
+*/
+int WorkerPool_call(WorkerPool * pool, const uint8_t * request, size_t length, Stream * response) __attribute__((warn_unused_result));
+
+void WorkerPool_delete(WorkerPool * pool);
+
+#endif /* WORKER_POOL_H_ */